@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * File             : channel.h
+ * Path             : pvm/include
+ * Author           : Muhammad Adriano Raksi
+ * Created          : 17-10-26 (DD-MM-YY)
+ *------------------------------------------------------------------------------
+ * Contains the message channels of the VM, addressed by the ID CHAN_NEW gives.
+ * A channel is a bounded ring buffer that threads send values to and receive
+ * them from without a lock. A thread that has to wait for room or for a value
+ * is parked off the run queue like on a synchronisation object.
+ ******************************************************************************/
+
+#ifndef CHANNEL_H
+#define CHANNEL_H 11
+
+#include "common.h"
+#include <stdbool.h>
+
+/* Number of channels, their IDs go from 0 up to it */
+#define CHAN_LIMIT 256
+
+typedef struct PineVMChannelCell
+{
+    /*
+     * Twice the position of the channel the cell is sent to next, plus one
+     * once a value was sent there. Received again, it is twice the position
+     * a capacity later, so the two never look alike even for a single cell.
+     */
+    uint64_t sequence;
+
+    /* The value sent */
+    PrimitiveData data;
+} ChannelCell;
+
+/* Threads blocked on a channel, linked through Thread.link in the order they came */
+typedef struct PineVMChannelWaiters
+{
+    va_t head, tail;
+} ChannelWaiters;
+
+typedef struct PineVMChannel
+{
+    /* Ring buffer, NULL until the channel is made by CHAN_NEW */
+    ChannelCell *cells;
+
+    /* Number of cells */
+    uint64_t capacity;
+
+    /*
+     * Whether at most one thread sends and one receives at once, which then
+     * move the positions without a compare-and-swap
+     */
+    bool single;
+
+    /* Waiting for room, and for a value */
+    ChannelWaiters senders, receivers;
+
+    /* Positions the next value is sent to and received from, on cache lines of their own */
+    uint64_t tail __attribute__((aligned(64)));
+    uint64_t head __attribute__((aligned(64)));
+} Channel;
+
+/*
+ * Function : chn_initialise
+ * -------------------------
+ * Initialises a channel that is not made yet.
+ *
+ * @param   : Pointer to Channel instance
+ * @return  : Error code
+ */
+int chn_initialise(Channel *);
+
+/*
+ * Function : chn_finalise
+ * -------------------------
+ * Frees the ring buffer of a channel.
+ *
+ * @param   : Pointer to Channel instance
+ * @return  : Error code
+ */
+int chn_finalise(Channel *);
+
+/*
+ * Function : chn_new
+ * ------------------
+ * Makes a channel of a number of cells, and reports an error once every ID
+ * is taken.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Capacity, at least 1
+ * @param   : Whether at most one thread sends and one receives at once
+ * @return  : Channel ID
+ */
+va_t chn_new(VM *, uint64_t, bool);
+
+/*
+ * Function : chn_send
+ * -------------------
+ * Sends values to a channel, as many as there is room for, and wakes up as
+ * many of the threads waiting for a value. When there is no room at all and
+ * the thread may block, it waits until a value is received, and has to send
+ * again then.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Channel ID
+ * @param   : Values to send
+ * @param   : Number of values
+ * @param   : Whether the thread blocks when the channel is full
+ * @return  : Number of values sent
+ */
+size_t chn_send(VM *, va_t, va_t, const PrimitiveData *, size_t, bool);
+
+/*
+ * Function : chn_recv
+ * -------------------
+ * Receives values from a channel, as many as it holds, in the order they were
+ * sent, and wakes up as many of the threads waiting for room. When it is
+ * empty and the thread may block, it waits until a value is sent, and has to
+ * receive again then.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Channel ID
+ * @param   : Where the values go
+ * @param   : Number of values wanted
+ * @param   : Whether the thread blocks when the channel is empty
+ * @return  : Number of values received
+ */
+size_t chn_recv(VM *, va_t, va_t, PrimitiveData *, size_t, bool);
+
+#endif /* CHANNEL_H */
@@ -12,6 +12,50 @@
 #define CODESEG_H 6
 
 #include "common.h"
+#include <stdbool.h>
+
+typedef struct PineVMInstruction
+{
+    /*
+     * Address of the label that performs this instruction in the interpreter
+     * loop. Resolved from 'opcode' by thr_run the first time the code runs.
+     */
+    const void *handler;
+
+    /* The opcode this instruction was decoded from */
+    opcode_t opcode;
+
+    /*
+     * REGISTER_ADDRESS operands, as indices into ControlUnit.regfile. The
+     * register results are written to is always reg[2], REG_AR unless the
+     * instruction names one.
+     */
+    uint8_t reg[3];
+
+    union
+    {
+        /*
+         * Index of the instruction a compare-and-branch opcode branches to, the
+         * default target of SWITCH
+         */
+        uint32_t target;
+
+        /* TYPE operand, for CAST and MALLOC_TYPED, which never branch */
+        uint8_t type;
+    };
+
+    union
+    {
+        /*
+         * Address and size operands, in native endianness. SWITCH keeps where
+         * its jump table starts in CodeSeg.table and the number of entries.
+         */
+        uint64_t imm[2];
+
+        /* Typed RAW_DATA operand, for LOAD and the immediate forms */
+        PrimitiveData data;
+    };
+} Instruction;
 
 typedef struct PineVMCodeSegment
 {
@@ -34,6 +78,48 @@ typedef struct PineVMCodeSegment
      * VM program on the console.
      */
     char *filepath;
+
+    /*
+     * Whether 'content' is in the compact encoding rather than the original
+     * one. @see: csg_compact.
+     */
+    bool compact;
+
+    /*
+     * The bytecode decoded once at load time, which is what threads actually
+     * run. Operands are already resolved so no instruction has to parse bytes
+     * at run time. The last entry is an extra HLT so running past the end of
+     * the code segment halts the thread.
+     */
+    Instruction *instr;
+
+    /* Number of decoded instructions, excluding the extra HLT */
+    size_t length;
+
+    /*
+     * The jump tables of every SWITCH one after the other, as indices into
+     * 'instr' that are checked when the code is decoded
+     */
+    uint32_t *table;
+
+    /* Number of entries in 'table' */
+    size_t tablesize;
+
+    /*
+     * Maps a byte offset in 'content' to the index in 'instr' of the
+     * instruction that starts there, or CSG_NOINSTR. Jump targets in the
+     * bytecode are byte offsets and are translated through this.
+     */
+    va_t *offsetmap;
+
+    /* Whether the handlers of 'instr' have been resolved */
+    bool linked;
+
+    /*
+     * How many times each instruction in 'instr' was performed. Only kept
+     * when profiling, NULL otherwise. @see: csg_profile.
+     */
+    uint64_t *profile;
 } CodeSeg;
 
 /*
@@ -45,9 +131,83 @@ typedef struct PineVMCodeSegment
  *
  * @param   : Pointer to CodeSeg instance
  * @param   : Bytecode file path
+ * @param   : Whether the file is in the compact encoding (MAGIC_COMPACT)
+ * @return  : Error code
+ */
+int csg_initialise(CodeSeg *, const char *, FILE *, bool);
+
+/*
+ * Function : csg_decode
+ * ------------------------
+ * Decodes 'content' into 'instr' and builds 'offsetmap'. Reports an error for
+ * unknown opcodes, register and type operands, or a truncated instruction.
+ *
+ * @param   : Pointer to CodeSeg instance
  * @return  : Error code
  */
-int csg_initialise(CodeSeg *, const char *, FILE *);
+int csg_decode(CodeSeg *);
+
+/*
+ * Function : csg_compact
+ * ------------------------
+ * Writes 'content' in the compact encoding. Instructions keep their opcode,
+ * followed by their register operands as 4-bit regfile indices, two to a
+ * byte with the first in the low nibble. The other operands follow in the
+ * order of the layout: addresses and sizes as unsigned LEB128, integer
+ * literals as LEB128 after their TYPE (zigzag encoded when signed), DBL
+ * literals as 8 little endian bytes. Branch displacements are zigzag encoded
+ * LEB128, and so are the targets of a SWITCH jump table, after its number of
+ * entries as unsigned LEB128.
+ *
+ * Jump targets are byte offsets in the encoding they are run from, so the
+ * LOAD literals that reach a jump are rewritten to the new offsets. Reports
+ * an error for a jump through anything else, which cannot be rewritten.
+ *
+ * @param   : Pointer to CodeSeg instance, in the original encoding
+ * @param   : Stream to write to
+ * @return  : Error code
+ */
+int csg_compact(CodeSeg *, FILE *);
+
+/*
+ * Function : csg_fuse
+ * ------------------------
+ * Gives the first instruction of every frequent sequence in 'instr' the
+ * opcode of the superinstruction that performs the whole sequence. The other
+ * instructions of the sequence are left as they are. @see: opc_Fusion in
+ * pvm/src/opcode.c for the sequences.
+ *
+ * @param   : Pointer to CodeSeg instance
+ * @return  : Error code
+ */
+int csg_fuse(CodeSeg *);
+
+/*
+ * Function : csg_profile
+ * ------------------------
+ * Undoes csg_fuse and starts counting how many times each instruction is
+ * performed. Has to be called before the code first runs.
+ *
+ * @param   : Pointer to CodeSeg instance
+ * @return  : Error code
+ */
+int csg_profile(CodeSeg *);
+
+/*
+ * Function : csg_dumpprofile
+ * ------------------------
+ * Prints the opcode pairs and triples performed most often in a row, after a
+ * run that was profiled. Sequences are only counted where every instruction
+ * but the last always carries on with the next one.
+ *
+ * @param   : Pointer to CodeSeg instance
+ * @param   : Stream to print to
+ * @return  : Error code
+ */
+int csg_dumpprofile(CodeSeg *, FILE *);
+
+/* Number of pairs and triples csg_dumpprofile prints */
+#define CSG_PROFILE_TOP 16
 
 /*
  * Function : csg_finalise
@@ -59,4 +219,24 @@ int csg_initialise(CodeSeg *, const char *, FILE *);
  */
 int csg_finalise(CodeSeg *);
 
+/* Value of offsetmap for bytes that do not start an instruction */
+#define CSG_NOINSTR ((va_t) -1)
+
+/*
+ * Function : csg_locate
+ * ------------------------
+ * Translates a byte offset in the bytecode, which is what jump operands hold,
+ * into the index of the decoded instruction that starts there.
+ *
+ * @param   : Pointer to CodeSeg instance
+ * @param   : Byte offset in 'content'
+ * @return  : Index in 'instr'
+ */
+static inline va_t csg_locate(CodeSeg *codeseg, va_t offset)
+{
+    if (offset > codeseg->size || codeseg->offsetmap[offset] == CSG_NOINSTR)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal jump target");
+    return codeseg->offsetmap[offset];
+}
+
 #endif /* CODESEG_H */
@@ -12,28 +12,119 @@
 #define CORE_H 1
 
 #include "opcode.h"
+#include "sync.h"
+#include "channel.h"
+#include <pthread.h>
+#include <stdbool.h>
 
-#define THREAD_LIMIT 256
+/*
+ * Number of thread slots the table is reserved for. Every thread also maps a
+ * stack and its guard page, two mappings, so fewer threads may be alive at
+ * once under the mapping limit of the OS. @see: Core.thread_limit.
+ */
+#define THREAD_LIMIT 0x10000
 
-typedef struct PineVMCore
+/* Mappings left under the limit of the OS for the heap, the JIT and the libraries */
+#define CORE_MAP_RESERVE 0x1000
+
+#define WORKER_LIMIT 256
+
+/*
+ * An OS thread that runs VM threads (pvm --workers). Every worker keeps the
+ * threads it runs in its own deque and takes the next one from the front. A
+ * worker whose deque is empty steals from the back of another one. VM threads
+ * keep their whole state in Thread, so they run on whichever worker has them.
+ */
+typedef struct PineVMWorker
 {
-    /* An index that points to the running thread in thread_pool */
-    uint8_t running_thread;
+    /* The OS thread, unused for worker 0 which runs on the caller of core_run */
+    pthread_t handle;
+
+    /* Guards the deque, taken by the worker itself and by thieves */
+    pthread_mutex_t lock;
 
-    /* Number of threads spawned */
+    /*
+     * Ring buffer of the thread IDs in the deque, 'size' of them from 'head'.
+     * A thread is in one deque at most, so it never fills up.
+     */
+    va_t deque[THREAD_LIMIT];
+    size_t head, size;
+
+    /* The VM this worker runs threads of, and its index in Core.workers */
+    VM *vm;
+    unsigned int id;
+} Worker;
+
+typedef struct PineVMCore
+{
+    /* Number of threads spawned and not killed yet */
     size_t thread_num;
 
     /*
-     * The thread pool size is precompiled. This means that there is a maximum
-     * number of threads spawned possible and also takes up the same amount of
-     * space throughout the lifetime of this program. Although the threads are
-     * already created, they are virtually not alive because this program needs
-     * to explicitly spawn a thread its own way to be used by this program.
+     * The thread table, THREAD_LIMIT slots reserved at once with mmap. The OS
+     * commits its pages as threads are spawned into them, so it takes up
+     * memory for the most threads alive at once rather than for the limit,
+     * and a thread never moves while the VM holds pointers to it.
      */
-    Thread thread_pool[THREAD_LIMIT];
+    Thread *thread_pool;
+
+    /*
+     * Slots given out so far, and the first of the slots given back by
+     * thr_reap, linked through Thread.link. Both guarded by the core lock.
+     */
+    va_t thread_top, thread_free;
+
+    /*
+     * Threads alive at once, THREAD_LIMIT or as many as the mapping limit of
+     * the OS (vm.max_map_count) leaves room for the stacks of
+     */
+    va_t thread_limit;
+
+    /* Stack entries of the threads spawned by the embedder (pvm --stack) */
+    size_t stack_size;
 
     /* Scheduler syncs all the threads work */
     Scheduler scheduler;
+
+    /* Mutexes, condition variables and barriers of the bytecode, by ID */
+    Sync sync[SYNC_LIMIT];
+
+    /* Message channels, by ID, and the number of IDs given out by CHAN_NEW */
+    Channel channels[CHAN_LIMIT];
+    uint32_t channel_num;
+
+    /* Number of workers core_run starts, 1 unless set (pvm --workers) */
+    unsigned int worker_num;
+
+    /* The workers while core_run runs, NULL otherwise */
+    Worker *workers;
+
+    /*
+     * Guards the scheduler run queue and timer wheel, the threads blocked on
+     * synchronisation objects and channels, and spawning threads. Workers
+     * only take it to wake up threads, when their own deque is empty, or to
+     * wait for work.
+     */
+    pthread_mutex_t lock;
+
+    /*
+     * Signalled when threads are queued or the run is over. Waits time out at
+     * the earliest SLEEP_NS deadline, on CLOCK_MONOTONIC.
+     */
+    pthread_cond_t idle;
+
+    /* Number of workers waiting on 'idle' */
+    unsigned int waiting;
+
+    /* Set once the master thread has died, every worker then returns */
+    bool stopped;
+
+    /*
+     * Guards the heap and the static segment when there are several workers.
+     * Allocations take it for writing, element accesses for reading. Threads
+     * accessing the same element at once still have to synchronise themselves.
+     */
+    pthread_rwlock_t memlock;
 } Core;
 
 /*
@@ -56,10 +147,23 @@ int core_initialise(VM *);
  */
 int core_finalise(VM *);
 
+/*
+ * Function : core_unmap
+ * -------------------------
+ * Unmaps the thread table. The threads are finalised at the end of core_run
+ * but their registers are kept until then, to be read after the run.
+ *
+ * @param   : Pointer to VM instance
+ * @return  : Error code
+ */
+int core_unmap(VM *);
+
 /*
  * Function : core_run
  * -------------------------
- * Runs core, spawns the master thread and run it.
+ * Runs core, spawns the master thread and run it. Threads spawned before are
+ * kept, the first of them being the master thread. Starts 'worker_num' - 1
+ * workers and runs the last one itself, then waits for all of them to return.
  *
  * @param   : Pointer to VM instance
  * @return  : Error code
@@ -70,25 +174,58 @@ int core_run(VM *);
  * Function : core_managethread
  * -------------------------
  * Finds the thread that needs to be run after the previous thread has finished
- * a cycle. Could possibly set previous thread to sleep.
+ * a cycle. The previous thread goes to the back of the worker's deque if it is
+ * still running, or to the timer wheel if it went to sleep. The threads that
+ * were queued since go before it. The next thread is the front of the deque,
+ * or one stolen from another worker when it is empty. Waits for a thread to
+ * run if every other runnable thread is running already, or until the
+ * earliest thread in SLEEP_NS is due when none is runnable.
  *
- * @NOTE    : Called only by thread
+ * @NOTE    : Called only by core_cycle and core_run
  * @param   : Pointer to VM instance
+ * @param   : Worker looking for a thread to run
+ * @param   : Thread ID of the previous running thread, SCH_NIL for none
+ * @return  : Thread ID, SCH_NIL once the master thread has died
+ */
+va_t core_managethread(VM *, Worker *, va_t);
+
+/*
+ * Function : core_cycle
+ * -------------------------
+ * Cycles scheduler once for every instruction the previous running thread
+ * retired since its last switch point, and wakes up the sleeping threads that
+ * are due, on the scheduler clock or the wall clock. Costs the same however
+ * many threads there are.
+ *
+ * @NOTE    : Called only by core_run.
+ * @param   : Pointer to VM instance
+ * @param   : Worker the previous thread ran on
  * @param   : Thread ID of the previous running thread
+ * @param   : Number of instructions retired
+ * @return  : Thread ID of the next thread to run, SCH_NIL once the master
+ *            thread has died
+ */
+va_t core_cycle(VM *, Worker *, va_t, vmclock_t);
+
+/*
+ * Function : core_lock
+ * -------------------------
+ * Takes the core lock. @see: Core.lock.
+ *
+ * @param   : Pointer to VM instance
  * @return  : Error code
  */
-int core_managethread(VM *, va_t);
+int core_lock(VM *);
 
 /*
- * Function : core_cycle
+ * Function : core_unlock
  * -------------------------
- * Keep track of any sleeping threads' cooldown. Cycles scheduler.
+ * Releases the core lock, waking up the idle workers first if threads were
+ * queued or the run is over.
  *
- * @NOTE    : Called only by thread.
  * @param   : Pointer to VM instance
- * @param   : Tthread ID of the previous running thread
  * @return  : Error code
  */
-int core_cycle(VM *, va_t);
+int core_unlock(VM *);
 
 #endif /* CORE_H */
@@ -10,6 +10,31 @@
  * such that there is an outer array (the actual heap), which holds an inner
  * array (a complex data) made up of VM's primitive data. This segment has a
  * minimum space of 1, reserved for null address.
+ *
+ * Frames of up to HEAP_SLAB_MAX elements are carved out of slabs the heap maps
+ * itself, in size classes. Freed frames go to a cache of the thread that frees
+ * them and are reused by it first, spilling over to a free list of their class
+ * shared by every thread. The slabs are only unmapped by heap_finalise.
+ * Frames of HEAP_MAP_MIN elements or more are mapped on their own, so the OS
+ * hands them out as zero pages and REALLOC moves their pages instead of
+ * copying them.
+ *
+ * A frame allocated with MALLOC_TYPED holds its elements as a native array of
+ * one type rather than as PrimitiveData, as many bytes each as the type takes.
+ * Its size stays in elements, the allocator is handed it in PrimitiveData
+ * sized units.
+ *
+ * Apart from the frames, FLAT_MALLOC gives out blocks of one region reserved
+ * at once, addressed by their element index in the region rather than by a
+ * frame of the pool. An access to a block is a single load from the base of
+ * the region. Every block starts with a header element the program never
+ * gets an address of. The class of a block in use and the free lists of each
+ * class are kept outside the region, so no store to it can forge them.
+ *
+ * MALLOC_HANDLE picks the address of the frame itself, past those the file
+ * header declares, so the program does not keep track of free addresses.
+ * Addresses freed are taken again first, and the pool doubles once every one
+ * is taken.
  ******************************************************************************/
 
 #ifndef HEAP_H
@@ -17,6 +42,52 @@
 
 #include "common.h"
 #include <stdbool.h>
+#include <pthread.h>
+
+/* Number of size classes, from 1 to HEAP_SLAB_MAX elements */
+#define HEAP_CLASSES 16
+
+/* Largest frame, in elements, carved out of the slabs, larger ones are malloc'd. Typed frames count in units. */
+#define HEAP_SLAB_MAX 256
+
+/* Smallest frame, in elements, mapped on its own */
+#define HEAP_MAP_MIN 0x2000
+
+/* Bytes mapped at once for a slab */
+#define HEAP_SLAB_SIZE 0x100000
+
+/* Frames a thread caches per class, and how many move to or from it at once */
+#define HEAP_CACHE_LIMIT 64
+#define HEAP_BATCH (HEAP_CACHE_LIMIT / 2)
+
+/* Elements reserved for the flat region, its addresses go from 1 up to it */
+#define HEAP_FLAT_LIMIT ((va_t) 1 << 30)
+
+/*
+ * Classes of the blocks of the flat region, those of the frames and then one
+ * per power of two past HEAP_SLAB_MAX elements, up to HEAP_FLAT_LIMIT
+ */
+#define HEAP_FLAT_CLASSES (HEAP_CLASSES + 22)
+
+/* Free frames of a size class, linked through their first element */
+typedef struct PineVMHeapList
+{
+    PrimitiveData *head;
+    size_t count;
+} HeapList;
+
+/* Freed blocks of a flat class, by the index of their header */
+typedef struct PineVMHeapFlatList
+{
+    va_t *blocks;
+    size_t count, capacity;
+} HeapFlatList;
+
+/* Free frames a thread reuses without locking the heap, by size class */
+typedef struct PineVMHeapCache
+{
+    HeapList lists[HEAP_CLASSES];
+} HeapCache;
 
 typedef struct PineVMHeapFrame
 {
@@ -26,8 +97,18 @@ typedef struct PineVMHeapFrame
     /* Size of frame, which is actually the PrimitiveData array 'block' */
     size_t  framesize;
 
-    /* Heap block */
-    PrimitiveData *block;
+    /* Storage of every element of a typed frame, 0 for a frame of PrimitiveData */
+    uint32_t type;
+
+    /* Heap block, the native array of a typed frame */
+    union
+    {
+        PrimitiveData *block;
+        void *raw;
+
+        /* Next free handle while a handle is unoccupied, 0 for none */
+        va_t link;
+    };
 } HeapFrame;
 
 typedef struct PineVMHeap
@@ -43,6 +124,38 @@ typedef struct PineVMHeap
 
      /* The actual heap */
     HeapFrame *var_pool;
+
+    /*
+     * Addresses the file header declares, handles come after them. The next
+     * handle never given out, and the first of those freed since, 0 for none.
+     */
+    size_t fixed;
+    va_t handletop, handlefree;
+
+    /* Whether small frames come from the slabs, malloc'd like large ones otherwise */
+    bool slabs;
+
+    /* Free frames of every size class, beyond those cached by threads */
+    HeapList lists[HEAP_CLASSES];
+
+    /* Slabs mapped so far, linked through their first bytes, and the room left in the last one */
+    void *slab;
+    char *bump;
+    size_t room;
+
+    /*
+     * The flat region, NULL until the first FLAT_MALLOC reserves it with mmap,
+     * and the index past the last element given out, from 1 on. The class of
+     * each block in use is kept at the index of its header in 'flatclass',
+     * plus 1, and is 0 for a free block or any other element.
+     */
+    PrimitiveData *flat;
+    uint8_t *flatclass;
+    va_t flattop;
+    HeapFlatList flatfree[HEAP_FLAT_CLASSES];
+
+    /* Guards the free lists, the slabs and the flat region, threads running at once may refill their caches */
+    pthread_mutex_t lock;
 } Heap;
 
 /*
@@ -59,7 +172,8 @@ int heap_initialise(Heap *, FILE *);
 /*
  * Function : heap_finalise
  * ------------------------
- * Finalises Heap. Frees unfreed blocks and finally the whole pool.
+ * Finalises Heap. Frees unfreed blocks, unmaps the slabs and finally frees
+ * the whole pool.
  *
  * @param   : Pointer to Heap instance
  * @return  : Error code
@@ -72,11 +186,26 @@ int heap_finalise(Heap *);
  * Allocate a frame in the pool with a given amount blocks.
  *
  * @param   : Pointer to Heap instance
+ * @param   : Cache of the allocating thread, NULL for none
  * @param   : Address in the pool
  * @param   : Size of frame
  * @return  : Error code
  */
-int heap_malloc(Heap *, va_t, size_t);
+int heap_malloc(Heap *, HeapCache *, va_t, size_t);
+
+/*
+ * Function : heap_mallochandle
+ * ----------------------------
+ * Allocate a frame in the pool with a given amount blocks, at an address the
+ * heap picks among the handles. A freed handle is taken again first, and the
+ * pool doubles when none is free.
+ *
+ * @param   : Pointer to Heap instance
+ * @param   : Cache of the allocating thread, NULL for none
+ * @param   : Size of frame
+ * @return  : Address in the pool
+ */
+va_t heap_mallochandle(Heap *, HeapCache *, size_t);
 
 /*
  * Function : heap_calloc
@@ -85,33 +214,100 @@ int heap_malloc(Heap *, va_t, size_t);
  * blocks.
  *
  * @param   : Pointer to Heap instance
+ * @param   : Cache of the allocating thread, NULL for none
+ * @param   : Address in the pool
+ * @param   : Size of frame
+ * @return  : Error code
+ */
+int heap_calloc(Heap *, HeapCache *, va_t, size_t);
+
+/*
+ * Function : heap_malloctyped
+ * ---------------------------
+ * Allocate a typed frame in the pool with a given amount of elements of a
+ * type, packed in a native array.
+ *
+ * @param   : Pointer to Heap instance
+ * @param   : Cache of the allocating thread, NULL for none
  * @param   : Address in the pool
  * @param   : Size of frame
+ * @param   : Storage of the elements, I8 up to VA
  * @return  : Error code
  */
-int heap_calloc(Heap *, va_t, size_t);
+int heap_malloctyped(Heap *, HeapCache *, va_t, size_t, uint32_t);
 
 /*
  * Function : heap_realloc
  * -----------------------
- * Enlarges/shrinks a frame, retaining its current data if possible.
+ * Enlarges/shrinks a frame, retaining its current data if possible. A mapped
+ * frame grows in place when the pages after it are free, and is moved by
+ * remapping its pages otherwise. A typed frame keeps its type.
  *
  * @param   : Pointer to Heap instance
+ * @param   : Cache of the allocating thread, NULL for none
  * @param   : Address in the pool
  * @param   : Size of frame
  * @return  : Error code
  */
-int heap_realloc(Heap *, va_t, size_t);
+int heap_realloc(Heap *, HeapCache *, va_t, size_t);
 
 /*
  * Function : heap_free
  * --------------------
- * Frees a frame, allowing it to be reused again later.
+ * Frees a frame, allowing it to be reused again later. A handle goes back to
+ * the handles MALLOC_HANDLE takes.
  *
  * @param   : Pointer to Heap instance
+ * @param   : Cache of the freeing thread, NULL for none
  * @param   : Address in the pool (of the frame)
  * @return  : Error code
  */
-int heap_free(Heap *, va_t);
+int heap_free(Heap *, HeapCache *, va_t);
+
+/*
+ * Function : heap_flatmalloc
+ * --------------------------
+ * Allocate a block of a given amount of elements in the flat region, reusing
+ * a freed block of its class first. Reserves the region the first time.
+ *
+ * @param   : Pointer to Heap instance
+ * @param   : Size of block
+ * @return  : Address of the first element of the block in the region
+ */
+va_t heap_flatmalloc(Heap *, size_t);
+
+/*
+ * Function : heap_flatfree
+ * ------------------------
+ * Frees a block of the flat region, allowing it to be reused again later.
+ * The pages of a large block go back to the OS.
+ *
+ * @param   : Pointer to Heap instance
+ * @param   : Address of the block, as given by heap_flatmalloc
+ * @return  : Error code
+ */
+int heap_flatfree(Heap *, va_t);
+
+/*
+ * Function : heap_width
+ * ---------------------
+ * Gives the bytes an element of a frame takes.
+ *
+ * @param   : Storage of the elements of a typed frame, 0 for PrimitiveData
+ * @return  : Size of an element, 0 for no storage at all
+ */
+size_t heap_width(uint32_t);
+
+/*
+ * Function : heap_flush
+ * ---------------------
+ * Gives the frames cached by a thread back to the free lists of the heap,
+ * once the thread halts.
+ *
+ * @param   : Pointer to Heap instance
+ * @param   : Cache of the thread
+ * @return  : Error code
+ */
+int heap_flush(Heap *, HeapCache *);
 
 #endif /* HEAP_H */
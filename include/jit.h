@@ -0,0 +1,122 @@
+/*******************************************************************************
+ * File             : jit.h
+ * Path             : pvm/include
+ * Author           : Muhammad Adriano Raksi
+ * Created          : 17-10-26 (DD-MM-YY)
+ *------------------------------------------------------------------------------
+ * Contains the interface of the VM's baseline JIT compiler. When enabled, the
+ * interpreter counts how often each backward jump target is reached. Once a
+ * target is hot, the loop starting there is compiled into native x86-64 code
+ * which the thread then runs instead. Compiled code gives control back to the
+ * interpreter for anything it does not handle itself.
+ ******************************************************************************/
+
+#ifndef JIT_H
+#define JIT_H 9
+
+#include "core.h"
+#include <stdbool.h>
+
+/*
+ * A compiled region. Runs the thread from the instruction the region starts
+ * at until it leaves the region or the retired instruction count reaches the
+ * limit, then returns the index of the instruction the interpreter has to
+ * carry on from.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Register file of the thread
+ * @param   : Number of instructions retired, updated by the region
+ * @param   : Retired instruction count at which the region must return
+ * @return  : Index of the next instruction to perform
+ */
+typedef va_t (*JitEntry)(VM *, va_t, PrimitiveData *, vmclock_t *, vmclock_t);
+
+typedef struct PineVMJit
+{
+    /* Whether hot regions get compiled at all (pvm --jit) */
+    bool enabled;
+
+    /* Times a backward jump target is reached before it is compiled */
+    uint32_t threshold;
+
+    /*
+     * Per decoded instruction, how often it was reached by a backward jump.
+     * JIT_NEVER marks instructions no region can start at.
+     */
+    uint32_t *hotness;
+
+    /* Per decoded instruction, the compiled region starting there or NULL */
+    JitEntry *entry;
+
+    /* Executable memory the regions are copied into, one page at least each */
+    uint8_t *arena;
+
+    /* Size of arena and the part of it already taken */
+    size_t capacity, used;
+
+    /* Serialises compiling, workers may reach hot loops at the same time */
+    pthread_mutex_t lock;
+} Jit;
+
+/*
+ * Function : jit_initialise
+ * -------------------------
+ * Initialises the JIT as disabled.
+ *
+ * @param   : Pointer to Jit instance
+ * @return  : Error code
+ */
+int jit_initialise(Jit *);
+
+/*
+ * Function : jit_enable
+ * ---------------------
+ * Enables the JIT for the VM's code segment, reserving the executable arena.
+ * Reports an error on platforms other than x86-64.
+ *
+ * @param   : Pointer to VM instance
+ * @return  : Error code
+ */
+int jit_enable(VM *);
+
+/*
+ * Function : jit_finalise
+ * -----------------------
+ * Frees the compiled regions and the JIT's bookkeeping.
+ *
+ * @param   : Pointer to Jit instance
+ * @return  : Error code
+ */
+int jit_finalise(Jit *);
+
+/*
+ * Function : jit_run
+ * ------------------
+ * Called by the interpreter when a thread takes a backward jump. Counts the
+ * target, compiles the region starting there once it is hot, and runs the
+ * region if there is one. While other threads are alive, or with several
+ * workers, the region returns once the thread has used up its quantum. Safe
+ * to call from every worker, compiling is serialised.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Index of the jump target
+ * @param   : Number of instructions retired, updated by the region
+ * @return  : Index of the next instruction to perform
+ */
+va_t jit_run(VM *, va_t, va_t, vmclock_t *);
+
+/* Default number of times a loop runs before it is compiled */
+#define JIT_THRESHOLD   1000
+
+/* Size of the executable arena */
+#define JIT_ARENA_SIZE  0x400000
+
+/* Longest region compiled, in instructions */
+#define JIT_REGION_MAX  256
+
+/* Value of hotness for instructions that are never compiled */
+#define JIT_NEVER       UINT32_MAX
+
+#endif /* JIT_H */
@@ -19,4 +19,380 @@ typedef opcode_t (*InstructionSet)(VM *, va_t);
 /* Opcode function array defined in opcode.c */
 extern InstructionSet opc_Execute[256];
 
+/* Operand layout of each opcode defined in opcode.c, NULL if illegal */
+extern const char *opc_Format[256];
+
+/* Mnemonic of each opcode defined in opcode.c, NULL if illegal */
+extern const char *opc_Name[256];
+
+/*
+ * The arithmetic, bitwise, relational and logical opcodes from 0x15 to 0x28
+ * write their result to aritreg. Each has a form OPC_DEST opcodes later
+ * (ADD3, NOT2, LESS3, ...) that takes the register to write the result to as
+ * its last operand instead. Both forms share their opcode function.
+ */
+#define OPC_DEST 0x15
+
+/*
+ * The arithmetic, shift and relational opcodes from 0x15 to 0x25, apart from
+ * NOT, also have a form OPC_IMM opcodes later (ADDI, LESSI, ...) whose second
+ * operand is a literal encoded like the one of LOAD, so that no LOAD has to
+ * put it in a register first. These forms take a destination register too.
+ */
+#define OPC_IMM 0x29
+
+/* Opcode of the aritreg form of an opcode, itself if it has none */
+#define OPC_BASE(opcode)\
+    ((opcode) >= 0x15 + OPC_DEST && (opcode) <= 0x28 + OPC_DEST ? (opcode) - OPC_DEST :\
+     (opcode) >= 0x15 + OPC_IMM && (opcode) <= 0x25 + OPC_IMM ? (opcode) - OPC_IMM : (opcode))
+
+/*
+ * The compare-and-branch opcodes BLT, BLE, BGT, BGE, BEQ and BNE from
+ * OPC_BRANCH compare two registers like LESS to N_EQUAL do, and branch when
+ * the comparison holds. BLTI to BNEI right after them compare a register with
+ * a literal instead. Their last operand is the signed displacement of the
+ * target from the start of the branch, so targets are checked at load time.
+ */
+#define OPC_BRANCH 0x51
+
+/* Whether an opcode is a compare-and-branch opcode */
+#define OPC_ISBRANCH(opcode)\
+    ((opcode) >= OPC_BRANCH && (opcode) < OPC_BRANCH + 12)
+
+/* Relational opcode a compare-and-branch opcode compares with */
+#define OPC_RELATIONAL(opcode)\
+    (0x20 + ((opcode) - OPC_BRANCH) % 6)
+
+/*
+ * SWITCH takes a register and an inline jump table: the number of entries,
+ * the default target and then one target per entry, all displacements like
+ * those of the compare-and-branch opcodes. The value of the register picks
+ * the entry, anything outside the table the default. Every target is checked
+ * once at load time, so a dispatch is a single lookup.
+ */
+#define OPC_SWITCH 0x5D
+
+/*
+ * SPAWN starts a thread at a displacement like those of the compare-and-branch
+ * opcodes, with a copy of the registers of the spawning thread, and writes the
+ * ID of the new thread to its destination register. JOIN waits for the thread
+ * whose ID is in its first register to halt, then copies the register of that
+ * thread named by its second one to its destination register. YIELD ends the
+ * turn of the running thread, SELF writes its ID to its destination register.
+ * Thread IDs are I32. A thread is joined once, after which its ID may stop
+ * naming it.
+ */
+#define OPC_SPAWN   0x5E
+#define OPC_JOIN    0x5F
+#define OPC_YIELD   0x60
+#define OPC_SELF    0x61
+
+/*
+ * PARFOR takes the registers holding the start and the end of an index range
+ * and a grain size, and a displacement to a body ending in HLT. The range is
+ * split into chunks of grain indices, a grain under 1 giving one chunk per
+ * worker. A few threads per worker, spawned like by SPAWN, run the body with
+ * the bounds of a chunk in GPR0 and GPR1, and start over with the next chunk
+ * left when they reach HLT. One that sleeps or waits hands the chunks left to
+ * a new thread, so chunks may wait on each other. The thread performing the
+ * PARFOR carries on once every one of them has halted.
+ */
+#define OPC_PARFOR  0x62
+
+/*
+ * Synchronisation opcodes take the ID of a mutex, condition variable or
+ * barrier in their first register, from 0 up to SYNC_LIMIT. COND_WAIT takes
+ * the mutex it releases in its second register, BARRIER the number of threads
+ * it waits for. SLEEP_NS blocks the thread for the nanoseconds in its register,
+ * on the wall clock. A thread that has to wait is parked until another one
+ * releases it, and carries on past the instruction.
+ */
+#define OPC_MUTEX_LOCK      0x63
+#define OPC_MUTEX_UNLOCK    0x64
+#define OPC_COND_WAIT       0x65
+#define OPC_COND_SIGNAL     0x66
+#define OPC_COND_BROADCAST  0x67
+#define OPC_BARRIER         0x68
+#define OPC_SLEEP_NS        0x69
+
+/*
+ * Atomic opcodes take the address of a heap frame and an offset like STOREI
+ * and GETI, with the register the offset is indexed by as their second one.
+ * The first register is the value written or added, or the destination of
+ * ATOMIC_LOAD. ATOMIC_XCHG and ATOMIC_FETCH_ADD write the previous value to
+ * their destination register. ATOMIC_CAS takes the expected value in its last
+ * register, writes the value found there instead when they differ, and I32 1
+ * or 0 to aritreg for whether it wrote its first one. Payloads are compared
+ * bit for bit.
+ *
+ * The type of a slot is the one it holds, an untyped slot taking the type of
+ * the first value written atomically. Values and expected values must be of
+ * that type, addends are converted to it. Loads acquire, stores release and
+ * the others are sequentially consistent. The _STATIC forms are the same on
+ * the static segment.
+ */
+#define OPC_ATOMIC_LOAD         0x6A
+#define OPC_ATOMIC_STORE        0x6B
+#define OPC_ATOMIC_XCHG         0x6C
+#define OPC_ATOMIC_FETCH_ADD    0x6D
+#define OPC_ATOMIC_CAS          0x6E
+
+/* Number of opcodes from the atomic opcodes of the heap to the static ones */
+#define OPC_STATIC 5
+
+/*
+ * CHAN_NEW makes a channel of the capacity in its first register and writes
+ * its ID to its destination register as an I32. A second register other than
+ * 0 promises that at most one thread sends and one receives at once. The
+ * other channel opcodes take the ID in their first register. CHAN_SEND sends
+ * its second register and CHAN_RECV receives to its destination register,
+ * parking the thread while the channel is full or empty. CHAN_TRY_SEND and
+ * CHAN_TRY_RECV do not wait, and write I32 1 or 0 to aritreg for whether they
+ * moved a value. CHAN_SEND_N and CHAN_RECV_N take a heap frame and an offset
+ * like STORE, then the channel and the number of values to move from or to
+ * the frame. They move as many as they can, waiting only while they cannot
+ * move any, and write how many to their destination register.
+ */
+#define OPC_CHAN_NEW        0x74
+#define OPC_CHAN_SEND       0x75
+#define OPC_CHAN_RECV       0x76
+#define OPC_CHAN_TRY_SEND   0x77
+#define OPC_CHAN_TRY_RECV   0x78
+#define OPC_CHAN_SEND_N     0x79
+#define OPC_CHAN_RECV_N     0x7A
+
+/*
+ * SPAWN_STACK sets the number of stack entries of the threads the running one
+ * spawns from then on, with SPAWN or PARFOR, to its register. Those threads
+ * pass it on to theirs. Threads start out with the stack size of the thread
+ * that spawned them, STACK_SIZE unless set otherwise (pvm --stack).
+ */
+#define OPC_SPAWN_STACK     0x7B
+
+/*
+ * MALLOC_TYPED allocates a heap frame like MALLOC, then a type numbered like
+ * the one of CAST. The frame holds its elements as a native array of that
+ * type, a byte each for I8 or UI8 instead of a whole PrimitiveData. STORE and
+ * STOREI convert the value to the type of the frame, GET and GETI widen the
+ * element back into a register of that type. REALLOC keeps the type. Atomic
+ * opcodes and CHAN_SEND_N or CHAN_RECV_N on a typed frame are reported.
+ */
+#define OPC_MALLOC_TYPED    0x7C
+
+/*
+ * Flat heap opcodes address the blocks of one region instead of the frames
+ * of the pool. FLAT_MALLOC allocates a block of the number of elements in its
+ * register and writes the address of its first element to its destination
+ * register as a VA, FLAT_FREE frees the block at the address in its register.
+ * FLAT_STORE stores its second register at the address in its first one, and
+ * FLAT_GET gets the element at the address in its register to its
+ * destination register. Addresses are element indices, so the next element
+ * of a block is at the address plus 1. They are only checked against the
+ * part of the region given out, and accesses never lock the heap.
+ */
+#define OPC_FLAT_MALLOC     0x7D
+#define OPC_FLAT_FREE       0x7E
+#define OPC_FLAT_STORE      0x7F
+#define OPC_FLAT_GET        0x80
+
+/*
+ * MALLOC_HANDLE allocates a heap frame like MALLOC, of the number of blocks
+ * in its register, at an address the heap picks, and writes the address to
+ * its destination register as a VA. Handles come after the addresses the
+ * file header declares, which MALLOC keeps to, and the pool grows to make
+ * room for them. FREE_HANDLE frees the frame at the address in its register.
+ * STORE_HANDLE stores its first register in the frame at the address in its
+ * second one, at the offset in its third one. GET_HANDLE gets the element of
+ * the frame at the address in its first register, at the offset in its
+ * second one, to its destination register. The frame opcodes taking
+ * immediate addresses work on handles too.
+ */
+#define OPC_MALLOC_HANDLE   0x81
+#define OPC_FREE_HANDLE     0x82
+#define OPC_STORE_HANDLE    0x83
+#define OPC_GET_HANDLE      0x84
+
+/*
+ * Superinstructions take the opcodes from OPC_FUSED up. They never appear in
+ * bytecode files: csg_fuse gives them to the first instruction of a frequent
+ * sequence when the code is loaded, and thr_run then performs the whole
+ * sequence at once.
+ */
+#define OPC_FUSED 0xF0
+
+typedef struct PineVMFusion
+{
+    /* Opcodes of the sequence, in order */
+    opcode_t sequence[3];
+
+    /* Number of instructions in the sequence */
+    uint8_t length;
+} Fusion;
+
+/* Sequence of each superinstruction defined in opcode.c, by opcode - OPC_FUSED */
+extern const Fusion opc_Fusion[256 - OPC_FUSED];
+
+/* Opcode of the first instruction an opcode performs, itself unless fused */
+#define OPC_HEAD(opcode)\
+    ((opcode) >= OPC_FUSED ? opc_Fusion[(opcode) - OPC_FUSED].sequence[0] : (opcode))
+
+/*
+ * OPCODE FUNCTION PROTOTYPES
+ */
+
+opcode_t NOP(VM *, va_t);
+opcode_t HLT(VM *, va_t);
+
+/* REGISTER MANIPULATION */
+opcode_t LOAD(VM *, va_t);
+opcode_t MOVE(VM *, va_t);
+opcode_t CAST(VM *, va_t);
+/* END LOAD */
+
+/* STACK INSTRUCTIONS */
+opcode_t PUSH(VM *, va_t);
+opcode_t POP(VM *, va_t);
+opcode_t PUT(VM *, va_t);
+opcode_t PEEK(VM *, va_t);
+/* END STUCK INSTRUCTIONS */
+
+/* HEAP INSTRUCTIONS */
+opcode_t MALLOC(VM *, va_t);
+opcode_t CALLOC(VM *, va_t);
+opcode_t REALLOC(VM *, va_t);
+opcode_t FREE(VM *, va_t);
+opcode_t STORE(VM *, va_t);
+opcode_t GET(VM *, va_t);
+opcode_t STOREI(VM *, va_t);
+opcode_t GETI(VM *, va_t);
+opcode_t MALLOC_TYPED(VM *, va_t);
+opcode_t FLAT_MALLOC(VM *, va_t);
+opcode_t FLAT_FREE(VM *, va_t);
+opcode_t FLAT_STORE(VM *, va_t);
+opcode_t FLAT_GET(VM *, va_t);
+opcode_t MALLOC_HANDLE(VM *, va_t);
+opcode_t FREE_HANDLE(VM *, va_t);
+opcode_t STORE_HANDLE(VM *, va_t);
+opcode_t GET_HANDLE(VM *, va_t);
+/* END HEAP INSTRUCTIONS */
+
+/* STATIC SEGMENT INSTRUCTIONS */
+opcode_t ALLOC_STATIC(VM *, va_t);
+opcode_t STORE_STATIC(VM *, va_t);
+opcode_t GET_STATIC(VM *, va_t);
+/* END STATIC SEGMENT INSTRUCTIONS */
+
+/* FLOW INSTRUCTIONS */
+opcode_t JUMP(VM *, va_t);
+opcode_t JUMP_IF_TRUE(VM *, va_t);
+opcode_t JUMP_IF_FALSE(VM *, va_t);
+opcode_t BLT(VM *, va_t);
+opcode_t BLE(VM *, va_t);
+opcode_t BGT(VM *, va_t);
+opcode_t BGE(VM *, va_t);
+opcode_t BEQ(VM *, va_t);
+opcode_t BNE(VM *, va_t);
+opcode_t SWITCH(VM *, va_t);
+/* END FLOW INSTRUCTIONS */
+
+/* ARITHMETIC & BITWISE OPERATIONS */
+opcode_t ADD(VM *, va_t);
+opcode_t SUB(VM *, va_t);
+opcode_t MUL(VM *, va_t);
+opcode_t DIV(VM *, va_t);
+opcode_t MOD(VM *, va_t);
+opcode_t AND(VM *, va_t);
+opcode_t XOR(VM *, va_t);
+opcode_t OR(VM *, va_t);
+opcode_t NOT(VM *, va_t);
+opcode_t LSHIFT(VM *, va_t);
+opcode_t RSHIFT(VM *, va_t);
+/* END ARITHMETIC & BITWISE OPERATIONS */
+
+/* RELATIONAL & LOGICAL OPERATIONS */
+opcode_t LESS(VM *, va_t);
+opcode_t LESS_EQ(VM *, va_t);
+opcode_t GREAT(VM *, va_t);
+opcode_t GREAT_EQ(VM *, va_t);
+opcode_t EQUAL(VM *, va_t);
+opcode_t N_EQUAL(VM *, va_t);
+opcode_t LOG_AND(VM *, va_t);
+opcode_t LOG_OR(VM *, va_t);
+opcode_t LOG_NOT(VM *, va_t);
+/* END RELATIONAL & LOGICAL OPERATIONS */
+
+/* SCHEDULER INSTRUCTION */
+opcode_t STAMP(VM *, va_t);
+opcode_t SPAWN(VM *, va_t);
+opcode_t JOIN(VM *, va_t);
+opcode_t YIELD(VM *, va_t);
+opcode_t SELF(VM *, va_t);
+opcode_t PARFOR(VM *, va_t);
+opcode_t SPAWN_STACK(VM *, va_t);
+opcode_t MUTEX_LOCK(VM *, va_t);
+opcode_t MUTEX_UNLOCK(VM *, va_t);
+opcode_t COND_WAIT(VM *, va_t);
+opcode_t COND_SIGNAL(VM *, va_t);
+opcode_t COND_BROADCAST(VM *, va_t);
+opcode_t BARRIER(VM *, va_t);
+opcode_t SLEEP_NS(VM *, va_t);
+/* END SCHEDULER INSTRUCTION */
+
+/* ATOMIC INSTRUCTIONS */
+opcode_t ATOMIC_LOAD(VM *, va_t);
+opcode_t ATOMIC_STORE(VM *, va_t);
+opcode_t ATOMIC_XCHG(VM *, va_t);
+opcode_t ATOMIC_FETCH_ADD(VM *, va_t);
+opcode_t ATOMIC_CAS(VM *, va_t);
+opcode_t ATOMIC_LOAD_STATIC(VM *, va_t);
+opcode_t ATOMIC_STORE_STATIC(VM *, va_t);
+opcode_t ATOMIC_XCHG_STATIC(VM *, va_t);
+opcode_t ATOMIC_FETCH_ADD_STATIC(VM *, va_t);
+opcode_t ATOMIC_CAS_STATIC(VM *, va_t);
+/* END ATOMIC INSTRUCTIONS */
+
+/* CHANNEL INSTRUCTIONS */
+opcode_t CHAN_NEW(VM *, va_t);
+opcode_t CHAN_SEND(VM *, va_t);
+opcode_t CHAN_RECV(VM *, va_t);
+opcode_t CHAN_TRY_SEND(VM *, va_t);
+opcode_t CHAN_TRY_RECV(VM *, va_t);
+opcode_t CHAN_SEND_N(VM *, va_t);
+opcode_t CHAN_RECV_N(VM *, va_t);
+/* END CHANNEL INSTRUCTIONS */
+
+/*
+ * END OPCODE FUNCTION PROTOTYPES
+ */
+
+/*
+ * Reads a PrimitiveData as the widest type that can hold it. Shared by the
+ * opcode functions and the interpreter loop in thread.c.
+ */
+#define DATA_RETRIEVER(data)\
+(\
+    (data).storage == I8 ? (data).i8 :\
+    ((data).storage == I16 ? (data).i16 :\
+    ((data).storage == I32 ? (data).i32 :\
+    ((data).storage == I64 ? (data).i64 :\
+    ((data).storage == UI8 ? (data).ui8 :\
+    ((data).storage == UI16 ? (data).ui16 :\
+    ((data).storage == UI32 ? (data).ui32 :\
+    ((data).storage == UI64 ? (data).ui64 :\
+    ((data).storage == DBL ? (data).dbl :\
+    ((data).va)))))))))\
+)
+
+#define DATA_RETRIEVER_INT(data)\
+(\
+    (data).storage == I8 ? (data).i8 :\
+    ((data).storage == I16 ? (data).i16 :\
+    ((data).storage == I32 ? (data).i32 :\
+    ((data).storage == I64 ? (data).i64 :\
+    ((data).storage == UI8 ? (data).ui8 :\
+    ((data).storage == UI16 ? (data).ui16 :\
+    ((data).storage == UI32 ? (data).ui32 :\
+    (data).ui64))))))\
+)
+
 #endif /* OPCODE_H */
@@ -1,5 +1,27 @@
 #include "vm.h"
 
-int opt_execute(char *);
+typedef struct PineVMOptions
+{
+    /* Compile hot loops into native code */
+    bool jit;
+
+    /* Count the instructions performed and print the frequent sequences */
+    bool profile;
+
+    /* Write the file in the compact encoding to this path instead of running */
+    const char *compact;
+
+    /* Scheduler.quantum to run with, the default SCH_QUANTUM if 0 */
+    vmclock_t quantum;
+
+    /* Core.worker_num to run with, a single worker if 0 */
+    unsigned int workers;
+
+    /* Core.stack_size to run with, STACK_SIZE entries if 0 */
+    size_t stack;
+} Options;
+
+int opt_execute(char *, const Options *);
+int opt_compact(char *, const char *);
 int opt_version(void);
 int opt_help(void);
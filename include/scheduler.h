@@ -16,6 +16,26 @@
 
 typedef unsigned long vmclock_t;
 
+/* Threads are only known by their index in the thread pool here */
+struct _PineVMThread;
+
+/* Bits of the wake up clock each level of the timer wheel sorts on */
+#define SCH_WHEEL_BITS      6
+#define SCH_WHEEL_SLOTS     (1 << SCH_WHEEL_BITS)
+
+/* Enough levels for any wake up clock */
+#define SCH_WHEEL_LEVELS    ((sizeof(vmclock_t) * 8 + SCH_WHEEL_BITS - 1) / SCH_WHEEL_BITS)
+
+/*
+ * Default Scheduler.quantum. Long enough for a thread to keep its registers,
+ * branch history and compiled loops warm, short enough that a sleeping thread
+ * does not wake up much later than due.
+ */
+#define SCH_QUANTUM 1000
+
+/* Ends a list of threads, and stands for no thread at all */
+#define SCH_NIL ((va_t) -1)
+
 typedef struct PineVMScheduler
 {
     /*
@@ -28,9 +48,57 @@ typedef struct PineVMScheduler
 
     /*
      * The total number of thread operations already performed. Note that this
-     * is shared by all threads.
+     * is shared by all threads, and advanced by every worker without a lock.
      */
     vmclock_t clocks;
+
+    /*
+     * The clock the timer wheel has been brought up to. It lags behind
+     * 'clocks' between two calls to sch_expire, and sleeping threads are
+     * filed relative to it.
+     */
+    vmclock_t wheelclock;
+
+    /*
+     * Number of instructions a thread runs for before another thread gets
+     * its turn. It only yields at a switch point, so the turn ends at the
+     * first one after that. @see: thr_run.
+     */
+    vmclock_t quantum;
+
+    /*
+     * The run queue: first and last of the runnable threads, in the order
+     * they run. The threads are linked through Thread.link, so queueing never
+     * allocates.
+     */
+    va_t head, tail;
+
+    /*
+     * Hierarchical timer wheel of the sleeping threads, linked through
+     * Thread.link as well. A thread is kept at the level of the highest
+     * SCH_WHEEL_BITS of its wake up clock that differ from 'wheelclock', in
+     * the slot those bits select. Expiring only visits the slots the clock
+     * passed, and moves their threads to the run queue or down a level.
+     */
+    va_t wheel[SCH_WHEEL_LEVELS][SCH_WHEEL_SLOTS];
+
+    /* One bit per slot of each level, set when the slot holds a thread */
+    uint64_t occupied[SCH_WHEEL_LEVELS];
+
+    /* Number of threads in the timer wheel */
+    size_t sleeping;
+
+    /*
+     * Threads in SLEEP_NS, linked through Thread.link in the order of their
+     * Thread.deadline. They wait on the wall clock rather than on 'clocks'.
+     */
+    va_t timers;
+
+    /*
+     * Number of threads that are queued or running, wherever they are. The
+     * core only lets the clock jump ahead when it drops to 0.
+     */
+    size_t runnable;
 } Scheduler;
 
 /*
@@ -74,6 +142,147 @@ int sch_resume(Scheduler *);
  */
 int sch_cycle(Scheduler *);
 
+/*
+ * Function : sch_advance
+ * ----------------------
+ * Same as sch_cycle but for a number of cycles at once. Used by the interpreter
+ * loop which only reports back to the scheduler at switch points. The clock is
+ * advanced atomically, so workers do not need to hold the core lock. Sleeping
+ * threads are only woken up by sch_expire.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Number of cycles performed
+ * @return  : Error code
+ */
+int sch_advance(Scheduler *, vmclock_t);
+
+/*
+ * Function : sch_expire
+ * ---------------------
+ * Brings the timer wheel up to the clock, which moves the threads whose sleep
+ * is over to the run queue. Costs the same however many threads there are.
+ *
+ * @NOTE    : Called with the core lock held, like every function below
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @return  : Error code
+ */
+int sch_expire(Scheduler *, struct _PineVMThread *);
+
+/*
+ * Function : sch_ready
+ * --------------------
+ * Puts a thread that was not runnable, a new or a woken up one, at the back of
+ * the run queue.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @param   : Thread ID
+ * @return  : Error code
+ */
+int sch_ready(Scheduler *, struct _PineVMThread *, va_t);
+
+/*
+ * Function : sch_sleep
+ * --------------------
+ * Puts a thread in the timer wheel until the clock reaches its Thread.wakeup,
+ * or straight back in the run queue if it already has.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @param   : Thread ID
+ * @return  : Error code
+ */
+int sch_sleep(Scheduler *, struct _PineVMThread *, va_t);
+
+/*
+ * Function : sch_wait
+ * --------------------
+ * Puts a thread among the threads waiting for its Thread.joining to halt, or
+ * straight back in the run queue if it already has. A thread that joins
+ * itself waits for the chunks of its PARFOR instead. @see: sch_release.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @param   : Thread ID
+ * @return  : Error code
+ */
+int sch_wait(Scheduler *, struct _PineVMThread *, va_t);
+
+/*
+ * Function : sch_wake
+ * --------------------
+ * Puts every thread waiting for a thread to halt back in the run queue.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @param   : Thread ID of the thread that halted
+ * @return  : Error code
+ */
+int sch_wake(Scheduler *, struct _PineVMThread *, va_t);
+
+/*
+ * Function : sch_release
+ * --------------------
+ * Counts down the Thread.pending of a thread performing a PARFOR, once for
+ * each chunk that halts and once when the thread itself is parked. Whichever
+ * comes last puts it back in the run queue.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @param   : Thread ID of the thread performing the PARFOR
+ * @return  : Error code
+ */
+int sch_release(Scheduler *, struct _PineVMThread *, va_t);
+
+/*
+ * Function : sch_timer
+ * --------------------
+ * Files a blocked thread among the timers, by its Thread.deadline.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @param   : Thread ID
+ * @return  : Error code
+ */
+int sch_timer(Scheduler *, struct _PineVMThread *, va_t);
+
+/*
+ * Function : sch_alarm
+ * --------------------
+ * Releases the threads among the timers whose deadline has passed.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @param   : Current time, from sch_walltime
+ * @return  : Error code
+ */
+int sch_alarm(Scheduler *, struct _PineVMThread *, uint64_t);
+
+/*
+ * Function : sch_next
+ * --------------------
+ * Takes the thread at the front of the run queue. Threads that were killed
+ * while queued are dropped on the way.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @return  : Thread ID, SCH_NIL when the run queue is empty
+ */
+va_t sch_next(Scheduler *, struct _PineVMThread *);
+
+/*
+ * Function : sch_idle
+ * --------------------
+ * When no thread is runnable but some sleep, jumps the clock to the earliest
+ * wake up, since nothing could advance it otherwise.
+ *
+ * @param   : Pointer to Scheduler instance
+ * @param   : Thread pool
+ * @return  : Error code
+ */
+int sch_idle(Scheduler *, struct _PineVMThread *);
+
 /*
  * Function : sch_reset
  * --------------------
@@ -95,6 +304,15 @@ int sch_reset(Scheduler *);
  */
 vmclock_t sch_stamp(Scheduler *);
 
+/*
+ * Function: sch_walltime
+ * --------------------
+ * Returns the time of CLOCK_MONOTONIC, which SLEEP_NS deadlines are on.
+ *
+ * @return  : Nanoseconds
+ */
+uint64_t sch_walltime(void);
+
 /* Scheduler flags */
 #define SCH_OFF    0
 #define SCH_ON     1
@@ -5,13 +5,16 @@
  * Created          : 02-03-18 (DD-MM-YY)
  *------------------------------------------------------------------------------
  * Contains the interface of the VM's stack. Unlike other data segments in the
- * VM, each threads possess their own stack.
+ * VM, each threads possess their own stack. A stack is reserved with mmap and
+ * the OS only commits the pages it uses. It ends flush against a guard page,
+ * so pushing past it faults instead of being checked for on every push.
  ******************************************************************************/
 
 #ifndef STACK_H
 #define STACK_H 5
 
 #include "common.h"
+#include <stdbool.h>
 
 /*
  * Address type to be used only within the stack. @TODO: might want to
@@ -26,12 +29,43 @@ typedef struct PineVMStack
 
     /* Where all the data that are pushed into the stack is stored. */
     PrimitiveData *primdata_arr;
+
+    /* Number of entries in primdata_arr */
+    size_t size;
+
+    /* The whole mapping, guard page included, and its length in bytes */
+    void *mapping;
+    size_t length;
 } Stack;
 
+/*
+ * Function : stk_initialise
+ * -------------------------
+ * Reserves the entries of a thread's stack, followed by a guard page, and
+ * empties it. Leaves the caller to report a failure, which is the OS
+ * refusing the mappings.
+ *
+ * @param   : Pointer to Stack instance
+ * @param   : Number of entries, at least 1
+ * @return  : Error code, 1 if the stack could not be mapped
+ */
+int stk_initialise(Stack *, size_t);
+
+/*
+ * Function : stk_finalise
+ * -----------------------
+ * Unmaps the entries of a stack.
+ *
+ * @param   : Pointer to Stack instance
+ * @return  : Error code
+ */
+int stk_finalise(Stack *);
+
 /*
  * Function : stk_push
  * -------------------
- * Inserts PrimitiveData input into stack. Increments stack pointer.
+ * Inserts PrimitiveData input into stack. Increments stack pointer. Pushing
+ * onto a full stack hits its guard page. @see: stk_guarded.
  *
  * @param   : Pointer to Stack instance
  * @param   : PrimitiveData instance
@@ -59,4 +93,16 @@ stackva_t stk_pop(Stack *);
  */
 PrimitiveData stk_peek(Stack); /* Return TOS */
 
+/*
+ * Function : stk_guarded
+ * ----------------------
+ * Tells whether an address is in the guard page of a stack, which is where
+ * a push onto the full stack faults.
+ *
+ * @param   : Pointer to Stack instance
+ * @param   : Faulting address
+ * @return  : Whether the stack overflowed there
+ */
+bool stk_guarded(const Stack *, const void *);
+
 #endif /* STACK_H */
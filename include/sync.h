@@ -0,0 +1,130 @@
+/*******************************************************************************
+ * File             : sync.h
+ * Path             : pvm/include
+ * Author           : Muhammad Adriano Raksi
+ * Created          : 17-10-26 (DD-MM-YY)
+ *------------------------------------------------------------------------------
+ * Contains the synchronisation objects of the VM: mutexes, condition variables
+ * and barriers, addressed by the ID the opcodes take. A thread that has to
+ * wait on one is parked off the run queue rather than spinning, and runs again
+ * once another thread releases it.
+ ******************************************************************************/
+
+#ifndef SYNC_H
+#define SYNC_H 10
+
+#include "common.h"
+#include <stdbool.h>
+
+/* Number of synchronisation objects, their IDs go from 0 up to it */
+#define SYNC_LIMIT 256
+
+/*
+ * An object is used as one of a mutex, a condition variable or a barrier at
+ * a time. Uncontended mutexes are taken and released without the core lock,
+ * everything else happens under it.
+ */
+typedef struct PineVMSync
+{
+    /* SYN_UNLOCKED, SYN_LOCKED or SYN_CONTENDED when threads may be waiting */
+    uint32_t state;
+
+    /* Thread holding the mutex, SCH_NIL if none */
+    va_t owner;
+
+    /*
+     * First and last of the threads blocked on the object, linked through
+     * Thread.link in the order they came
+     */
+    va_t head, tail;
+
+    /* Threads that reached the barrier since it last opened */
+    uint32_t arrived;
+} Sync;
+
+/*
+ * Function : syn_initialise
+ * -------------------------
+ * Initialises an unlocked object nobody waits on.
+ *
+ * @param   : Pointer to Sync instance
+ * @return  : Error code
+ */
+int syn_initialise(Sync *);
+
+/*
+ * Function : syn_lock
+ * -------------------
+ * Takes a mutex. When another thread holds it, the thread blocks until the
+ * mutex is handed over to it on unlock. Reports an error for a thread that
+ * holds the mutex already.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Mutex ID
+ * @return  : Whether the thread has to wait
+ */
+int syn_lock(VM *, va_t, va_t);
+
+/*
+ * Function : syn_unlock
+ * ---------------------
+ * Releases a mutex, handing it over to the thread that waited for it the
+ * longest, if any. Reports an error for a thread that does not hold it.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Mutex ID
+ * @return  : Error code
+ */
+int syn_unlock(VM *, va_t, va_t);
+
+/*
+ * Function : syn_wait
+ * -------------------
+ * Releases a mutex the thread holds and blocks it on a condition variable,
+ * at once so no signal is missed. Once signalled, the thread takes the mutex
+ * again before it runs.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Condition variable ID
+ * @param   : Mutex ID
+ * @return  : Error code
+ */
+int syn_wait(VM *, va_t, va_t, va_t);
+
+/*
+ * Function : syn_signal
+ * ---------------------
+ * Wakes up the thread that waited on a condition variable the longest, or
+ * every one of them.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Condition variable ID
+ * @param   : Whether every waiting thread is woken up
+ * @return  : Error code
+ */
+int syn_signal(VM *, va_t, bool);
+
+/*
+ * Function : syn_barrier
+ * ----------------------
+ * Blocks the thread on a barrier until a number of threads, itself included,
+ * have reached it. The last one releases the others and the barrier can be
+ * used again.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Barrier ID
+ * @param   : Number of threads the barrier waits for
+ * @return  : Whether the thread has to wait
+ */
+int syn_barrier(VM *, va_t, va_t, uint32_t);
+
+/* Mutex states */
+#define SYN_UNLOCKED    0
+#define SYN_LOCKED      1
+#define SYN_CONTENDED   2
+
+#endif /* SYNC_H */
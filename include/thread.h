@@ -16,6 +16,7 @@
 #define THREAD_H 3
 
 #include "scheduler.h"
+#include "heap.h"
 
 typedef struct
 {
@@ -23,8 +24,17 @@ typedef struct
      * These are the data registers. There are 8 General Purpose Registers (GPR)
      * and 1 Arithmetic Registers (AR). GPR holds both data and address
      * variables whereas AR holds the output of a(n) logic/arithmetic operation.
+     * The interpreter loop addresses them as one register file, where AR is
+     * index REG_AR.
      */
-    PrimitiveData genpreg[8], aritreg;
+    union
+    {
+        struct
+        {
+            PrimitiveData genpreg[8], aritreg;
+        };
+        PrimitiveData regfile[9];
+    };
 
     /*
      * Program Counter Register holds the number of operations the thread has
@@ -50,23 +60,83 @@ typedef struct _PineVMThread
     /* Thread flag */
     uint8_t flag;
 
-     /*
-      * Countdown to run again from sleep. This is defined when the thread is
-      * passed to thr_Sleep. Countdown is decremented by core_Cycle.
-      */
-    vmclock_t countdown;
+    /*
+     * Scheduler clock at which the thread runs again from sleep. This is
+     * defined when the thread is passed to thr_sleep.
+     */
+    vmclock_t wakeup;
+
+    /*
+     * CLOCK_MONOTONIC time, in nanoseconds, at which the thread runs again
+     * from SLEEP_NS. This is defined when the thread is passed to thr_sleepns.
+     */
+    uint64_t deadline;
+
+    /*
+     * Next thread in the run queue, in the timer wheel slot of a sleeping
+     * thread, among the threads waiting for the same one or blocked on the same
+     * synchronisation object or channel, or in SLEEP_NS. @see: Scheduler,
+     * Sync, Channel.
+     */
+    va_t link;
+
+    /* Thread a thread in THR_WAIT waits for, itself when it waits on 'pending' */
+    va_t joining;
+
+    /* First of the threads waiting for this one to halt, linked through 'link' */
+    va_t waiters;
+
+    /* Thread whose PARFOR this one performs chunks of, SCH_NIL otherwise */
+    va_t parent;
+
+    /*
+     * Range of the PARFOR a thread performs, its grain and the first
+     * instruction of its body. 'chunknext' is the first index no chunk has
+     * been taken from yet, the threads performing it take the next chunk as
+     * they halt.
+     */
+    int64_t chunknext;
+    int32_t chunkend, chunkgrain;
+    va_t chunkbody;
+
+    /*
+     * Events a thread that waits on itself still waits for: the chunks of its
+     * PARFOR that have not halted yet, or being released from a
+     * synchronisation object or SLEEP_NS. Plus one until the core parks the
+     * thread. @see: sch_release.
+     */
+    uint32_t pending;
+
+    /* Mutex a thread in COND_WAIT takes again once it is signalled */
+    va_t relock;
+
+    /*
+     * Entries of the stack of the threads this one spawns, its own unless set
+     * by SPAWN_STACK. @see: Core.stack_size.
+     */
+    size_t stacksize;
+
+    /* Times the slot was reused, part of the thread ID the bytecode sees */
+    uint16_t generation;
+
+    /* What still holds the slot of the thread back from reuse, THR_HOLD_* */
+    uint8_t holds;
 
     /* Control Unit is where all the registers are located */
     ControlUnit controlunit;
 
     /* Stack is thread's private memory */
     Stack stack;
+
+    /* Heap frames the thread freed and allocates again first */
+    HeapCache heapcache;
 } Thread;
 
 /*
  * Function : thr_spawn
  * --------------------
- * Spawns a thread and initialises its members.
+ * Spawns a thread and initialises its members. Takes the core lock, which
+ * the caller must not hold.
  *
  * @param   : Pointer to VM instance
  * @param   : Address to code segment for the thread's
@@ -75,10 +145,90 @@ typedef struct _PineVMThread
  */
 int thr_spawn(VM *, va_t);
 
+/*
+ * Function : thr_fork
+ * --------------------
+ * Spawns a thread that starts with a copy of the registers of another one, at
+ * a decoded instruction. Used by SPAWN.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID of the parent thread
+ * @param   : Index in CodeSeg.instr of the thread's first operation
+ * @return  : Thread ID of the new thread
+ */
+va_t thr_fork(VM *, va_t, va_t);
+
+/*
+ * Function : thr_parfor
+ * --------------------
+ * Splits the range [start, end) into chunks of grain indices and spawns up to
+ * THR_PARFOR_SPREAD threads per worker to perform them at a decoded
+ * instruction, each with a copy of the registers of the parent where
+ * genpreg[0] and genpreg[1] hold the bounds of its chunk. A thread takes the
+ * next chunk left as it halts, see thr_nextchunk, and hands the chunks left to
+ * a new thread as it stops running, see thr_handoff. A grain under 1 makes one
+ * chunk per worker. The parent waits for every thread to halt from its next
+ * switch point on. Used by PARFOR.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID of the parent thread
+ * @param   : Index in CodeSeg.instr of the first operation of the chunks
+ * @param   : First index of the range
+ * @param   : Index past the last one of the range
+ * @param   : Number of indices per chunk
+ * @return  : Whether the parent has to wait, 0 for an empty range
+ */
+int thr_parfor(VM *, va_t, va_t, int32_t, int32_t, int32_t);
+
+/*
+ * Function : thr_nextchunk
+ * ------------------------
+ * Has a thread performing chunks of a PARFOR start over at the body with the
+ * next chunk no thread has taken yet, a fresh copy of the registers of the
+ * parent and an empty stack. Used by HLT.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @return  : Whether the thread took a chunk, 0 when it has to halt
+ */
+int thr_nextchunk(VM *, va_t);
+
+/*
+ * Function : thr_handoff
+ * ----------------------
+ * Spawns a thread for the next chunk of a PARFOR no thread has taken yet when
+ * a thread performing chunks of it goes to sleep or waits, which takes the
+ * chunks after it in turn as it halts. Every chunk may thus wait on another
+ * one, however few threads the PARFOR started with. Called by the core with
+ * its lock held.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @return  : Whether a thread was spawned
+ */
+int thr_handoff(VM *, va_t);
+
+/*
+ * Function : thr_block
+ * --------------------
+ * Makes a running thread wait until it is released once with sch_release. It
+ * carries on until its next switch point, where the core parks it. Used by
+ * the synchronisation objects, the channels and SLEEP_NS.
+ *
+ * @NOTE    : Called with the core lock held
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @return  : Error code
+ */
+int thr_block(VM *, va_t);
+
 /*
  * Function : thr_kill
  * --------------------
- * Kills a thread and frees any dynamically allocated members.
+ * Kills a thread and frees any dynamically allocated members. The threads that
+ * wait for it to halt run again, and so does the thread whose PARFOR it is the
+ * last chunk of. The heap frames it cached go back to the heap. Its slot is
+ * reused once thr_reap released every hold.
  *
  * @param   : Pointer to VM instance
  * @param   : Thread ID
@@ -86,33 +236,129 @@ int thr_spawn(VM *, va_t);
  */
 int thr_kill(VM *, va_t);
 
+/*
+ * Function : thr_reap
+ * --------------------
+ * Releases a hold on the slot of a halted thread, and gives the slot back to
+ * the free list of the core once nothing holds it. Its worker releases
+ * THR_HOLD_WORKER past its last switch point, the JOIN that takes its result
+ * releases THR_HOLD_JOIN. Releasing a hold twice does nothing. Takes the core
+ * lock, which the caller must not hold.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : THR_HOLD_WORKER or THR_HOLD_JOIN
+ * @return  : Error code
+ */
+int thr_reap(VM *, va_t, uint8_t);
+
+/*
+ * Function : thr_id
+ * --------------------
+ * Gives the ID the bytecode sees for a thread, its slot with the generation of
+ * the slot above it, so that a reused slot never answers to a stale ID.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @return  : ID for SPAWN and SELF
+ */
+int32_t thr_id(VM *, va_t);
+
+/*
+ * Function : thr_slot
+ * --------------------
+ * Finds the slot of a thread from the ID SPAWN or SELF gave, and reports an
+ * error for an ID that was never given out or whose slot was reused since.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : ID for SPAWN and SELF
+ * @return  : Thread ID
+ */
+va_t thr_slot(VM *, int64_t);
+
 /*
  * Function : thr_run
  * --------------------
- * Lets thread perform a cycle.
+ * Lets thread perform instructions until it reaches a switch point: a halt,
+ * or a taken jump once it has retired Scheduler.quantum instructions while
+ * other threads are alive. Instructions are dispatched
+ * with threaded code and control transfers only move the instruction pointer,
+ * so the native stack depth does not depend on the bytecode. The caller
+ * passes the result to core_cycle.
  *
  * @param   : Pointer to VM instance
- * @param   : Address to code segment for the thread's first operation
- * @return  : Calls core_Cycle
+ * @param   : Thread ID
+ * @return  : Number of instructions retired
  */
-int thr_run(VM *, va_t);
+vmclock_t thr_run(VM *, va_t);
 
 /*
  * Function : thr_sleep
  * --------------------
- * Sleeps a thread.
+ * Sleeps a thread until the scheduler clock has advanced by the given number
+ * of cycles. A running thread carries on until its next switch point, where
+ * the core puts it in the timer wheel.
  *
  * @param   : Pointer to VM instance
- * @param   : Address to code segment for the thread's first operation
+ * @param   : Thread ID
  * @param   : Clocks for thread's countdown
  * @return  : Error code
  */
 int thr_sleep(VM *, va_t, vmclock_t);
 
+/*
+ * Function : thr_join
+ * --------------------
+ * Makes a thread wait for another one to halt. A running thread carries on
+ * until its next switch point, where the core puts it among the waiters of
+ * the other thread. Reports an error for a thread that was never spawned, or
+ * for the thread itself. Each thread is joined once, its slot may be reused
+ * after.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Thread ID of the thread to wait for
+ * @return  : Whether the thread has to wait, 0 if the other one halted already
+ */
+int thr_join(VM *, va_t, va_t);
+
+/*
+ * Function : thr_sleepns
+ * --------------------
+ * Blocks a thread for a number of nanoseconds of wall-clock time. Unlike with
+ * thr_sleep the scheduler clock does not jump ahead for it, and a worker with
+ * nothing else to run sleeps until the earliest such thread is due.
+ *
+ * @param   : Pointer to VM instance
+ * @param   : Thread ID
+ * @param   : Nanoseconds to sleep for
+ * @return  : Whether the thread has to wait, 0 for no time at all
+ */
+int thr_sleepns(VM *, va_t, uint64_t);
+
+/* Index of the Arithmetic Register in ControlUnit.regfile */
+#define REG_AR      8
+
+/*
+ * Stands for the literal of an immediate form (ADDI, LESSI, ...) where a
+ * decoded instruction names its second operand register. Never an index.
+ */
+#define REG_IMM     9
+
 #define THR_UNINIT  0 /* Thread uninitialised */
 #define THR_DEAD    1 /* When a thread is killed */
 #define THR_ALIVE   2 /* When a thread is spawned */
 #define THR_RUN     4 /* Thread is currenly running */
 #define THR_SLEEP   8 /* Thread is not running/waiting for other threads */
+#define THR_WAIT    16 /* Thread is waiting for another thread to halt */
+
+#define THR_HOLD_WORKER 1 /* Its worker has not passed its last switch point yet */
+#define THR_HOLD_JOIN   2 /* No JOIN has taken its result yet, never set on a PARFOR chunk */
+
+/*
+ * Threads a PARFOR spawns per worker to start with, however many chunks it
+ * has. More are spawned only as chunks wait, see thr_handoff.
+ */
+#define THR_PARFOR_SPREAD 4
 
 #endif /* THREAD_H */
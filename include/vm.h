@@ -17,6 +17,7 @@
 #include "staticseg.h"
 #include "heap.h"
 #include "core.h"
+#include "jit.h"
 
 typedef struct PineVM
 {
@@ -57,6 +58,12 @@ typedef struct PineVM
      * core.h to see the core's interface.
      */
     Core core;
+
+    /*
+     * Compiles hot loops into native code when enabled. @see: pvm/include/
+     * jit.h to see the JIT's interface.
+     */
+    Jit jit;
 } VM;
 
 /*
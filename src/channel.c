@@ -0,0 +1,250 @@
+/*******************************************************************************
+ * File             : channel.c
+ * Path             : pvm/src
+ * Author           : Muhammad Adriano Raksi
+ * Created          : 17-10-26 (DD-MM-YY)
+ *------------------------------------------------------------------------------
+ * Contains the implementation of the VM's message channels. The ring buffer is
+ * a bounded queue where every cell carries a sequence number, so senders and
+ * receivers only contend on the position they move. Blocked threads wait in a
+ * list of the channel and are released with sch_release.
+ ******************************************************************************/
+
+#include "../include/channel.h"
+#include "../include/vm.h"
+
+int chn_initialise(Channel *chan)
+{
+    chan->cells = NULL;
+    chan->capacity = 0;
+    chan->single = false;
+    chan->senders.head = chan->senders.tail = SCH_NIL;
+    chan->receivers.head = chan->receivers.tail = SCH_NIL;
+    chan->tail = chan->head = 0;
+
+    return 0;
+}
+
+int chn_finalise(Channel *chan)
+{
+    free(chan->cells);
+    chan->cells = NULL;
+
+    return 0;
+}
+
+va_t chn_new(VM *vm, uint64_t capacity, bool single)
+{
+    va_t id = __atomic_fetch_add(&vm->core.channel_num, 1, __ATOMIC_RELAXED);
+    Channel *chan;
+    ChannelCell *cells;
+
+    if (id >= CHAN_LIMIT)
+        return pvm_reporterror(CHANNEL_H, __FUNCTION__, "Too many channels");
+    if (capacity == 0)
+        return pvm_reporterror(CHANNEL_H, __FUNCTION__, "Channel of no capacity");
+
+    cells = malloc(sizeof(ChannelCell) * capacity);
+    if (cells == NULL)
+        return pvm_reporterror(CHANNEL_H, __FUNCTION__, "Allocation failed");
+    for (uint64_t i = 0; i < capacity; i++)
+        cells[i].sequence = 2 * i;
+
+    chan = &vm->core.channels[id];
+    chan->capacity = capacity;
+    chan->single = single;
+
+    /* Threads that get the ID from another one find the channel made */
+    __atomic_store_n(&chan->cells, cells, __ATOMIC_RELEASE);
+
+    return id;
+}
+
+/* Returns the channel with the given ID */
+static Channel *chn_fetch(VM *vm, va_t id)
+{
+    if (id >= CHAN_LIMIT || __atomic_load_n(&vm->core.channels[id].cells, __ATOMIC_ACQUIRE) == NULL)
+        pvm_reporterror(CHANNEL_H, __FUNCTION__, "No such channel");
+
+    return &vm->core.channels[id];
+}
+
+/*
+ * Claims up to n cells from a position on, those whose sequence number says
+ * they are ready: twice the position for sending, plus one for receiving.
+ * Returns the first position claimed, with the number of cells in 'n'.
+ */
+static uint64_t chn_claim(Channel *chan, uint64_t *position, uint64_t lag, size_t *n)
+{
+    uint64_t pos = __atomic_load_n(position, __ATOMIC_RELAXED), seq = 0;
+    size_t ready = 0;
+
+    while (*n > 0)
+    {
+        for (ready = 0; ready < *n; ready++)
+        {
+            seq = __atomic_load_n(&chan->cells[(pos + ready) % chan->capacity].sequence, __ATOMIC_ACQUIRE);
+            if (seq != 2 * (pos + ready) + lag)
+                break;
+        }
+
+        /* Full or empty, unless another thread moved the position since */
+        if (ready == 0 && (int64_t) (seq - (2 * pos + lag)) < 0)
+            break;
+
+        /* Nobody else moves the position of a channel with a single thread on either side */
+        if (ready > 0 && chan->single)
+        {
+            __atomic_store_n(position, pos + ready, __ATOMIC_RELAXED);
+            break;
+        }
+        if (ready > 0 && __atomic_compare_exchange_n(position, &pos, pos + ready, false, __ATOMIC_RELAXED,
+                                                     __ATOMIC_RELAXED))
+            break;
+        if (ready == 0)
+            pos = __atomic_load_n(position, __ATOMIC_RELAXED);
+    }
+    *n = ready;
+
+    return pos;
+}
+
+/* Sends as many values as there is room for, returns how many */
+static size_t chn_put(Channel *chan, const PrimitiveData *values, size_t n)
+{
+    uint64_t pos = chn_claim(chan, &chan->tail, 0, &n);
+    ChannelCell *cell;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        cell = &chan->cells[(pos + i) % chan->capacity];
+        cell->data = values[i];
+        __atomic_store_n(&cell->sequence, 2 * (pos + i) + 1, __ATOMIC_RELEASE);
+    }
+
+    return n;
+}
+
+/* Receives as many values as the channel holds, returns how many */
+static size_t chn_get(Channel *chan, PrimitiveData *values, size_t n)
+{
+    uint64_t pos = chn_claim(chan, &chan->head, 1, &n);
+    ChannelCell *cell;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        cell = &chan->cells[(pos + i) % chan->capacity];
+        values[i] = cell->data;
+        __atomic_store_n(&cell->sequence, 2 * (pos + i + chan->capacity), __ATOMIC_RELEASE);
+    }
+
+    return n;
+}
+
+/* Puts a thread at the back of the threads blocked on a channel */
+static void chn_push(Thread *pool, ChannelWaiters *waiters, va_t tid)
+{
+    pool[tid].link = SCH_NIL;
+    if (waiters->tail == SCH_NIL)
+        __atomic_store_n(&waiters->head, tid, __ATOMIC_RELAXED);
+    else
+        pool[waiters->tail].link = tid;
+    waiters->tail = tid;
+}
+
+/* Takes the thread at the front of the threads blocked on a channel, SCH_NIL if none */
+static va_t chn_pop(Thread *pool, ChannelWaiters *waiters)
+{
+    va_t tid = waiters->head;
+
+    if (tid == SCH_NIL)
+        return SCH_NIL;
+    __atomic_store_n(&waiters->head, pool[tid].link, __ATOMIC_RELAXED);
+    if (waiters->head == SCH_NIL)
+        waiters->tail = SCH_NIL;
+
+    return tid;
+}
+
+/* Takes back the thread that was the last to block on a channel */
+static void chn_unlink(Thread *pool, ChannelWaiters *waiters)
+{
+    va_t tid = waiters->head;
+
+    if (tid == waiters->tail)
+    {
+        __atomic_store_n(&waiters->head, SCH_NIL, __ATOMIC_RELAXED);
+        waiters->tail = SCH_NIL;
+        return;
+    }
+    while (pool[tid].link != waiters->tail)
+        tid = pool[tid].link;
+    pool[tid].link = SCH_NIL;
+    waiters->tail = tid;
+}
+
+/* Wakes up to n of the threads blocked on a channel */
+static void chn_wake(VM *vm, ChannelWaiters *waiters, size_t n)
+{
+    va_t tid;
+
+    /* Pairs with the fence of a thread that blocks, one of them sees the other */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&waiters->head, __ATOMIC_RELAXED) == SCH_NIL)
+        return;
+
+    core_lock(vm);
+    while (n-- > 0 && (tid = chn_pop(vm->core.thread_pool, waiters)) != SCH_NIL)
+        sch_release(&vm->core.scheduler, vm->core.thread_pool, tid);
+    core_unlock(vm);
+}
+
+/*
+ * Blocks a thread on a channel unless trying once more moves some values.
+ * The thread is among the waiters before it tries, so whoever makes room or
+ * sends a value next either is seen here or sees the thread.
+ */
+static size_t chn_block(VM *vm, va_t tid, Channel *chan, const PrimitiveData *in, PrimitiveData *out, size_t n)
+{
+    ChannelWaiters *waiters = in != NULL ? &chan->senders : &chan->receivers;
+    size_t moved;
+
+    core_lock(vm);
+    chn_push(vm->core.thread_pool, waiters, tid);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    moved = in != NULL ? chn_put(chan, in, n) : chn_get(chan, out, n);
+    if (moved == 0)
+        thr_block(vm, tid);
+    else
+        chn_unlink(vm->core.thread_pool, waiters);
+    core_unlock(vm);
+
+    return moved;
+}
+
+size_t chn_send(VM *vm, va_t tid, va_t id, const PrimitiveData *values, size_t n, bool block)
+{
+    Channel *chan = chn_fetch(vm, id);
+    size_t sent = chn_put(chan, values, n);
+
+    if (sent == 0 && n > 0 && block)
+        sent = chn_block(vm, tid, chan, values, NULL, n);
+    if (sent > 0)
+        chn_wake(vm, &chan->receivers, sent);
+
+    return sent;
+}
+
+size_t chn_recv(VM *vm, va_t tid, va_t id, PrimitiveData *values, size_t n, bool block)
+{
+    Channel *chan = chn_fetch(vm, id);
+    size_t received = chn_get(chan, values, n);
+
+    if (received == 0 && n > 0 && block)
+        received = chn_block(vm, tid, chan, NULL, values, n);
+    if (received > 0)
+        chn_wake(vm, &chan->senders, received);
+
+    return received;
+}
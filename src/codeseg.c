@@ -8,8 +8,352 @@
  ******************************************************************************/
 
 #include "../include/codeseg.h"
+#include "../include/opcode.h"
+#include <string.h>
 
-int csg_initialise(CodeSeg * codeseg, const char * path, FILE * fp)
+/* Value of regindex for bytes that are not a REGISTER_ADDRESS */
+#define REG_ILLEGAL 0xFF
+
+/* Maps a REGISTER_ADDRESS operand to its index in ControlUnit.regfile */
+static const uint8_t regindex[256] =
+{
+    [0x00 ... 0xFF] = REG_ILLEGAL,
+
+    [0x00] = 0, [0x01] = 1, [0x02] = 2, [0x04] = 3,
+    [0x08] = 4, [0x10] = 5, [0x20] = 6, [0x40] = 7,
+    [0x80] = REG_AR
+};
+
+/* Size of RAW_DATA for each TYPE operand */
+static const uint8_t typesize[10] = {1, 1, 2, 2, 4, 4, 8, 8, 8, 8};
+
+/* Reads a big endian integer of the given amount of bytes */
+static uint64_t decode_bytes(const opcode_t *code, size_t bytes)
+{
+    uint64_t value = 0;
+
+    while (bytes-- > 0)
+        value = (value << 8) | *code++;
+
+    return value;
+}
+
+/* Creates the PrimitiveData that LOAD puts in a register from its RAW_DATA */
+static PrimitiveData decode_literal(opcode_t type, uint64_t raw)
+{
+    PrimitiveData data = {0};
+
+    switch (type)
+    {
+        case 0:
+            data.storage = I8;
+            data.i8 = raw;
+            break;
+        case 1:
+            data.storage = UI8;
+            data.ui8 = raw;
+            break;
+        case 2:
+            data.storage = I16;
+            data.i16 = raw;
+            break;
+        case 3:
+            data.storage = UI16;
+            data.ui16 = raw;
+            break;
+        case 4:
+            data.storage = I32;
+            data.i32 = raw;
+            break;
+        case 5:
+            data.storage = UI32;
+            data.ui32 = raw;
+            break;
+        case 6:
+            data.storage = I64;
+            data.i64 = raw;
+            break;
+        case 7:
+            data.storage = UI64;
+            data.ui64 = raw;
+            break;
+        case 8:
+            data.storage = DBL;
+            data.dbl = raw;
+            break;
+        case 9:
+            data.storage = VA;
+            data.va = raw;
+            break;
+    }
+
+    return data;
+}
+
+/* Reads an unsigned LEB128 integer of the compact encoding */
+static uint64_t decode_varint(const CodeSeg *codeseg, size_t *pos)
+{
+    uint64_t value = 0;
+    unsigned int shift = 0;
+    opcode_t byte;
+
+    do
+    {
+        if (*pos >= codeseg->size)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+        if (shift >= 64)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Integer too long");
+        byte = codeseg->content[(*pos)++];
+        value |= (uint64_t) (byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return value;
+}
+
+/* Reads TYPE and RAW_DATA of a literal in the compact encoding */
+static int decode_compact_literal(const CodeSeg *codeseg, size_t *pos, PrimitiveData *data)
+{
+    opcode_t type = codeseg->content[(*pos)++];
+    unsigned int bits;
+    uint64_t raw;
+    int64_t value;
+
+    if (type >= sizeof(typesize))
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal type");
+
+    /* DBL RAW_DATA is little endian */
+    if (type == 8)
+    {
+        if (*pos + sizeof(uint64_t) > codeseg->size)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+        for (raw = 0, bits = 0; bits < 64; bits += 8)
+            raw |= (uint64_t) codeseg->content[(*pos)++] << bits;
+        *data = decode_literal(type, raw);
+        return 0;
+    }
+
+    raw = decode_varint(codeseg, pos);
+    bits = typesize[type] * 8;
+
+    /* Signed types are even, and zigzag encoded */
+    if (type % 2 == 0)
+    {
+        value = (int64_t) (raw >> 1) ^ -(int64_t) (raw & 1);
+        if (bits < 64 && (value < -((int64_t) 1 << (bits - 1)) || value >= (int64_t) 1 << (bits - 1)))
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Literal out of range");
+        raw = value;
+    }
+    else if (bits < 64 && raw >> bits != 0)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Literal out of range");
+
+    *data = decode_literal(type, raw);
+    return 0;
+}
+
+/*
+ * Keeps the byte offset a branch displacement leads to in 'target', which
+ * csg_decode turns into an instruction index once every offset is known
+ */
+static int decode_target(CodeSeg *codeseg, uint32_t *target, size_t start, int64_t displacement)
+{
+    if (displacement < -(int64_t) start || displacement > (int64_t) (codeseg->size - start))
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal branch target");
+    *target = start + displacement;
+
+    return 0;
+}
+
+/*
+ * Makes room at the end of 'table' for the jump table of a SWITCH, whose
+ * default target and entries take at least 'width' bytes each from 'pos' on.
+ * That bounds 'count' by what is left of the code before anything is
+ * allocated.
+ */
+static int decode_table(CodeSeg *codeseg, Instruction *instr, size_t pos, uint64_t count, size_t width)
+{
+    uint32_t *tmp;
+
+    if (count >= (codeseg->size - pos) / width)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+
+    tmp = realloc(codeseg->table, sizeof(uint32_t) * (codeseg->tablesize + count + 1));
+    if (tmp == NULL)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Allocation failed");
+    codeseg->table = tmp;
+    instr->imm[0] = codeseg->tablesize;
+    instr->imm[1] = count;
+    codeseg->tablesize += count;
+
+    return 0;
+}
+
+/* Reads the operands of an instruction in the original encoding */
+static int decode_operands(CodeSeg *codeseg, Instruction *instr, const char *format, size_t *pos)
+{
+    const opcode_t *code = codeseg->content;
+    size_t nreg, nimm, start = *pos - 1;
+    uint64_t count, n;
+    uint32_t *entry;
+    opcode_t type;
+
+    for (nreg = nimm = 0; *format != '\0'; format++)
+    {
+        if (*pos >= codeseg->size)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+
+        switch (*format)
+        {
+            case 'R':
+                instr->reg[nreg] = regindex[code[(*pos)++]];
+                if (instr->reg[nreg++] == REG_ILLEGAL)
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal register");
+                break;
+            case 'D':
+                instr->reg[2] = regindex[code[(*pos)++]];
+                if (instr->reg[2] == REG_ILLEGAL)
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal register");
+                break;
+            case 'T':
+                instr->type = code[(*pos)++];
+                if (instr->type >= sizeof(typesize))
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal type");
+                break;
+            case 'I':
+                instr->reg[nreg++] = REG_IMM;
+                /* fall through */
+            case 'L':
+                type = code[(*pos)++];
+                if (type >= sizeof(typesize))
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal type");
+                if (*pos + typesize[type] > codeseg->size)
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+                instr->data = decode_literal(type, decode_bytes(&code[*pos], typesize[type]));
+                *pos += typesize[type];
+                break;
+            case 'A':
+                if (*pos + sizeof(uint64_t) > codeseg->size)
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+                instr->imm[nimm++] = decode_bytes(&code[*pos], sizeof(uint64_t));
+                *pos += sizeof(uint64_t);
+                break;
+            case 'J':
+                if (*pos + sizeof(int32_t) > codeseg->size)
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+                if (decode_target(codeseg, &instr->target, start, (int32_t) decode_bytes(&code[*pos], sizeof(int32_t))) != 0)
+                    return 1;
+                *pos += sizeof(int32_t);
+                break;
+            case 'S':
+                if (*pos + sizeof(uint32_t) > codeseg->size)
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+                count = decode_bytes(&code[*pos], sizeof(uint32_t));
+                *pos += sizeof(uint32_t);
+                if (decode_table(codeseg, instr, *pos, count, sizeof(int32_t)) != 0)
+                    return 1;
+                for (n = 0; n <= count; n++)
+                {
+                    entry = n == 0 ? &instr->target : &codeseg->table[instr->imm[0] + n - 1];
+                    if (decode_target(codeseg, entry, start, (int32_t) decode_bytes(&code[*pos], sizeof(int32_t))) != 0)
+                        return 1;
+                    *pos += sizeof(int32_t);
+                }
+                break;
+        }
+    }
+
+    return 0;
+}
+
+/* Reads a branch displacement of the compact encoding, a zigzag varint */
+static int decode_compact_target(CodeSeg *codeseg, size_t *pos, size_t start, uint32_t *target)
+{
+    uint64_t raw = decode_varint(codeseg, pos);
+
+    if (raw > UINT32_MAX)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal branch target");
+
+    return decode_target(codeseg, target, start, (int64_t) (raw >> 1) ^ -(int64_t) (raw & 1));
+}
+
+/*
+ * Reads the operands of an instruction in the compact encoding, where the
+ * register operands come first. @see: csg_compact.
+ */
+static int decode_compact(CodeSeg *codeseg, Instruction *instr, const char *format, size_t *pos)
+{
+    const opcode_t *code = codeseg->content;
+    uint8_t regs[4];
+    size_t n, nregs, nreg, nimm, start = *pos - 1;
+    uint64_t count, k;
+    uint32_t *entry;
+
+    /* Unpack the register nibbles, an unused last nibble has to be zero */
+    for (n = nregs = 0; format[n] != '\0'; n++)
+        if (format[n] == 'R' || format[n] == 'D')
+            nregs++;
+    if (*pos + (nregs + 1) / 2 > codeseg->size)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+    for (n = 0; n < nregs; n++)
+    {
+        regs[n] = code[*pos + n / 2] >> (n % 2 * 4) & 0xF;
+        if (regs[n] > REG_AR)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal register");
+    }
+    if (nregs % 2 == 1 && code[*pos + nregs / 2] >> 4 != 0)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal register");
+    *pos += (nregs + 1) / 2;
+
+    for (n = nreg = nimm = 0; *format != '\0'; format++)
+    {
+        if (*format != 'R' && *format != 'D' && *pos >= codeseg->size)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Truncated instruction");
+
+        switch (*format)
+        {
+            case 'R':
+                instr->reg[nreg++] = regs[n++];
+                break;
+            case 'D':
+                instr->reg[2] = regs[n++];
+                break;
+            case 'T':
+                instr->type = code[(*pos)++];
+                if (instr->type >= sizeof(typesize))
+                    return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal type");
+                break;
+            case 'I':
+                instr->reg[nreg++] = REG_IMM;
+                /* fall through */
+            case 'L':
+                if (decode_compact_literal(codeseg, pos, &instr->data) != 0)
+                    return 1;
+                break;
+            case 'A':
+                instr->imm[nimm++] = decode_varint(codeseg, pos);
+                break;
+            case 'J':
+                if (decode_compact_target(codeseg, pos, start, &instr->target) != 0)
+                    return 1;
+                break;
+            case 'S':
+                count = decode_varint(codeseg, pos);
+                if (decode_table(codeseg, instr, *pos, count, 1) != 0)
+                    return 1;
+                for (k = 0; k <= count; k++)
+                {
+                    entry = k == 0 ? &instr->target : &codeseg->table[instr->imm[0] + k - 1];
+                    if (decode_compact_target(codeseg, pos, start, entry) != 0)
+                        return 1;
+                }
+                break;
+        }
+    }
+
+    return 0;
+}
+
+int csg_initialise(CodeSeg * codeseg, const char * path, FILE * fp, bool compact)
 {
     size_t size;
     long int initial_pos;
@@ -24,7 +368,536 @@ int csg_initialise(CodeSeg * codeseg, const char * path, FILE * fp)
     codeseg->size = size;
     codeseg->content = malloc(sizeof(opcode_t) * size);
     fread(codeseg->content, sizeof(opcode_t) * size, 1, fp);
-    realpath(path, codeseg->filepath);
+    codeseg->filepath = realpath(path, NULL);
+    codeseg->compact = compact;
+
+    csg_decode(codeseg);
+
+    return csg_fuse(codeseg);
+}
+
+int csg_decode(CodeSeg *codeseg)
+{
+    const opcode_t *code = codeseg->content;
+    const char *format;
+    Instruction *instr, *tmp;
+    size_t pos, n, i;
+    int retcode;
+
+    /* Every instruction takes at least a byte, so there is enough room */
+    codeseg->instr = calloc(codeseg->size + 1, sizeof(Instruction));
+    codeseg->offsetmap = malloc(sizeof(va_t) * (codeseg->size + 1));
+    codeseg->linked = false;
+    codeseg->profile = NULL;
+    codeseg->table = NULL;
+    codeseg->tablesize = 0;
+    if (codeseg->instr == NULL || codeseg->offsetmap == NULL)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Allocation failed");
+    if (codeseg->size >= UINT32_MAX)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Code segment too large");
+
+    for (pos = 0; pos <= codeseg->size; pos++)
+        codeseg->offsetmap[pos] = CSG_NOINSTR;
+
+    for (pos = 0, n = 0; pos < codeseg->size; n++)
+    {
+        format = opc_Format[code[pos]];
+        if (format == NULL)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal instruction");
+
+        codeseg->offsetmap[pos] = n;
+        instr = &codeseg->instr[n];
+        instr->opcode = code[pos++];
+        instr->reg[2] = REG_AR;
+
+        /* Decode the operands in the order of the opcode's layout */
+        retcode = codeseg->compact ? decode_compact(codeseg, instr, format, &pos) :
+                                     decode_operands(codeseg, instr, format, &pos);
+        if (retcode != 0)
+            return retcode;
+    }
+
+    /* Running past the last instruction halts the thread */
+    codeseg->instr[n].opcode = 0x01;
+    codeseg->offsetmap[codeseg->size] = n;
+    codeseg->length = n;
+
+    /* Every branch, spawn and parallel for has to land on an instruction, or right past the last */
+    for (i = 0; i < n; i++)
+    {
+        instr = &codeseg->instr[i];
+        if (!OPC_ISBRANCH(instr->opcode) && instr->opcode != OPC_SWITCH && instr->opcode != OPC_SPAWN &&
+            instr->opcode != OPC_PARFOR)
+            continue;
+        if (codeseg->offsetmap[instr->target] == CSG_NOINSTR)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal branch target");
+        instr->target = codeseg->offsetmap[instr->target];
+    }
+    for (i = 0; i < codeseg->tablesize; i++)
+    {
+        if (codeseg->offsetmap[codeseg->table[i]] == CSG_NOINSTR)
+            return pvm_reporterror(CODESEG_H, __FUNCTION__, "Illegal branch target");
+        codeseg->table[i] = codeseg->offsetmap[codeseg->table[i]];
+    }
+
+    /* Give back the room that multi-byte instructions did not need */
+    tmp = realloc(codeseg->instr, sizeof(Instruction) * (n + 1));
+    if (tmp != NULL)
+        codeseg->instr = tmp;
+
+    return 0;
+}
+
+/* Register contents while converting: the LOAD that put a literal there */
+#define SLOT_UNSET  ((va_t) -2) /* Not reached yet */
+#define SLOT_ANY    ((va_t) -1) /* Anything but a literal */
+
+/* Merges register contents where paths meet, returns whether 'to' changed */
+static bool merge_slots(va_t *to, const va_t *from)
+{
+    bool changed = false;
+
+    for (int r = 0; r <= REG_AR; r++)
+    {
+        va_t merged = to[r] == SLOT_UNSET || to[r] == from[r] ? from[r] : SLOT_ANY;
+        changed |= merged != to[r];
+        to[r] = merged;
+    }
+
+    return changed;
+}
+
+/* Carries register contents over to instruction i, queueing it if they changed */
+static void visit(va_t (*slots)[REG_AR + 1], const va_t *in, va_t i, va_t *work, size_t *nwork, bool *queued)
+{
+    if (merge_slots(slots[i], in) && !queued[i])
+    {
+        work[(*nwork)++] = i;
+        queued[i] = true;
+    }
+}
+
+/*
+ * Finds the LOAD instructions whose literal is used as a jump target, and
+ * marks them in 'target'. Follows every path from the start of the code with
+ * the LOAD each register was last given.
+ */
+static int find_targets(CodeSeg *codeseg, const va_t *offset, bool *target)
+{
+    const Instruction *instr = codeseg->instr;
+    va_t (*slots)[REG_AR + 1] = malloc(sizeof(*slots) * (codeseg->length + 1));
+    va_t *work = malloc(sizeof(va_t) * (codeseg->length + 1));
+    bool *queued = calloc(codeseg->length + 1, sizeof(bool));
+    va_t in[REG_AR + 1], chunk[REG_AR + 1], next[2], i, load;
+    size_t nwork = 0, nnext, k;
+    opcode_t opcode;
+
+    if (slots == NULL || work == NULL || queued == NULL)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Allocation failed");
+
+    for (i = 0; i <= codeseg->length; i++)
+        for (k = 0; k <= REG_AR; k++)
+            slots[i][k] = i == 0 ? SLOT_ANY : SLOT_UNSET;
+    work[nwork++] = 0;
+    queued[0] = true;
+
+    while (nwork > 0)
+    {
+        i = work[--nwork];
+        queued[i] = false;
+        memcpy(in, slots[i], sizeof(in));
+        opcode = i == codeseg->length ? 0x01 : OPC_BASE(codeseg->content[offset[i]]);
+
+        /* Where the instruction goes next */
+        nnext = 0;
+        if (opcode != 0x01 && opcode != 0x12 && opcode != OPC_SWITCH)
+            next[nnext++] = i + 1;
+        if (opcode >= 0x12 && opcode <= 0x14)
+        {
+            load = in[instr[i].reg[0]];
+            if (load == SLOT_ANY)
+                return pvm_reporterror(CODESEG_H, __FUNCTION__, "Jump target is not a LOAD literal");
+            target[load] = true;
+            next[nnext++] = csg_locate(codeseg, DATA_RETRIEVER_INT(instr[load].data));
+        }
+        if (OPC_ISBRANCH(opcode) || opcode == OPC_SWITCH)
+            next[nnext++] = instr[i].target;
+
+        /* A spawned thread starts with the registers of its parent */
+        if (opcode == OPC_SPAWN)
+            visit(slots, in, instr[i].target, work, &nwork, queued);
+
+        /* So does a chunk of a PARFOR, but for the bounds of the chunk */
+        if (opcode == OPC_PARFOR)
+        {
+            memcpy(chunk, in, sizeof(chunk));
+            chunk[0] = chunk[1] = SLOT_ANY;
+            visit(slots, chunk, instr[i].target, work, &nwork, queued);
+        }
+
+        /* What the instruction leaves in the registers */
+        switch (opcode)
+        {
+            case 0x02:  /* LOAD */
+                in[instr[i].reg[0]] = i;
+                break;
+            case 0x03:  /* MOVE */
+                in[instr[i].reg[1]] = in[instr[i].reg[0]];
+                break;
+            case 0x04: case 0x08: case 0x0E: case 0x11: case 0x29: case 0x50:
+                in[instr[i].reg[0]] = SLOT_ANY;
+                break;
+            case OPC_SPAWN: case OPC_JOIN: case OPC_SELF:
+            case OPC_ATOMIC_XCHG: case OPC_ATOMIC_FETCH_ADD:
+            case OPC_ATOMIC_XCHG + OPC_STATIC: case OPC_ATOMIC_FETCH_ADD + OPC_STATIC:
+            case OPC_CHAN_NEW: case OPC_CHAN_RECV: case OPC_CHAN_SEND_N: case OPC_CHAN_RECV_N:
+            case OPC_FLAT_MALLOC: case OPC_FLAT_GET: case OPC_MALLOC_HANDLE: case OPC_GET_HANDLE:
+                in[instr[i].reg[2]] = SLOT_ANY;
+                break;
+            case OPC_CHAN_TRY_SEND:
+                in[REG_AR] = SLOT_ANY;
+                break;
+            case OPC_ATOMIC_LOAD: case OPC_ATOMIC_LOAD + OPC_STATIC:
+                in[instr[i].reg[0]] = SLOT_ANY;
+                break;
+            case OPC_ATOMIC_CAS: case OPC_ATOMIC_CAS + OPC_STATIC: case OPC_CHAN_TRY_RECV:
+                in[instr[i].reg[2]] = in[REG_AR] = SLOT_ANY;
+                break;
+            default:
+                if (opcode >= 0x15 && opcode <= 0x28)
+                    in[instr[i].reg[2]] = SLOT_ANY;
+                break;
+        }
+
+        for (k = 0; k < nnext; k++)
+            visit(slots, in, next[k], work, &nwork, queued);
+        for (k = 0; opcode == OPC_SWITCH && k < instr[i].imm[1]; k++)
+            visit(slots, in, codeseg->table[instr[i].imm[0] + k], work, &nwork, queued);
+    }
+
+    free(slots);
+    free(work);
+    free(queued);
+
+    return 0;
+}
+
+/* Writes an unsigned LEB128 integer of at least 'length' bytes */
+static size_t encode_varint(uint8_t *out, uint64_t value, size_t length)
+{
+    size_t n = 0;
+
+    do
+    {
+        out[n] = value & 0x7F;
+        value >>= 7;
+        if (value != 0 || n + 1 < length)
+            out[n] |= 0x80;
+        n++;
+    } while (value != 0 || n < length);
+
+    return n;
+}
+
+/* Writes a signed integer as a zigzag encoded LEB128 integer */
+static size_t encode_signed(uint8_t *out, int64_t value, size_t length)
+{
+    return encode_varint(out, (uint64_t) value << 1 ^ (uint64_t) (value >> 63), length);
+}
+
+/* Writes the displacement from instruction i to 'to' in the compact 'layout' */
+static size_t encode_target(uint8_t *out, const va_t *layout, va_t i, va_t to)
+{
+    if (layout == NULL)
+        return encode_signed(out, 0, (32 + 6) / 7);
+    return encode_signed(out, (int64_t) layout[to] - (int64_t) layout[i], 1);
+}
+
+/*
+ * Encodes instruction i, at 'pos' in the original encoding, in the compact
+ * one. Jump target literals and branch displacements are offsets in the
+ * compact 'layout'. Without a layout they are given the widest encoding of
+ * their type instead, which no offset in the layout can outgrow.
+ */
+static size_t encode_compact(CodeSeg *codeseg, va_t i, size_t pos, bool target, const va_t *layout, uint8_t *out)
+{
+    const Instruction *instr = &codeseg->instr[i];
+    const opcode_t *code = codeseg->content;
+    const char *format = opc_Format[code[pos]];
+    size_t n = 0, nregs = 0, nreg = 0, length;
+    uint64_t k;
+    opcode_t type;
+    uint64_t raw;
+    unsigned int bits;
+
+    out[n++] = code[pos++];
+
+    /* Register operands first, two to a byte */
+    for (const char *f = format; *f != '\0'; f++)
+    {
+        uint8_t reg = *f == 'R' ? instr->reg[nreg++] : *f == 'D' ? instr->reg[2] : 0;
+
+        if (*f == 'I')
+            nreg++;
+        if (*f != 'R' && *f != 'D')
+            continue;
+        if (nregs % 2 == 0)
+            out[n++] = reg;
+        else
+            out[n - 1] |= reg << 4;
+        nregs++;
+    }
+
+    for (; *format != '\0'; format++)
+    {
+        switch (*format)
+        {
+            case 'R':
+            case 'D':
+                pos++;
+                break;
+            case 'T':
+                out[n++] = code[pos++];
+                break;
+            case 'I':
+            case 'L':
+                type = code[pos++];
+                out[n++] = type;
+                bits = typesize[type] * 8;
+                raw = decode_bytes(&code[pos], typesize[type]);
+                pos += typesize[type];
+                length = target && layout == NULL ? (bits + 6) / 7 : 1;
+                if (target && layout != NULL)
+                    raw = layout[csg_locate(codeseg, DATA_RETRIEVER_INT(instr->data))];
+                if (type == 8)
+                    for (unsigned int b = 0; b < 64; b += 8)
+                        out[n++] = raw >> b;
+                else if (type % 2 == 0)
+                    n += encode_signed(&out[n], (int64_t) (raw << (64 - bits)) >> (64 - bits), length);
+                else
+                    n += encode_varint(&out[n], raw, length);
+                break;
+            case 'A':
+                n += encode_varint(&out[n], decode_bytes(&code[pos], sizeof(uint64_t)), 1);
+                pos += sizeof(uint64_t);
+                break;
+            case 'J':
+                n += encode_target(&out[n], layout, i, instr->target);
+                pos += sizeof(int32_t);
+                break;
+            case 'S':
+                n += encode_varint(&out[n], instr->imm[1], 1);
+                n += encode_target(&out[n], layout, i, instr->target);
+                for (k = 0; k < instr->imm[1]; k++)
+                    n += encode_target(&out[n], layout, i, codeseg->table[instr->imm[0] + k]);
+                pos += sizeof(uint32_t) + sizeof(int32_t) * (instr->imm[1] + 1);
+                break;
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Longest instruction in the compact encoding, apart from a SWITCH, whose
+ * jump table takes up to 5 more bytes per entry
+ */
+#define COMPACT_MAX 32
+
+int csg_compact(CodeSeg *codeseg, FILE *fp)
+{
+    va_t *offset = malloc(sizeof(va_t) * (codeseg->length + 1));
+    va_t *layout = malloc(sizeof(va_t) * (codeseg->length + 1));
+    size_t *size = malloc(sizeof(size_t) * (codeseg->length + 1));
+    bool *target = calloc(codeseg->length + 1, sizeof(bool));
+    uint8_t *out = malloc(COMPACT_MAX + (32 + 6) / 7 * codeseg->tablesize);
+    bool changed;
+    va_t i;
+    size_t pos, n, bits;
+    opcode_t type;
+
+    if (offset == NULL || layout == NULL || size == NULL || target == NULL || out == NULL)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Allocation failed");
+    if (codeseg->compact)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Already in the compact encoding");
+
+    for (pos = 0; pos <= codeseg->size; pos++)
+        if (codeseg->offsetmap[pos] != CSG_NOINSTR)
+            offset[codeseg->offsetmap[pos]] = pos;
+    find_targets(codeseg, offset, target);
+
+    /*
+     * Start from the widest encoding of every offset and shrink them until
+     * the layout settles. Offsets only get smaller on the way, so no
+     * instruction ever has to grow back.
+     */
+    for (i = 0; i < codeseg->length; i++)
+        size[i] = encode_compact(codeseg, i, offset[i], target[i], NULL, out);
+    do
+    {
+        for (i = 0, layout[0] = 0; i < codeseg->length; i++)
+            layout[i + 1] = layout[i] + size[i];
+        for (i = 0, changed = false; i < codeseg->length; i++)
+        {
+            n = encode_compact(codeseg, i, offset[i], target[i], layout, out);
+            changed |= n != size[i];
+            size[i] = n;
+        }
+    } while (changed);
+
+    for (i = 0; i < codeseg->length; i++)
+    {
+        /* The rewritten jump target has to fit the type of its literal */
+        if (target[i])
+        {
+            type = codeseg->content[offset[i] + 2];
+            bits = typesize[type] * 8 - (type % 2 == 0 && type < 8);
+            if (type != 8 && bits < 64 && layout[csg_locate(codeseg, DATA_RETRIEVER_INT(codeseg->instr[i].data))] >> bits != 0)
+                return pvm_reporterror(CODESEG_H, __FUNCTION__, "Jump target out of range of its LOAD");
+        }
+        n = encode_compact(codeseg, i, offset[i], target[i], layout, out);
+        fwrite(out, n, 1, fp);
+    }
+
+    free(offset);
+    free(layout);
+    free(size);
+    free(target);
+    free(out);
+
+    return 0;
+}
+
+int csg_fuse(CodeSeg *codeseg)
+{
+    Instruction *instr = codeseg->instr;
+    size_t i, k, n, length;
+    opcode_t fused;
+
+    for (i = 0; i < codeseg->length; i += length)
+    {
+        /* Prefer the longest sequence that starts here */
+        for (n = 0, fused = 0, length = 1; n < 256 - OPC_FUSED; n++)
+        {
+            const Fusion *fusion = &opc_Fusion[n];
+
+            if (fusion->length <= length || i + fusion->length > codeseg->length)
+                continue;
+            for (k = 0; k < fusion->length && instr[i + k].opcode == fusion->sequence[k]; k++);
+            if (k == fusion->length)
+            {
+                fused = OPC_FUSED + n;
+                length = fusion->length;
+            }
+        }
+
+        if (fused)
+            instr[i].opcode = fused;
+    }
+
+    return 0;
+}
+
+int csg_profile(CodeSeg *codeseg)
+{
+    /* Sequences are counted as they are in the bytecode */
+    for (size_t i = 0; i < codeseg->length; i++)
+        codeseg->instr[i].opcode = OPC_HEAD(codeseg->instr[i].opcode);
+
+    codeseg->profile = calloc(codeseg->length + 1, sizeof(uint64_t));
+    if (codeseg->profile == NULL)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Allocation failed");
+
+    return 0;
+}
+
+/* An opcode sequence packed into 'key', one opcode per byte from the top */
+typedef struct
+{
+    uint32_t key;
+    uint64_t count;
+} Sequence;
+
+static int sequence_bykey(const void *a, const void *b)
+{
+    const Sequence *x = a, *y = b;
+    return (x->key > y->key) - (x->key < y->key);
+}
+
+static int sequence_bycount(const void *a, const void *b)
+{
+    const Sequence *x = a, *y = b;
+    return (x->count < y->count) - (x->count > y->count);
+}
+
+/* Adds up the counts of equal sequences and prints the most frequent */
+static void dump_sequences(FILE *fp, const char *title, Sequence *seq, size_t num, size_t length)
+{
+    size_t i, n;
+
+    qsort(seq, num, sizeof(Sequence), sequence_bykey);
+    for (i = 0, n = 0; i < num; i++)
+    {
+        if (n > 0 && seq[n - 1].key == seq[i].key)
+            seq[n - 1].count += seq[i].count;
+        else
+            seq[n++] = seq[i];
+    }
+    qsort(seq, n, sizeof(Sequence), sequence_bycount);
+
+    fprintf(fp, "%s:\n", title);
+    for (i = 0; i < n && i < CSG_PROFILE_TOP; i++)
+    {
+        fprintf(fp, "%16lu ", seq[i].count);
+        for (size_t k = 0; k < length; k++)
+            fprintf(fp, " %s", opc_Name[(seq[i].key >> (16 - 8 * k)) & 0xFF]);
+        fprintf(fp, "\n");
+    }
+}
+
+/* Whether an instruction can carry on somewhere else than the next one */
+static bool transfers(opcode_t opcode)
+{
+    return opcode == 0x01 || (opcode >= 0x12 && opcode <= 0x14) || OPC_ISBRANCH(opcode) ||
+           opcode == OPC_SWITCH || opcode == OPC_JOIN;
+}
+
+int csg_dumpprofile(CodeSeg *codeseg, FILE *fp)
+{
+    const Instruction *instr = codeseg->instr;
+    const uint64_t *profile = codeseg->profile;
+    Sequence *pairs, *triples;
+    size_t i, npairs = 0, ntriples = 0;
+    uint64_t total = 0;
+
+    if (profile == NULL)
+        return 1;
+
+    pairs = malloc(sizeof(Sequence) * (codeseg->length + 1));
+    triples = malloc(sizeof(Sequence) * (codeseg->length + 1));
+    if (pairs == NULL || triples == NULL)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Allocation failed");
+
+    /* An instruction that always carries on with the next one runs as often as the pair */
+    for (i = 0; i <= codeseg->length; i++)
+    {
+        total += profile[i];
+        if (profile[i] == 0 || transfers(instr[i].opcode) || i + 1 >= codeseg->length)
+            continue;
+        pairs[npairs].key = instr[i].opcode << 16 | instr[i + 1].opcode << 8;
+        pairs[npairs++].count = profile[i];
+        if (transfers(instr[i + 1].opcode) || i + 2 >= codeseg->length)
+            continue;
+        triples[ntriples].key = pairs[npairs - 1].key | instr[i + 2].opcode;
+        triples[ntriples++].count = profile[i];
+    }
+
+    fprintf(fp, "Instructions performed: %lu\n", total);
+    dump_sequences(fp, "Most frequent pairs", pairs, npairs, 2);
+    dump_sequences(fp, "Most frequent triples", triples, ntriples, 3);
+
+    free(pairs);
+    free(triples);
 
     return 0;
 }
@@ -34,5 +907,15 @@ int csg_finalise(CodeSeg * codeseg)
     if (codeseg->content != NULL)
         free(codeseg->content);
     codeseg->content = NULL;
+    free(codeseg->filepath);
+    codeseg->filepath = NULL;
+    free(codeseg->instr);
+    codeseg->instr = NULL;
+    free(codeseg->offsetmap);
+    codeseg->offsetmap = NULL;
+    free(codeseg->profile);
+    codeseg->profile = NULL;
+    free(codeseg->table);
+    codeseg->table = NULL;
     return 0;
 }
@@ -11,14 +11,67 @@
 
 #include "../include/core.h"
 #include "../include/vm.h"
+#include <string.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* The VM whose threads' stacks a fault is checked against, while core_run runs */
+static VM *core_running;
+
+/* Action for SIGSEGV before core_run, faults outside a guard page go back to it */
+static struct sigaction core_fallback;
+
+/* Threads whose stacks fit under the mapping limit of the OS, two mappings each */
+static va_t core_threadlimit(void)
+{
+    FILE *fp = fopen("/proc/sys/vm/max_map_count", "r");
+    long count;
+
+    if (fp == NULL)
+        return THREAD_LIMIT;
+    if (fscanf(fp, "%ld", &count) != 1)
+        count = 2 * THREAD_LIMIT + CORE_MAP_RESERVE;
+    fclose(fp);
+
+    if (count < 2 * THREAD_LIMIT + CORE_MAP_RESERVE)
+        return count > 2 + CORE_MAP_RESERVE ? (count - CORE_MAP_RESERVE) / 2 : 1;
+    return THREAD_LIMIT;
+}
 
 int core_initialise(VM *vm)
 {
     Core *tmp = &vm->core;
 
     tmp->thread_num = 0;
-    *tmp->thread_pool = (Thread) {0};
+
+    /* Zero-filled, so every slot starts out THR_UNINIT */
+    tmp->thread_pool = mmap(NULL, sizeof(Thread) * THREAD_LIMIT, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (tmp->thread_pool == MAP_FAILED)
+        return pvm_reporterror(CORE_H, __FUNCTION__, "Allocation failed");
+    tmp->thread_top = 0;
+    tmp->thread_free = SCH_NIL;
+    tmp->thread_limit = core_threadlimit();
+    tmp->stack_size = STACK_SIZE;
+
     sch_initialise(&tmp->scheduler);
+    for (va_t i = 0x0; i < SYNC_LIMIT; i++)
+        syn_initialise(&tmp->sync[i]);
+    for (va_t i = 0x0; i < CHAN_LIMIT; i++)
+        chn_initialise(&tmp->channels[i]);
+    tmp->channel_num = 0;
+
+    tmp->worker_num = 1;
+    tmp->workers = NULL;
+    tmp->waiting = 0;
+    tmp->stopped = false;
+
+    /* The VM is returned by value, so the locks must not depend on their address */
+    tmp->lock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+    tmp->idle = (pthread_cond_t) PTHREAD_COND_INITIALIZER;
+    tmp->memlock = (pthread_rwlock_t) PTHREAD_RWLOCK_INITIALIZER;
 
     return 0;
 }
@@ -28,64 +81,393 @@ int core_finalise(VM *vm)
     Core *tmp = &vm->core;
 
     /* Traverse through thread pool to finalise all alive thread_pool */
-    for (va_t i = 0x0; i < THREAD_LIMIT; i++)
-        if ((tmp->thread_pool[i].flag & (THR_ALIVE | THR_RUN | THR_SLEEP)) == (THR_ALIVE | THR_RUN | THR_SLEEP))
+    for (va_t i = 0x0; i < tmp->thread_top; i++)
+        if (tmp->thread_pool[i].flag != THR_UNINIT && !(tmp->thread_pool[i].flag & THR_DEAD))
             thr_kill(vm, i);
+    for (va_t i = 0x0; i < CHAN_LIMIT; i++)
+        chn_finalise(&tmp->channels[i]);
 
     return THREAD_LIMIT;
 }
 
-inline int core_run(VM *vm)
+int core_unmap(VM *vm)
 {
-    va_t i;
+    Core *tmp = &vm->core;
+
+    if (tmp->thread_pool != NULL)
+        munmap(tmp->thread_pool, sizeof(Thread) * THREAD_LIMIT);
+    tmp->thread_pool = NULL;
+
+    return 0;
+}
+
+/* Puts a thread at the back of the deque of a worker, returns its new size */
+static size_t deque_push(Worker *worker, va_t tid)
+{
+    size_t size;
 
-    thr_spawn(vm, 0x0); /* Spawn Master Thread */
+    pthread_mutex_lock(&worker->lock);
+    worker->deque[(worker->head + worker->size) % THREAD_LIMIT] = tid;
+    size = ++worker->size;
+    pthread_mutex_unlock(&worker->lock);
+
+    return size;
+}
+
+/* Takes the thread at the front of the deque of a worker, SCH_NIL if empty */
+static va_t deque_take(VM *vm, Worker *worker)
+{
+    va_t tid;
+
+    pthread_mutex_lock(&worker->lock);
     do
     {
-        i = thr_run(vm, 0x0);
-    } while(i < THREAD_LIMIT);
+        if (worker->size == 0)
+        {
+            tid = SCH_NIL;
+            break;
+        }
+        tid = worker->deque[worker->head];
+        worker->head = (worker->head + 1) % THREAD_LIMIT;
+        worker->size--;
+    } while (vm->core.thread_pool[tid].flag & THR_DEAD);
+    pthread_mutex_unlock(&worker->lock);
 
-    return i;
+    return tid;
 }
 
 /*
- * TODO: Try making this function return the ID of the thread to run next rather
- *       than calling thr_run by itself as it returns. This way, recursion can
- *       be kept limited so as to not overflowing native stack.
+ * Moves half of the threads from the back of the deque of another worker to
+ * the back of the deque of this one, starting with the victim after it.
+ * Returns whether any thread was stolen.
  */
-int core_managethread(VM *vm, va_t tid)
+static bool core_steal(VM *vm, Worker *worker)
 {
-    if (vm->core.thread_pool[0x0].flag & THR_DEAD)
-        return THREAD_LIMIT;
+    Core *tmp = &vm->core;
+    va_t loot[256]; /* Taken at most at once, however many threads there are */
+    size_t count = 0;
+
+    for (unsigned int k = 1; k < tmp->worker_num && count == 0; k++)
+    {
+        Worker *victim = &tmp->workers[(worker->id + k) % tmp->worker_num];
+
+        pthread_mutex_lock(&victim->lock);
+        count = (victim->size + 1) / 2;
+        if (count > sizeof(loot) / sizeof(loot[0]))
+            count = sizeof(loot) / sizeof(loot[0]);
+        victim->size -= count;
+        for (size_t n = 0; n < count; n++)
+            loot[n] = victim->deque[(victim->head + victim->size + n) % THREAD_LIMIT];
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    /* Never holds two deque locks at once, so thieves cannot deadlock */
+    for (size_t n = 0; n < count; n++)
+        deque_push(worker, loot[n]);
+
+    return count > 0;
+}
+
+/*
+ * Moves the threads of the scheduler run queue to the back of the deque of a
+ * worker, which idle workers may then steal from. Called with the core lock.
+ * Returns the number of threads moved.
+ */
+static size_t core_drain(VM *vm, Worker *worker)
+{
+    Core *tmp = &vm->core;
+    size_t moved = 0;
+    va_t tid;
+
+    while ((tid = sch_next(&tmp->scheduler, tmp->thread_pool)) != SCH_NIL)
+    {
+        deque_push(worker, tid);
+        moved++;
+    }
+    if (moved > 0 && tmp->waiting > 0)
+        pthread_cond_broadcast(&tmp->idle);
 
+    return moved;
+}
+
+/* Wakes up the idle workers after a worker queued threads it has to spare */
+static void core_share(VM *vm)
+{
+    Core *tmp = &vm->core;
+
+    if (tmp->worker_num == 1)
+        return;
+
+    /*
+     * A worker about to wait counts itself in 'waiting' before it looks at
+     * the deques one last time. Either it sees the thread just queued, or
+     * this sees it waiting.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&tmp->waiting, __ATOMIC_RELAXED) > 0)
+    {
+        pthread_mutex_lock(&tmp->lock);
+        pthread_cond_broadcast(&tmp->idle);
+        pthread_mutex_unlock(&tmp->lock);
+    }
+}
+
+/* What pvm_reporterror would print for a stack overflow */
+#define CORE_STRING(x) #x
+#define CORE_OVERFLOW(unit) "Error at " CORE_STRING(unit) ", stk_push: Stack overflow\n"
+
+/*
+ * Reports a push onto a full stack, which faults on the guard page past it.
+ * Any other fault is raised again under the action from before core_run.
+ * Another worker may hold the lock of stderr, so the report is written and
+ * the VM left without stdio.
+ */
+static void core_fault(int sig, siginfo_t *info, void *context)
+{
+    static const char overflow[] = CORE_OVERFLOW(STACK_H);
+    VM *vm = __atomic_load_n(&core_running, __ATOMIC_ACQUIRE);
+    va_t top;
+
+    (void) context;
+    if (vm != NULL)
+    {
+        top = __atomic_load_n(&vm->core.thread_top, __ATOMIC_ACQUIRE);
+        for (va_t i = 0x0; i < top; i++)
+            if (stk_guarded(&vm->core.thread_pool[i].stack, info->si_addr))
+            {
+                (void) write(STDERR_FILENO, overflow, sizeof(overflow) - 1);
+                _exit(1);
+            }
+    }
+    sigaction(sig, &core_fallback, NULL);
+}
+
+/* Runs threads on a worker until the master thread has died */
+static void *core_work(void *arg)
+{
+    Worker *worker = arg;
+    VM *vm = worker->vm;
     va_t i;
+
+    /*
+     * Threads only return here at their switch points, the core then picks the
+     * next one to run. Nothing recurses, so the native stack stays the same
+     * depth however long the program runs.
+     */
+    i = core_managethread(vm, worker, SCH_NIL);
+    while (i != SCH_NIL)
+        i = core_cycle(vm, worker, i, thr_run(vm, i));
+
+    return NULL;
+}
+
+/*
+ * Waits on Core.idle, at most until the earliest thread in SLEEP_NS is due.
+ * Called with the core lock held.
+ */
+static void core_idle(VM *vm)
+{
     Core *tmp = &vm->core;
-    Thread *next = &vm->core.thread_pool[VA_SUCCEED(tid)];
+    struct timespec deadline;
+    uint64_t due;
 
-    /* i = next thread */
-    i = next->flag & THR_UNINIT ? 0x0 :
-        next->flag & THR_DEAD ? VA_SUCCEED(VA_SUCCEED(tid)) :
-        next->flag & THR_SLEEP && next->countdown > 0 ? VA_SUCCEED(tid) :
-        tid;
+    if (tmp->scheduler.timers == SCH_NIL)
+    {
+        pthread_cond_wait(&tmp->idle, &tmp->lock);
+        return;
+    }
 
-    /* Sleep original thread if the the next thread to run is not the same */
-    if (i != tid && tmp->thread_pool[tid].flag & THR_RUN)
-        thr_sleep(vm, tid, tid-1);
+    due = tmp->thread_pool[tmp->scheduler.timers].deadline;
+    deadline.tv_sec = due / 1000000000;
+    deadline.tv_nsec = due % 1000000000;
+    pthread_cond_timedwait(&tmp->idle, &tmp->lock, &deadline);
+}
 
-    return (i == tid && tmp->thread_pool[tid].flag & THR_DEAD) ? core_finalise(vm) : i;
+int core_run(VM *vm)
+{
+    Core *tmp = &vm->core;
+    pthread_condattr_t attr;
+    struct sigaction action;
+
+    /* Spawn Master Thread, unless the embedder spawned threads already */
+    if (tmp->thread_num == 0)
+        thr_spawn(vm, 0x0);
+
+    /* Idle workers time out on the clock SLEEP_NS deadlines are on */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_destroy(&tmp->idle);
+    pthread_cond_init(&tmp->idle, &attr);
+    pthread_condattr_destroy(&attr);
+
+    /* Stack overflows fault on a guard page */
+    action.sa_sigaction = core_fault;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    __atomic_store_n(&core_running, vm, __ATOMIC_RELEASE);
+    sigaction(SIGSEGV, &action, &core_fallback);
+
+    tmp->workers = calloc(tmp->worker_num, sizeof(Worker));
+    if (tmp->workers == NULL)
+        return pvm_reporterror(CORE_H, __FUNCTION__, "Allocation failed");
+    for (unsigned int w = 0; w < tmp->worker_num; w++)
+    {
+        pthread_mutex_init(&tmp->workers[w].lock, NULL);
+        tmp->workers[w].vm = vm;
+        tmp->workers[w].id = w;
+    }
+
+    /* This thread is worker 0, the others get an OS thread of their own */
+    for (unsigned int w = 1; w < tmp->worker_num; w++)
+        if (pthread_create(&tmp->workers[w].handle, NULL, core_work, &tmp->workers[w]) != 0)
+            return pvm_reporterror(CORE_H, __FUNCTION__, "Cannot start worker");
+    core_work(&tmp->workers[0]);
+    for (unsigned int w = 1; w < tmp->worker_num; w++)
+        pthread_join(tmp->workers[w].handle, NULL);
+
+    for (unsigned int w = 0; w < tmp->worker_num; w++)
+        pthread_mutex_destroy(&tmp->workers[w].lock);
+    free(tmp->workers);
+    tmp->workers = NULL;
+    sigaction(SIGSEGV, &core_fallback, NULL);
+    __atomic_store_n(&core_running, NULL, __ATOMIC_RELEASE);
+
+    return core_finalise(vm);
 }
 
-int core_cycle(VM *vm, va_t tid)
+va_t core_managethread(VM *vm, Worker *worker, va_t tid)
 {
     Core *tmp = &vm->core;
+    Thread *pool = tmp->thread_pool;
+    size_t runnable, moved;
+    va_t i;
+
+    /* The run is over once the master thread has died */
+    if (__atomic_load_n(&pool[0x0].flag, __ATOMIC_ACQUIRE) & THR_DEAD)
+    {
+        core_lock(vm);
+        __atomic_store_n(&tmp->stopped, true, __ATOMIC_RELEASE);
+        core_unlock(vm);
+    }
 
-    /* Cycle scheduler */
-    sch_cycle(&tmp->scheduler);
+    /* Threads queued since the last switch point run before the previous one */
+    if (__atomic_load_n(&tmp->scheduler.head, __ATOMIC_RELAXED) != SCH_NIL)
+    {
+        core_lock(vm);
+        core_drain(vm, worker);
+        core_unlock(vm);
+    }
+
+    /*
+     * A thread that is still running goes to the back of the deque, one that
+     * went to sleep to the timer wheel, one that joins another thread among
+     * its waiters. A blocked one is already in the list of what it waits on.
+     * A thread of a PARFOR that stops running hands the chunks left to a new
+     * one, so no chunk waits for another to carry on.
+     */
+    if (tid != SCH_NIL && pool[tid].flag & THR_SLEEP)
+    {
+        pool[tid].flag = THR_SLEEP;
+        core_lock(vm);
+        sch_sleep(&tmp->scheduler, pool, tid);
+        thr_handoff(vm, tid);
+        core_unlock(vm);
+    }
+    else if (tid != SCH_NIL && pool[tid].flag & THR_WAIT)
+    {
+        pool[tid].flag = THR_WAIT;
+        core_lock(vm);
+        sch_wait(&tmp->scheduler, pool, tid);
+        thr_handoff(vm, tid);
+        core_unlock(vm);
+    }
+    else if (tid != SCH_NIL && pool[tid].flag & THR_RUN)
+    {
+        pool[tid].flag = THR_ALIVE;
+        if (deque_push(worker, tid) > 1)
+            core_share(vm);
+    }
+    else if (tid != SCH_NIL && pool[tid].flag & THR_DEAD)
+        thr_reap(vm, tid, THR_HOLD_WORKER);
+
+    for (;;)
+    {
+        if (__atomic_load_n(&tmp->stopped, __ATOMIC_ACQUIRE))
+            return SCH_NIL;
+
+        i = deque_take(vm, worker);
+        if (i != SCH_NIL)
+            return i;
+        if (core_steal(vm, worker))
+            continue;
+
+        /* Nothing to take, look at the run queue and the timers */
+        core_lock(vm);
+        if (tmp->scheduler.timers != SCH_NIL)
+            sch_alarm(&tmp->scheduler, pool, sch_walltime());
+        moved = core_drain(vm, worker);
+
+        /* A master thread dying elsewhere is dead by the time it is not runnable */
+        runnable = __atomic_load_n(&tmp->scheduler.runnable, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&pool[0x0].flag, __ATOMIC_ACQUIRE) & THR_DEAD)
+            __atomic_store_n(&tmp->stopped, true, __ATOMIC_RELEASE);
+        else if (runnable == 0 && tmp->scheduler.sleeping > 0)
+        {
+            sch_idle(&tmp->scheduler, pool);
+            core_drain(vm, worker);
+        }
+        else if (runnable == 0 && tmp->scheduler.timers == SCH_NIL)
+            return pvm_reporterror(CORE_H, __FUNCTION__, "No thread left to run");
+        else if (moved == 0)
+        {
+            /*
+             * Every runnable thread is taken, or every thread waits on the wall
+             * clock: sleep until one is queued or due
+             */
+            __atomic_fetch_add(&tmp->waiting, 1, __ATOMIC_SEQ_CST);
+            if (!core_steal(vm, worker))
+                core_idle(vm);
+            __atomic_fetch_sub(&tmp->waiting, 1, __ATOMIC_SEQ_CST);
+        }
+        core_unlock(vm);
+    }
+}
+
+va_t core_cycle(VM *vm, Worker *worker, va_t tid, vmclock_t cycles)
+{
+    Core *tmp = &vm->core;
+
+    /* Cycle scheduler, then wake up the threads whose sleep is over */
+    sch_advance(&tmp->scheduler, cycles);
+    if (__atomic_load_n(&tmp->scheduler.sleeping, __ATOMIC_RELAXED) > 0)
+    {
+        core_lock(vm);
+        sch_expire(&tmp->scheduler, tmp->thread_pool);
+        core_unlock(vm);
+    }
+
+    /* Only looks at the wall clock while a thread is in SLEEP_NS */
+    if (__atomic_load_n(&tmp->scheduler.timers, __ATOMIC_RELAXED) != SCH_NIL)
+    {
+        core_lock(vm);
+        sch_alarm(&tmp->scheduler, tmp->thread_pool, sch_walltime());
+        core_unlock(vm);
+    }
+
+    return core_managethread(vm, worker, tid);
+}
+
+int core_lock(VM *vm)
+{
+    return pthread_mutex_lock(&vm->core.lock);
+}
+
+int core_unlock(VM *vm)
+{
+    Core *tmp = &vm->core;
 
-    /* Decrement thread_pool countdown */
-    for (va_t i = 0x0; tmp->thread_pool[i].flag != THR_UNINIT; i++)
-        if (tmp->thread_pool[i].flag == THR_SLEEP)
-            tmp->thread_pool[i].countdown--;
+    if (tmp->waiting > 0 && (tmp->scheduler.head != SCH_NIL || tmp->stopped))
+        pthread_cond_broadcast(&tmp->idle);
 
-    return core_managethread(vm, tid);
+    return pthread_mutex_unlock(&tmp->lock);
 }
@@ -6,44 +6,305 @@
  *------------------------------------------------------------------------------
  * Contains the implementation of the VM's heap. The heap is implemented as a
  * superset of the static segment. User has full control over data inserted here
- * such as freeing at will and enlarging/shrinking size.
+ * such as freeing at will and enlarging/shrinking size. Small frames come from
+ * slabs in size classes, through a cache of the running thread.
  ******************************************************************************/
 
+#define _GNU_SOURCE /* mremap */
 #include "../include/heap.h"
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Elements of the frames of each size class, two per power of two */
+static const size_t heap_classsize[HEAP_CLASSES] =
+{
+    1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256
+};
+
+/* Size class of a frame of up to HEAP_SLAB_MAX elements */
+static size_t heap_class(size_t size)
+{
+    size_t bits;
+
+    if (size <= 4)
+        return size == 0 ? 0 : size - 1;
+
+    /* 2^bits < size <= 2^(bits + 1), in its lower or upper half */
+    bits = 63 - __builtin_clzll(size - 1);
+    return 2 * bits + ((size - 1) >> (bits - 1) & 1);
+}
+
+size_t heap_width(uint32_t type)
+{
+    switch (type)
+    {
+        case 0:
+            return sizeof(PrimitiveData);
+        case I8: case UI8:
+            return 1;
+        case I16: case UI16:
+            return 2;
+        case I32: case UI32:
+            return 4;
+        case I64: case UI64: case DBL: case VA:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/* PrimitiveData sized units the allocator hands out for a frame, the size classes and limits count these */
+static size_t heap_units(uint32_t type, size_t size)
+{
+    return (heap_width(type) * size + sizeof(PrimitiveData) - 1) / sizeof(PrimitiveData);
+}
+
+/* Whether a frame of the given size is carved out of the slabs */
+static bool heap_small(const Heap *heap, size_t size)
+{
+    return heap->slabs && size <= HEAP_SLAB_MAX;
+}
+
+/* Whether a frame of the given size is mapped on its own */
+static bool heap_mapped(size_t size)
+{
+    return size >= HEAP_MAP_MIN;
+}
+
+/* Bytes of the mapping of a frame of the given size, in whole pages */
+static size_t heap_length(size_t size)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    return (sizeof(PrimitiveData) * size + page - 1) / page * page;
+}
+
+/* Free frames are linked through their first element */
+static void heap_push(HeapList *list, PrimitiveData *block)
+{
+    memcpy(block, &list->head, sizeof(list->head));
+    list->head = block;
+    list->count++;
+}
+
+static PrimitiveData *heap_pop(HeapList *list)
+{
+    PrimitiveData *block = list->head;
+
+    if (block != NULL)
+    {
+        memcpy(&list->head, block, sizeof(list->head));
+        list->count--;
+    }
+
+    return block;
+}
+
+/* Carves a frame out of the last slab, or a new one. Called with the heap lock held. */
+static PrimitiveData *heap_carve(Heap *heap, size_t class)
+{
+    size_t bytes = sizeof(PrimitiveData) * heap_classsize[class];
+    PrimitiveData *block;
+    char *slab;
+
+    if (heap->room < bytes)
+    {
+        slab = mmap(NULL, HEAP_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED)
+            return NULL;
+
+        /* The first element links the slabs for heap_finalise */
+        memcpy(slab, &heap->slab, sizeof(heap->slab));
+        heap->slab = slab;
+        heap->bump = slab + sizeof(PrimitiveData);
+        heap->room = HEAP_SLAB_SIZE - sizeof(PrimitiveData);
+    }
+
+    block = (PrimitiveData *) heap->bump;
+    heap->bump += bytes;
+    heap->room -= bytes;
+
+    return block;
+}
+
+/* Moves up to HEAP_BATCH free frames of a class to a cache, carving new ones if there are none */
+static void heap_refill(Heap *heap, HeapList *list, size_t class)
+{
+    PrimitiveData *block;
+
+    pthread_mutex_lock(&heap->lock);
+    while (list->count < HEAP_BATCH && (block = heap_pop(&heap->lists[class])) != NULL)
+        heap_push(list, block);
+    while (list->count < HEAP_BATCH && (block = heap_carve(heap, class)) != NULL)
+        heap_push(list, block);
+    pthread_mutex_unlock(&heap->lock);
+}
+
+/*
+ * Takes a frame of the given size, from the slabs, malloc or a mapping of its
+ * own, and clears it if asked to. Mapped frames are zero pages already.
+ */
+static PrimitiveData *heap_take(Heap *heap, HeapCache *cache, size_t size, bool clear)
+{
+    size_t class = heap_class(size);
+    PrimitiveData *block;
+
+    if (heap_mapped(size))
+    {
+        block = mmap(NULL, heap_length(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return block == MAP_FAILED ? NULL : block;
+    }
+    if (!heap_small(heap, size))
+        return clear ? calloc(size, sizeof(PrimitiveData)) : malloc(sizeof(PrimitiveData) * size);
+    if (cache == NULL)
+    {
+        pthread_mutex_lock(&heap->lock);
+        block = heap_pop(&heap->lists[class]);
+        if (block == NULL)
+            block = heap_carve(heap, class);
+        pthread_mutex_unlock(&heap->lock);
+    }
+    else
+    {
+        if (cache->lists[class].head == NULL)
+            heap_refill(heap, &cache->lists[class], class);
+        block = heap_pop(&cache->lists[class]);
+    }
+
+    /* Frames from the slabs may have been used before */
+    if (block != NULL && clear)
+        memset(block, 0, sizeof(PrimitiveData) * size);
+
+    return block;
+}
+
+/* Gives back a frame of the given size, half of a full cache spilling over to the heap */
+static void heap_give(Heap *heap, HeapCache *cache, PrimitiveData *block, size_t size)
+{
+    size_t class = heap_class(size);
+
+    if (heap_mapped(size))
+    {
+        munmap(block, heap_length(size));
+        return;
+    }
+    if (!heap_small(heap, size))
+    {
+        free(block);
+        return;
+    }
+    if (cache == NULL)
+    {
+        pthread_mutex_lock(&heap->lock);
+        heap_push(&heap->lists[class], block);
+        pthread_mutex_unlock(&heap->lock);
+        return;
+    }
+
+    heap_push(&cache->lists[class], block);
+    if (cache->lists[class].count > HEAP_CACHE_LIMIT)
+    {
+        pthread_mutex_lock(&heap->lock);
+        while (cache->lists[class].count > HEAP_BATCH)
+            heap_push(&heap->lists[class], heap_pop(&cache->lists[class]));
+        pthread_mutex_unlock(&heap->lock);
+    }
+}
+
+/* Class of a flat block of the given elements, header included */
+static size_t heap_flatclass(size_t units)
+{
+    if (units <= HEAP_SLAB_MAX)
+        return heap_class(units);
+
+    /* 2^(bits - 1) < units <= 2^bits, from 2^9 on */
+    return HEAP_CLASSES + (64 - __builtin_clzll(units - 1)) - 9;
+}
+
+/* Elements of the blocks of a flat class, header included */
+static size_t heap_flatsize(size_t class)
+{
+    return class < HEAP_CLASSES ? heap_classsize[class] : (size_t) 1 << (class - HEAP_CLASSES + 9);
+}
 
 int heap_initialise(Heap *heap, FILE *fp)
 {
-    size_t size;
+    uint32_t size;
     fread(&size, sizeof(uint32_t), 1, fp);
     size = REVERSE_32(size);
     heap->freeframes = heap->size = size;
     heap->totalblocks = 0;
-    heap->var_pool = malloc(sizeof(HeapFrame) * size);
 
-    if (heap->var_pool == NULL)
+    /* Frames start out unoccupied, so the whole pool is cleared */
+    heap->var_pool = calloc(size, sizeof(HeapFrame));
+
+    if (heap->var_pool == NULL && size > 0)
         return pvm_reporterror(HEAP_H, __FUNCTION__, "Allocation Failed");
 
-    (*heap->var_pool) = (HeapFrame) {.occupied = false, .framesize = 0, .block = NULL};
+    /* Address 0 is the null address, never a handle */
+    heap->fixed = size;
+    heap->handletop = size > 0 ? size : 1;
+    heap->handlefree = 0;
+
+    heap->slabs = true;
+    memset(heap->lists, 0, sizeof(heap->lists));
+    heap->slab = NULL;
+    heap->bump = NULL;
+    heap->room = 0;
+    heap->flat = NULL;
+    heap->flatclass = NULL;
+    heap->flattop = 0;
+    memset(heap->flatfree, 0, sizeof(heap->flatfree));
+
+    /* The VM is returned by value, so the lock must not depend on its address */
+    heap->lock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
 
     return 0;
 }
 
 /*
- * It is very important that users free whatever is explicitly allocated
- * because this function does not check for allocated blocks.
+ * Frames left allocated are freed too, the slabs all at once however many
+ * frames they hold.
  */
 int heap_finalise(Heap *heap)
 {
+    void *slab, *next;
+    size_t units;
+
+    if (heap->flat != NULL)
+    {
+        munmap(heap->flat, sizeof(PrimitiveData) * HEAP_FLAT_LIMIT);
+        munmap(heap->flatclass, HEAP_FLAT_LIMIT);
+    }
+    for (size_t class = 0; class < HEAP_FLAT_CLASSES; class++)
+        free(heap->flatfree[class].blocks);
+    memset(heap->flatfree, 0, sizeof(heap->flatfree));
+    heap->flat = NULL;
+    heap->flatclass = NULL;
+    heap->flattop = 0;
     if (heap->size == 0)
         return 0;
+    for (va_t i = 0; i < heap->size; i++)
+    {
+        units = heap_units(heap->var_pool[i].type, heap->var_pool[i].framesize);
+        if (heap->var_pool[i].occupied && !heap_small(heap, units))
+            heap_give(heap, NULL, heap->var_pool[i].block, units);
+    }
+    for (slab = heap->slab; slab != NULL; slab = next)
+    {
+        memcpy(&next, slab, sizeof(next));
+        munmap(slab, HEAP_SLAB_SIZE);
+    }
+    heap->slab = NULL;
     heap->totalblocks = heap->freeframes = 0;
     free(heap->var_pool);
 
     return 0;
 }
 
-int heap_malloc(Heap *heap, va_t va, size_t size)
+/* Allocates a frame of a size and element storage, cleared if asked to */
+static int heap_allocate(Heap *heap, HeapCache *cache, va_t va, size_t size, uint32_t type, bool clear)
 {
     if (heap->var_pool[va].occupied == true || heap->freeframes == 0)
         return pvm_reporterror(HEAP_H, __FUNCTION__, "Heap Overflow");
@@ -53,7 +314,8 @@ int heap_malloc(Heap *heap, va_t va, size_t size)
 
     heap->var_pool[va].occupied = true;
     heap->var_pool[va].framesize = size;
-    heap->var_pool[va].block = malloc(sizeof(PrimitiveData) * size);
+    heap->var_pool[va].type = type;
+    heap->var_pool[va].block = heap_take(heap, cache, heap_units(type, size), clear);
 
     if (heap->var_pool[va].block == NULL)
         return pvm_reporterror(HEAP_H, __FUNCTION__, NULL);
@@ -61,43 +323,112 @@ int heap_malloc(Heap *heap, va_t va, size_t size)
     return 0;
 }
 
-int heap_calloc(Heap *heap, va_t va, size_t size)
+int heap_malloc(Heap *heap, HeapCache *cache, va_t va, size_t size)
 {
-    if (heap->var_pool[va].occupied == true || heap->freeframes == 0)
+    /* Handles are only ever picked by the heap */
+    if (va >= heap->fixed)
         return pvm_reporterror(HEAP_H, __FUNCTION__, "Heap Overflow");
 
-    heap->freeframes--;
-    heap->totalblocks += size;
+    return heap_allocate(heap, cache, va, size, 0, false);
+}
 
-    heap->var_pool[va].occupied = true;
-    heap->var_pool[va].framesize = size;
-    heap->var_pool[va].block = calloc(size, sizeof(PrimitiveData));
+va_t heap_mallochandle(Heap *heap, HeapCache *cache, size_t size)
+{
+    size_t grown;
+    HeapFrame *tmp;
+    va_t va;
 
-    if (heap->var_pool[va].block == NULL)
-        return pvm_reporterror(HEAP_H, __FUNCTION__, NULL);
+    if (heap->handlefree != 0)
+    {
+        va = heap->handlefree;
+        heap->handlefree = heap->var_pool[va].link;
+        heap->var_pool[va].block = NULL;
+    }
+    else
+    {
+        if (heap->handletop >= heap->size)
+        {
+            /* Frames only ever move while the heap is locked for writing */
+            grown = heap->size < 8 ? 16 : 2 * heap->size;
+            tmp = realloc(heap->var_pool, sizeof(HeapFrame) * grown);
+            if (tmp == NULL)
+                return pvm_reporterror(HEAP_H, __FUNCTION__, "Allocation Failed");
+            memset(&tmp[heap->size], 0, sizeof(HeapFrame) * (grown - heap->size));
 
-    return 0;
+            heap->freeframes += grown - heap->size;
+            heap->var_pool = tmp;
+            heap->size = grown;
+        }
+        va = heap->handletop++;
+    }
+
+    heap_allocate(heap, cache, va, size, 0, false);
+
+    return va;
 }
 
-int heap_realloc(Heap *heap, va_t va, size_t size)
+int heap_calloc(Heap *heap, HeapCache *cache, va_t va, size_t size)
+{
+    /* Handles are only ever picked by the heap */
+    if (va >= heap->fixed)
+        return pvm_reporterror(HEAP_H, __FUNCTION__, "Heap Overflow");
+
+    return heap_allocate(heap, cache, va, size, 0, true);
+}
+
+int heap_malloctyped(Heap *heap, HeapCache *cache, va_t va, size_t size, uint32_t type)
+{
+    if (type == 0 || heap_width(type) == 0)
+        return pvm_reporterror(HEAP_H, __FUNCTION__, "Illegal type");
+    if (va >= heap->fixed)
+        return pvm_reporterror(HEAP_H, __FUNCTION__, "Heap Overflow");
+
+    return heap_allocate(heap, cache, va, size, type, false);
+}
+
+int heap_realloc(Heap *heap, HeapCache *cache, va_t va, size_t size)
 {
     if (heap->var_pool[va].occupied == false)
         return pvm_reporterror(HEAP_H, __FUNCTION__, "Target unallocated");
 
+    HeapFrame *frame = &heap->var_pool[va];
+    size_t old = heap_units(frame->type, frame->framesize), units = heap_units(frame->type, size);
     PrimitiveData * tmp;
 
-    heap->totalblocks -= heap->var_pool[va].framesize; // Minus previous size
-    heap->totalblocks += heap->var_pool[va].framesize = size; // New size
-
-    tmp = realloc(heap->var_pool[va].block, size);
-    if (tmp == NULL)
+    /*
+     * A frame of the same size class stays where it is, a mapped one has its
+     * pages moved rather than copied
+     */
+    if (heap_small(heap, old) && heap_small(heap, units) && heap_class(old) == heap_class(units))
+        tmp = frame->block;
+    else if (heap_mapped(old) && heap_mapped(units))
+    {
+        tmp = mremap(frame->block, heap_length(old), heap_length(units), MREMAP_MAYMOVE);
+        if (tmp == MAP_FAILED)
+            tmp = NULL;
+    }
+    else if (!heap_small(heap, old) && !heap_small(heap, units) && !heap_mapped(old) && !heap_mapped(units))
+        tmp = realloc(frame->block, sizeof(PrimitiveData) * units);
+    else
+    {
+        tmp = heap_take(heap, cache, units, false);
+        if (tmp != NULL)
+        {
+            memcpy(tmp, frame->block, sizeof(PrimitiveData) * (old < units ? old : units));
+            heap_give(heap, cache, frame->block, old);
+        }
+    }
+    if (tmp == NULL && size > 0)
         return pvm_reporterror(HEAP_H, __FUNCTION__, "Allocation Failed");
 
-    heap->var_pool[va].block = tmp;
+    heap->totalblocks -= frame->framesize; // Minus previous size
+    heap->totalblocks += frame->framesize = size; // New size
+
+    frame->block = tmp;
     return 0;
 }
 
-int heap_free(Heap *heap, va_t va)
+int heap_free(Heap *heap, HeapCache *cache, va_t va)
 {
     if (heap->var_pool[va].occupied == false)
         return pvm_reporterror(HEAP_H, __FUNCTION__, "Target unallocated");
@@ -106,11 +437,137 @@ int heap_free(Heap *heap, va_t va)
     heap->totalblocks -= heap->var_pool[va].framesize;
 
     /* Free frame */
+    heap_give(heap, cache, heap->var_pool[va].block, heap_units(heap->var_pool[va].type, heap->var_pool[va].framesize));
     heap->var_pool[va].occupied = false;
     heap->var_pool[va].framesize = 0;
-    free(heap->var_pool[va].block);
+    heap->var_pool[va].type = 0;
     heap->var_pool[va].block = NULL;
 
+    if (va >= heap->fixed)
+    {
+        heap->var_pool[va].link = heap->handlefree;
+        heap->handlefree = va;
+    }
+
+
+    return 0;
+}
+
+va_t heap_flatmalloc(Heap *heap, size_t size)
+{
+    size_t units = size + 1, class;
+    HeapFlatList *list;
+    PrimitiveData *flat;
+    uint8_t *flatclass;
+    va_t va;
+
+    if (units > HEAP_FLAT_LIMIT - 1)
+        return pvm_reporterror(HEAP_H, __FUNCTION__, "Heap Overflow");
+    class = heap_flatclass(units);
+    list = &heap->flatfree[class];
+
+    pthread_mutex_lock(&heap->lock);
+    if (heap->flat == NULL)
+    {
+        /* Only the pages touched are ever committed, of the region and of the classes alike */
+        flat = mmap(NULL, sizeof(PrimitiveData) * HEAP_FLAT_LIMIT, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        flatclass = mmap(NULL, HEAP_FLAT_LIMIT, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (flat == MAP_FAILED || flatclass == MAP_FAILED)
+        {
+            if (flat != MAP_FAILED)
+                munmap(flat, sizeof(PrimitiveData) * HEAP_FLAT_LIMIT);
+            if (flatclass != MAP_FAILED)
+                munmap(flatclass, HEAP_FLAT_LIMIT);
+            pthread_mutex_unlock(&heap->lock);
+            return pvm_reporterror(HEAP_H, __FUNCTION__, "Allocation Failed");
+        }
+        heap->flat = flat;
+        heap->flatclass = flatclass;
+
+        /* Address 0 is the null address */
+        __atomic_store_n(&heap->flattop, 1, __ATOMIC_RELEASE);
+    }
+
+    if (list->count > 0)
+        va = list->blocks[--list->count];
+    else
+    {
+        if (heap->flattop + heap_flatsize(class) > HEAP_FLAT_LIMIT)
+        {
+            pthread_mutex_unlock(&heap->lock);
+            return pvm_reporterror(HEAP_H, __FUNCTION__, "Heap Overflow");
+        }
+        va = heap->flattop;
+
+        /* Threads running at once only check addresses against it */
+        __atomic_store_n(&heap->flattop, va + heap_flatsize(class), __ATOMIC_RELEASE);
+    }
+
+    heap->flatclass[va] = class + 1;
+    pthread_mutex_unlock(&heap->lock);
+
+    return va + 1;
+}
+
+int heap_flatfree(Heap *heap, va_t va)
+{
+    size_t page = sysconf(_SC_PAGESIZE), class;
+    HeapFlatList *list;
+    uintptr_t start, end;
+    va_t *tmp;
+
+    pthread_mutex_lock(&heap->lock);
+    if (va < 2 || va >= heap->flattop || heap->flatclass[va - 1] == 0)
+    {
+        pthread_mutex_unlock(&heap->lock);
+        return pvm_reporterror(HEAP_H, __FUNCTION__, "Target unallocated");
+    }
+    class = heap->flatclass[va - 1] - 1;
+    list = &heap->flatfree[class];
+
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity < 8 ? 16 : 2 * list->capacity;
+        tmp = realloc(list->blocks, sizeof(va_t) * list->capacity);
+        if (tmp == NULL)
+        {
+            pthread_mutex_unlock(&heap->lock);
+            return pvm_reporterror(HEAP_H, __FUNCTION__, "Allocation Failed");
+        }
+        list->blocks = tmp;
+    }
+
+    /* The whole pages past the header go back to the OS, they read as zero pages once reused */
+    if (heap_mapped(heap_flatsize(class)))
+    {
+        start = ((uintptr_t) &heap->flat[va] + page - 1) / page * page;
+        end = (uintptr_t) &heap->flat[va - 1 + heap_flatsize(class)] / page * page;
+        if (start < end)
+            madvise((void *) start, end - start, MADV_DONTNEED);
+    }
+
+    heap->flatclass[va - 1] = 0;
+    list->blocks[list->count++] = va - 1;
+    pthread_mutex_unlock(&heap->lock);
+
+    return 0;
+}
+
+int heap_flush(Heap *heap, HeapCache *cache)
+{
+    PrimitiveData *block;
+
+    for (size_t class = 0; class < HEAP_CLASSES; class++)
+    {
+        if (cache->lists[class].count == 0)
+            continue;
+        pthread_mutex_lock(&heap->lock);
+        while ((block = heap_pop(&cache->lists[class])) != NULL)
+            heap_push(&heap->lists[class], block);
+        pthread_mutex_unlock(&heap->lock);
+    }
 
     return 0;
 }
@@ -0,0 +1,641 @@
+/*******************************************************************************
+ * File             : jit.c
+ * Path             : pvm/src
+ * Author           : Muhammad Adriano Raksi
+ * Created          : 17-10-26 (DD-MM-YY)
+ *------------------------------------------------------------------------------
+ * Contains the implementation of the VM's baseline JIT compiler. A region is
+ * the straight run of decoded instructions starting at a hot backward jump
+ * target. It loops natively for as long as its jumps lead back to its first
+ * instruction, and returns to the interpreter everywhere else.
+ *
+ * While a region runs, the machine registers hold:
+ *     rbx : register file of the thread (start of its ControlUnit)
+ *     r12 : VM instance
+ *     r13 : number of instructions retired
+ *     r14 : where the number of instructions retired is written back
+ *     r15 : thread ID
+ *     rbp : retired instruction count at which the region returns
+ * Everything but LOAD, MOVE and the 32-bit integer forms of ADD, SUB, MUL, the
+ * comparisons and the compare-and-branch opcodes, with or without a
+ * destination register or an immediate, is performed by calling its opcode
+ * function.
+ ******************************************************************************/
+
+#include "../include/jit.h"
+#include "../include/vm.h"
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* x86-64 register numbers */
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/* x86-64 condition codes */
+enum { CC_E = 0x4, CC_NE = 0x5, CC_AE = 0x3, CC_B = 0x2, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF };
+
+/* Displacement of a register and of its value from rbx */
+#define REG(index)      ((int32_t) ((index) * sizeof(PrimitiveData)))
+#define VAL(index)      (REG(index) + (int32_t) offsetof(PrimitiveData, i64))
+
+/* Machine code of a region while it is compiled */
+typedef struct
+{
+    uint8_t *code;
+    size_t size, capacity;
+
+    /* rel32 fields jumping to the exit of an instruction, patched last */
+    struct
+    {
+        size_t at;
+        va_t index, retired;
+    } *exits;
+    size_t exit_num;
+} Emitter;
+
+static void emit(Emitter *e, const void *bytes, size_t size)
+{
+    if (e->size + size > e->capacity)
+    {
+        e->capacity = e->capacity * 2 + size;
+        e->code = realloc(e->code, e->capacity);
+        if (e->code == NULL)
+            pvm_reporterror(JIT_H, __FUNCTION__, "Out of memory");
+    }
+    memcpy(e->code + e->size, bytes, size);
+    e->size += size;
+}
+
+static void emit8(Emitter *e, uint8_t byte)
+{
+    emit(e, &byte, 1);
+}
+
+static void emit32(Emitter *e, uint32_t word)
+{
+    emit(e, &word, 4);
+}
+
+static void emit64(Emitter *e, uint64_t word)
+{
+    emit(e, &word, 8);
+}
+
+/* REX prefix, left out when it would be empty */
+static void emit_rex(Emitter *e, int wide, int reg, int base)
+{
+    uint8_t rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((base & 8) ? 0x01 : 0);
+    if (rex != 0x40)
+        emit8(e, rex);
+}
+
+/* Instruction with a [base + disp32] memory operand */
+static void emit_mem(Emitter *e, int wide, uint8_t op, int reg, int base, int32_t disp)
+{
+    emit_rex(e, wide, reg, base);
+    emit8(e, op);
+    emit8(e, 0x80 | (reg & 7) << 3 | (base & 7));
+    if ((base & 7) == RSP)
+        emit8(e, 0x24);
+    emit32(e, disp);
+}
+
+/* Instruction with two register operands */
+static void emit_rr(Emitter *e, uint8_t op, int reg, int rm)
+{
+    emit_rex(e, 1, reg, rm);
+    emit8(e, op);
+    emit8(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* op r64, imm32 of group 1: 0 = add, 5 = sub, 7 = cmp */
+static void emit_ri(Emitter *e, int group, int reg, int32_t imm)
+{
+    emit_rex(e, 1, 0, reg);
+    emit8(e, 0x81);
+    emit8(e, 0xC0 | group << 3 | (reg & 7));
+    emit32(e, imm);
+}
+
+static void emit_push(Emitter *e, int reg)
+{
+    emit_rex(e, 0, 0, reg);
+    emit8(e, 0x50 | (reg & 7));
+}
+
+static void emit_pop(Emitter *e, int reg)
+{
+    emit_rex(e, 0, 0, reg);
+    emit8(e, 0x58 | (reg & 7));
+}
+
+/* Jump with a rel32 to patch, returns where the rel32 is */
+static size_t emit_jump(Emitter *e, int cc)
+{
+    if (cc < 0)
+        emit8(e, 0xE9);
+    else
+    {
+        emit8(e, 0x0F);
+        emit8(e, 0x80 | cc);
+    }
+    emit32(e, 0);
+    return e->size - 4;
+}
+
+/* Points the rel32 at the given position of the code */
+static void patch(Emitter *e, size_t at, size_t target)
+{
+    int32_t rel = (int32_t) (target - (at + 4));
+    memcpy(e->code + at, &rel, 4);
+}
+
+/*
+ * Jump to the exit of an instruction, the interpreter goes on from there. The
+ * exit adds the instructions retired since the start of the region to r13.
+ */
+static void emit_exit(Emitter *e, int cc, va_t index, va_t retired)
+{
+    e->exits = realloc(e->exits, (e->exit_num + 1) * sizeof(*e->exits));
+    if (e->exits == NULL)
+        pvm_reporterror(JIT_H, __FUNCTION__, "Out of memory");
+    e->exits[e->exit_num].at = emit_jump(e, cc);
+    e->exits[e->exit_num].index = index;
+    e->exits[e->exit_num].retired = retired;
+    e->exit_num++;
+}
+
+/* Performs the instruction by calling its opcode function */
+static void emit_call(Emitter *e, const Instruction *instr, va_t index)
+{
+    /* The opcode functions read the instruction through the control unit */
+    emit_mem(e, 1, 0xC7, 0, RBX, offsetof(ControlUnit, instrpointreg));
+    emit32(e, index + 1);
+    emit_mem(e, 0, 0xC6, 0, RBX, offsetof(ControlUnit, instrreg));
+    emit8(e, instr->opcode);
+
+    emit_rr(e, 0x89, R12, RDI);
+    emit_rr(e, 0x89, R15, RSI);
+    emit_rex(e, 1, 0, RAX);
+    emit8(e, 0xB8);
+    emit64(e, (uint64_t) (uintptr_t) opc_Execute[instr->opcode]);
+    emit8(e, 0xFF);
+    emit8(e, 0xD0);
+}
+
+/*
+ * Jumps to slow unless both operands hold 32-bit integers. The literal of an
+ * immediate form is known to be one already, see jit_inlinable.
+ */
+static void emit_guard(Emitter *e, const Instruction *instr, size_t slow[2])
+{
+    for (int i = 0; i < 2; i++)
+    {
+        if (instr->reg[i] == REG_IMM)
+        {
+            slow[i] = slow[i - 1];
+            continue;
+        }
+        emit_mem(e, 0, 0x81, 7, RBX, REG(instr->reg[i]));
+        emit32(e, I32);
+        slow[i] = emit_jump(e, CC_NE);
+    }
+}
+
+/* movsxd of the second operand, the literal itself for an immediate form */
+static void emit_operand(Emitter *e, const Instruction *instr, int reg)
+{
+    if (instr->reg[1] == REG_IMM)
+    {
+        emit_rex(e, 1, 0, reg);
+        emit8(e, 0xC7);
+        emit8(e, 0xC0 | (reg & 7));
+        emit32(e, instr->data.i32);
+    }
+    else
+        emit_mem(e, 1, 0x63, reg, RBX, VAL(instr->reg[1]));
+}
+
+/* ADD, SUB and MUL of 32-bit integers, wrapping around like the interpreter */
+static void emit_arithmetic(Emitter *e, const Instruction *instr, va_t index)
+{
+    size_t slow[2], done, low, wrapped[2];
+
+    emit_guard(e, instr, slow);
+    emit_mem(e, 1, 0x63, RAX, RBX, VAL(instr->reg[0]));
+    emit_operand(e, instr, RCX);
+    switch (instr->opcode)
+    {
+        case 0x15: emit_rr(e, 0x01, RCX, RAX); break;
+        case 0x16: emit_rr(e, 0x29, RCX, RAX); break;
+        default:
+            emit_rex(e, 1, RAX, RCX);
+            emit8(e, 0x0F);
+            emit8(e, 0xAF);
+            emit8(e, 0xC0 | (RAX & 7) << 3 | (RCX & 7));
+            break;
+    }
+
+    /* Past INT_MAX: INT_MIN + (value - INT_MAX) */
+    emit_ri(e, 7, RAX, INT32_MAX);
+    low = emit_jump(e, CC_LE);
+    emit_ri(e, 5, RAX, INT32_MAX);
+    emit_ri(e, 0, RAX, INT32_MIN);
+    wrapped[0] = emit_jump(e, -1);
+
+    /* Past INT_MIN: INT_MAX + (value - INT_MIN) */
+    patch(e, low, e->size);
+    emit_ri(e, 7, RAX, INT32_MIN);
+    wrapped[1] = emit_jump(e, CC_GE);
+    emit_ri(e, 5, RAX, INT32_MIN);
+    emit_ri(e, 0, RAX, INT32_MAX);
+
+    patch(e, wrapped[0], e->size);
+    patch(e, wrapped[1], e->size);
+
+    /* A product that wrapped around more than once is INT_MIN, see thr_run */
+    if (instr->opcode == 0x17)
+    {
+        emit_ri(e, 7, RAX, INT32_MAX);
+        low = emit_jump(e, CC_G);
+        emit_ri(e, 7, RAX, INT32_MIN);
+        done = emit_jump(e, CC_GE);
+        patch(e, low, e->size);
+        emit8(e, 0xB8);
+        emit32(e, INT32_MIN);
+        patch(e, done, e->size);
+    }
+    emit_mem(e, 1, 0x89, RAX, RBX, VAL(instr->reg[2]));
+    emit_mem(e, 1, 0xC7, 0, RBX, REG(instr->reg[2]));
+    emit32(e, I32);
+    done = emit_jump(e, -1);
+
+    patch(e, slow[0], e->size);
+    patch(e, slow[1], e->size);
+    emit_call(e, instr, index);
+    patch(e, done, e->size);
+}
+
+/*
+ * Comparisons of 32-bit integers. Results are written as whole quadwords so
+ * a MOVE of aritreg right after loads them straight from the store buffer.
+ */
+static void emit_relational(Emitter *e, const Instruction *instr, va_t index)
+{
+    static const uint8_t cc[6] = {CC_L, CC_LE, CC_G, CC_GE, CC_E, CC_NE};
+    size_t slow[2], done;
+
+    emit_guard(e, instr, slow);
+    emit_rr(e, 0x31, RDX, RDX);
+    emit_mem(e, 1, 0x63, RAX, RBX, VAL(instr->reg[0]));
+    emit_operand(e, instr, RCX);
+    emit_rr(e, 0x39, RCX, RAX);
+    emit8(e, 0x0F);
+    emit8(e, 0x90 | cc[instr->opcode - 0x20]);
+    emit8(e, 0xC0 | RDX);
+    emit_mem(e, 1, 0x89, RDX, RBX, VAL(instr->reg[2]));
+    emit_mem(e, 1, 0xC7, 0, RBX, REG(instr->reg[2]));
+    emit32(e, I8);
+    done = emit_jump(e, -1);
+
+    patch(e, slow[0], e->size);
+    patch(e, slow[1], e->size);
+    emit_call(e, instr, index);
+    patch(e, done, e->size);
+}
+
+/* Back at the start of the region, which returns there once the limit is reached */
+static void emit_loop(Emitter *e, va_t index, va_t head, size_t loop)
+{
+    emit_ri(e, 0, R13, index - head + 1);
+    emit_rr(e, 0x39, RBP, R13);
+    patch(e, emit_jump(e, CC_B), loop);
+    emit_exit(e, -1, head, 0);
+}
+
+/*
+ * JUMP, JUMP_IF_TRUE and JUMP_IF_FALSE. Only a taken jump back to the start
+ * of the region stays native, anything else is left to the interpreter.
+ */
+static void emit_jump_to(Emitter *e, const Instruction *instr, va_t index, va_t head, va_t offset, size_t loop)
+{
+    size_t skip = 0;
+
+    if (instr->opcode != 0x12)
+    {
+        /* The comparisons leave an I8, other conditions are interpreted */
+        emit_mem(e, 0, 0x81, 7, RBX, REG(REG_AR));
+        emit32(e, I8);
+        emit_exit(e, CC_NE, index, index - head);
+        emit_mem(e, 0, 0x80, 7, RBX, VAL(REG_AR));
+        emit8(e, instr->opcode == 0x13 ? 1 : 0);
+        skip = emit_jump(e, CC_NE);
+    }
+
+    emit_mem(e, 0, 0x81, 7, RBX, REG(instr->reg[0]));
+    emit32(e, I32);
+    emit_exit(e, CC_NE, index, index - head);
+    emit_mem(e, 0, 0x81, 7, RBX, VAL(instr->reg[0]));
+    emit32(e, offset);
+    emit_exit(e, CC_NE, index, index - head);
+    emit_loop(e, index, head, loop);
+
+    if (skip)
+        patch(e, skip, e->size);
+}
+
+/*
+ * Compare-and-branch of 32-bit integers. Only a taken branch back to the
+ * start of the region stays native. Other types leave the region before the
+ * branch, for the interpreter to perform it.
+ */
+static void emit_branch(Emitter *e, const Instruction *instr, va_t index, va_t head, size_t loop)
+{
+    static const uint8_t cc[6] = {CC_L, CC_LE, CC_G, CC_GE, CC_E, CC_NE};
+    uint8_t taken = cc[OPC_RELATIONAL(instr->opcode) - 0x20];
+    size_t skip;
+
+    if (instr->reg[1] == REG_IMM && instr->data.storage != I32)
+    {
+        emit_exit(e, -1, index, index - head);
+        return;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (instr->reg[i] == REG_IMM)
+            continue;
+        emit_mem(e, 0, 0x81, 7, RBX, REG(instr->reg[i]));
+        emit32(e, I32);
+        emit_exit(e, CC_NE, index, index - head);
+    }
+
+    emit_mem(e, 1, 0x63, RAX, RBX, VAL(instr->reg[0]));
+    emit_operand(e, instr, RCX);
+    emit_rr(e, 0x39, RCX, RAX);
+    if (instr->target != head)
+    {
+        emit_exit(e, taken, instr->target, index - head + 1);
+        return;
+    }
+
+    /* Condition codes come in pairs that differ in the lowest bit */
+    skip = emit_jump(e, taken ^ 1);
+    emit_loop(e, index, head, loop);
+    patch(e, skip, e->size);
+}
+
+/* Whether an inlined form applies, immediate forms only with an I32 literal */
+static bool jit_inlinable(const Instruction *instr)
+{
+    return instr->reg[1] != REG_IMM || instr->data.storage == I32;
+}
+
+/* Whether the region goes on past the instruction */
+static bool jit_compilable(const Instruction *instr)
+{
+    switch (instr->opcode)
+    {
+        case 0x01:  /* HLT */
+        case 0x29:  /* STAMP, needs the clocks of the run */
+        case 0x5D:  /* SWITCH, dispatched by the interpreter */
+        case 0x5F:  /* JOIN, YIELD, PARFOR and blocking opcodes end the run of the thread */
+        case 0x60:
+        case 0x62:
+        case 0x63:
+        case 0x65:
+        case 0x68:
+        case 0x69:
+        case 0x75:
+        case 0x76:
+        case 0x79:
+        case 0x7A:
+            return false;
+        default:
+            return opc_Execute[instr->opcode] != NULL;
+    }
+}
+
+/* Compiles the region starting at head into the arena */
+static int jit_compile(VM *vm, va_t head)
+{
+    Jit *jit = &vm->jit;
+    CodeSeg *codeseg = &vm->codeseg;
+    Emitter e = {0};
+    size_t loop, out, pagesize, size;
+    va_t i, offset;
+    bool closed = false;
+
+    /* Byte offset jumps back to the start of the region use */
+    for (offset = 0; codeseg->offsetmap[offset] != head; offset++);
+
+    /* Prologue: keep the state of the region in callee saved registers */
+    emit_push(&e, RBP);
+    emit_push(&e, RBX);
+    emit_push(&e, R12);
+    emit_push(&e, R13);
+    emit_push(&e, R14);
+    emit_push(&e, R15);
+    emit_ri(&e, 5, RSP, 8);
+    emit_rr(&e, 0x89, RDI, R12);
+    emit_rr(&e, 0x89, RSI, R15);
+    emit_rr(&e, 0x89, RDX, RBX);
+    emit_rr(&e, 0x89, RCX, R14);
+    emit_rr(&e, 0x89, R8, RBP);
+    emit_mem(&e, 1, 0x8B, R13, R14, 0);
+    loop = e.size;
+
+    for (i = head; i < codeseg->length && i - head < JIT_REGION_MAX; i++)
+    {
+        /*
+         * Superinstructions are compiled one instruction at a time, and forms
+         * with a destination register or an immediate like their aritreg form
+         */
+        Instruction unfused = codeseg->instr[i];
+        const Instruction *instr = &unfused;
+
+        unfused.opcode = OPC_BASE(OPC_HEAD(unfused.opcode));
+        if (!jit_compilable(instr))
+            break;
+
+        switch (instr->opcode)
+        {
+            case 0x00:
+                break;
+            case 0x02:  /* LOAD */
+                emit_rex(&e, 1, 0, RAX);
+                emit8(&e, 0xB8);
+                emit64(&e, ((const uint64_t *) &instr->data)[0]);
+                emit_mem(&e, 1, 0x89, RAX, RBX, REG(instr->reg[0]));
+                emit_rex(&e, 1, 0, RAX);
+                emit8(&e, 0xB8);
+                emit64(&e, ((const uint64_t *) &instr->data)[1]);
+                emit_mem(&e, 1, 0x89, RAX, RBX, REG(instr->reg[0]) + 8);
+                break;
+            case 0x03:  /* MOVE, in halves the stores before it can forward */
+                emit_mem(&e, 1, 0x8B, RAX, RBX, REG(instr->reg[0]));
+                emit_mem(&e, 1, 0x8B, RCX, RBX, VAL(instr->reg[0]));
+                emit_mem(&e, 1, 0x89, RAX, RBX, REG(instr->reg[1]));
+                emit_mem(&e, 1, 0x89, RCX, RBX, VAL(instr->reg[1]));
+                break;
+            case 0x12: case 0x13: case 0x14:
+                emit_jump_to(&e, instr, i, head, offset, loop);
+                break;
+            case 0x51 ... 0x5C:
+                emit_branch(&e, instr, i, head, loop);
+                break;
+            case 0x15: case 0x16: case 0x17:
+                if (jit_inlinable(instr))
+                    emit_arithmetic(&e, instr, i);
+                else
+                    emit_call(&e, instr, i);
+                break;
+            case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25:
+                if (jit_inlinable(instr))
+                    emit_relational(&e, instr, i);
+                else
+                    emit_call(&e, instr, i);
+                break;
+            default:
+                emit_call(&e, instr, i);
+                break;
+        }
+
+        /* Nothing after an unconditional jump is reached from here */
+        if (instr->opcode == 0x12)
+        {
+            closed = true;
+            break;
+        }
+    }
+
+    if (i == head)
+    {
+        free(e.code);
+        free(e.exits);
+        return 1;
+    }
+    if (!closed)
+        emit_exit(&e, -1, i, i - head);
+
+    /* Exits: account for the instructions retired since the start and leave */
+    out = 0;
+    for (size_t n = 0; n < e.exit_num; n++)
+    {
+        patch(&e, e.exits[n].at, e.size);
+        if (e.exits[n].retired)
+            emit_ri(&e, 0, R13, e.exits[n].retired);
+        emit8(&e, 0xB8);
+        emit32(&e, e.exits[n].index);
+        if (out)
+            patch(&e, emit_jump(&e, -1), out);
+        else
+        {
+            out = e.size;
+            emit_mem(&e, 1, 0x89, R13, R14, 0);
+            emit_ri(&e, 0, RSP, 8);
+            emit_pop(&e, R15);
+            emit_pop(&e, R14);
+            emit_pop(&e, R13);
+            emit_pop(&e, R12);
+            emit_pop(&e, RBX);
+            emit_pop(&e, RBP);
+            emit8(&e, 0xC3);
+        }
+    }
+    free(e.exits);
+
+    /* Regions never share a page, so one is never writable while it runs */
+    pagesize = sysconf(_SC_PAGESIZE);
+    size = (e.size + pagesize - 1) / pagesize * pagesize;
+    if (jit->used + size > jit->capacity)
+    {
+        free(e.code);
+        return 1;
+    }
+
+    uint8_t *region = jit->arena + jit->used;
+    if (mprotect(region, size, PROT_READ | PROT_WRITE) != 0)
+        pvm_reporterror(JIT_H, __FUNCTION__, "Cannot write to the arena");
+    memcpy(region, e.code, e.size);
+    if (mprotect(region, size, PROT_READ | PROT_EXEC) != 0)
+        pvm_reporterror(JIT_H, __FUNCTION__, "Cannot execute the arena");
+    free(e.code);
+
+    jit->used += size;
+    __atomic_store_n(&jit->entry[head], (JitEntry) (uintptr_t) region, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+int jit_initialise(Jit *jit)
+{
+    memset(jit, 0, sizeof(Jit));
+    jit->threshold = JIT_THRESHOLD;
+    jit->lock = (pthread_mutex_t) PTHREAD_MUTEX_INITIALIZER;
+
+    return 0;
+}
+
+int jit_enable(VM *vm)
+{
+#if defined(__x86_64__)
+    Jit *jit = &vm->jit;
+    size_t length = vm->codeseg.length + 1;
+
+    jit->hotness = calloc(length, sizeof(uint32_t));
+    jit->entry = calloc(length, sizeof(JitEntry));
+    if (jit->hotness == NULL || jit->entry == NULL)
+        return pvm_reporterror(JIT_H, __FUNCTION__, "Out of memory");
+
+    /* Reserved only, pages are made writable as regions are copied in */
+    jit->arena = mmap(NULL, JIT_ARENA_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->arena == MAP_FAILED)
+        return pvm_reporterror(JIT_H, __FUNCTION__, "Cannot map the arena");
+    jit->capacity = JIT_ARENA_SIZE;
+    jit->used = 0;
+    jit->enabled = true;
+
+    return 0;
+#else
+    return pvm_reporterror(JIT_H, __FUNCTION__, "JIT is only supported on x86-64");
+#endif
+}
+
+int jit_finalise(Jit *jit)
+{
+    if (jit->arena != NULL)
+        munmap(jit->arena, jit->capacity);
+    free(jit->hotness);
+    free(jit->entry);
+    jit->enabled = false;
+
+    return 0;
+}
+
+va_t jit_run(VM *vm, va_t tid, va_t index, vmclock_t *retired)
+{
+    Jit *jit = &vm->jit;
+    JitEntry entry = __atomic_load_n(&jit->entry[index], __ATOMIC_ACQUIRE);
+
+    if (entry == NULL)
+    {
+        if (__atomic_load_n(&jit->hotness[index], __ATOMIC_RELAXED) == JIT_NEVER ||
+            __atomic_add_fetch(&jit->hotness[index], 1, __ATOMIC_RELAXED) < jit->threshold)
+            return index;
+
+        /* Another worker may have compiled it, or given up, in the meantime */
+        pthread_mutex_lock(&jit->lock);
+        if (jit->entry[index] == NULL && jit->hotness[index] != JIT_NEVER && jit_compile(vm, index) != 0)
+            __atomic_store_n(&jit->hotness[index], JIT_NEVER, __ATOMIC_RELAXED);
+        entry = jit->entry[index];
+        pthread_mutex_unlock(&jit->lock);
+        if (entry == NULL)
+            return index;
+    }
+
+    /* Other threads get their turn once the quantum is used up */
+    return entry(vm, tid, vm->core.thread_pool[tid].controlunit.regfile, retired,
+                 __atomic_load_n(&vm->core.thread_num, __ATOMIC_RELAXED) > 1 || vm->core.worker_num > 1 ?
+                 vm->core.scheduler.quantum : (vmclock_t) -1);
+}
@@ -4,22 +4,65 @@
 static struct option long_opts[] =
 {
     {"execute", required_argument, NULL, 'e'},
+    {"compact", required_argument, NULL, 'c'},
+    {"jit",     no_argument,       NULL, 'j'},
+    {"profile", no_argument,       NULL, 'p'},
+    {"quantum", required_argument, NULL, 'q'},
+    {"workers", required_argument, NULL, 'w'},
+    {"stack",   required_argument, NULL, 's'},
     {"version", no_argument,       NULL, 'v'},
-    {"help",    no_argument,       NULL, 'h'}
+    {"help",    no_argument,       NULL, 'h'},
+    {0, 0, 0, 0}
 };
 
 int main(int argc, char *argv[])
 {
     int opt;
     int retcode = 0;
+    char *path = NULL;
+    char *end;
+    Options options = {0};
     extern char *optarg;
 
-    while ((opt = getopt_long(argc, argv, "e:vh", long_opts, NULL)) != -1)
+    while ((opt = getopt_long(argc, argv, "e:c:jpq:w:s:vh", long_opts, NULL)) != -1)
     {
         switch (opt)
         {
             case 'e':
-                retcode = opt_execute(optarg);
+                path = optarg;
+                break;
+            case 'c':
+                options.compact = optarg;
+                break;
+            case 'j':
+                options.jit = true;
+                break;
+            case 'p':
+                options.profile = true;
+                break;
+            case 'q':
+                options.quantum = strtoul(optarg, &end, 0);
+                if (*end != '\0' || options.quantum == 0)
+                {
+                    printf("pvm: invalid quantum %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                options.workers = strtoul(optarg, &end, 0);
+                if (*end != '\0' || options.workers == 0 || options.workers > WORKER_LIMIT)
+                {
+                    printf("pvm: invalid number of workers %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 's':
+                options.stack = strtoul(optarg, &end, 0);
+                if (*end != '\0' || options.stack == 0)
+                {
+                    printf("pvm: invalid stack size %s\n", optarg);
+                    return 1;
+                }
                 break;
             case 'v':
                 retcode = opt_version();
@@ -29,9 +72,14 @@ int main(int argc, char *argv[])
                 break;
         }
     }
-    if (optind == 1 && argc == 2)
-        retcode = opt_execute(argv[1]);
-    if (optind == 1)
+    /* Options only configure the run, the file may follow them */
+    if (path == NULL && optind == argc - 1)
+        path = argv[optind];
+    if (path != NULL && options.compact != NULL)
+        retcode = opt_compact(path, options.compact);
+    else if (path != NULL)
+        retcode = opt_execute(path, &options);
+    else if (optind == 1)
         printf("pvm: no options specified\n");
 
     return retcode;
@@ -17,113 +17,227 @@
 #include <float.h>
 #include <sys/syscall.h>
 
-PrimitiveData *fetch_reg(VM *, va_t);
-uint8_t fetch_code(VM *, va_t);
+const Instruction *fetch_instr(VM *, va_t);
+PrimitiveData *fetch_reg(VM *, va_t, uint8_t);
+const PrimitiveData *fetch_operand(VM *, va_t, const Instruction *);
+va_t fetch_element(VM *, va_t, va_t, va_t, uint8_t);
+void lock_memory(VM *, bool);
+void unlock_memory(VM *);
+static PrimitiveData *fetch_static(VM *, va_t, va_t, va_t, uint8_t);
+static opcode_t atomic_slot(VM *, va_t, bool, opcode_t);
+static PrimitiveData *fetch_frame(VM *, va_t, va_t, int64_t);
+static void load_element(const HeapFrame *, va_t, PrimitiveData *);
+static void store_element(HeapFrame *, va_t, const PrimitiveData *);
+static PrimitiveData *fetch_flat(VM *, va_t, uint8_t);
 
-/*
- * OPCODE FUNCTION PROTOTYPES
- */
+InstructionSet opc_Execute[256] =
+{
+    /* 0x00 */  NOP,
 
-opcode_t NOP(VM *, va_t);
-opcode_t HLT(VM *, va_t);
+    /* 0x01 */  HLT,
 
-/* REGISTER MANIPULATION */
-opcode_t LOAD(VM *, va_t);
-opcode_t MOVE(VM *, va_t);
-opcode_t CAST(VM *, va_t);
-/* END LOAD */
+    /* 0x02 */  LOAD, MOVE, CAST,
 
-/* STACK INSTRUCTIONS */
-opcode_t PUSH(VM *, va_t);
-opcode_t POP(VM *, va_t);
-opcode_t PUT(VM *, va_t);
-opcode_t PEEK(VM *, va_t);
-/* END STUCK INSTRUCTIONS */
-
-/* HEAP INSTRUCTIONS */
-opcode_t MALLOC(VM *, va_t);
-opcode_t CALLOC(VM *, va_t);
-opcode_t REALLOC(VM *, va_t);
-opcode_t FREE(VM *, va_t);
-opcode_t STORE(VM *, va_t);
-opcode_t GET(VM *, va_t);
-/* END HEAP INSTRUCTIONS */
+    /* 0x05 */  PUSH, POP, PUT, PEEK,
 
-/* STATIC SEGMENT INSTRUCTIONS */
-opcode_t ALLOC_STATIC(VM *, va_t);
-opcode_t STORE_STATIC(VM *, va_t);
-opcode_t GET_STATIC(VM *, va_t);
-/* END STATIC SEGMENT INSTRUCTIONS */
-
-/* FLOW INSTRUCTIONS */
-opcode_t JUMP(VM *, va_t);
-opcode_t JUMP_IF_TRUE(VM *, va_t);
-opcode_t JUMP_IF_FALSE(VM *, va_t);
-opcode_t RETURN(VM *, va_t);
-/* END FLOW INSTRUCTIONS */
+    /* 0x09 */  MALLOC, CALLOC, REALLOC, FREE, STORE, GET,
 
-/* ARITHMETIC & BITWISE OPERATIONS */
-opcode_t ADD(VM *, va_t);
-opcode_t SUB(VM *, va_t);
-opcode_t MUL(VM *, va_t);
-opcode_t DIV(VM *, va_t);
-opcode_t MOD(VM *, va_t);
-opcode_t AND(VM *, va_t);
-opcode_t XOR(VM *, va_t);
-opcode_t OR(VM *, va_t);
-opcode_t NOT(VM *, va_t);
-opcode_t LSHIFT(VM *, va_t);
-opcode_t RSHIFT(VM *, va_t);
-/* END ARITHMETIC & BITWISE OPERATIONS */
+    /* 0x0F */  ALLOC_STATIC, STORE_STATIC, GET_STATIC,
 
-/* RELATIONAL & LOGICAL OPERATIONS */
-opcode_t LESS(VM *, va_t);
-opcode_t LESS_EQ(VM *, va_t);
-opcode_t GREAT(VM *, va_t);
-opcode_t GREAT_EQ(VM *, va_t);
-opcode_t EQUAL(VM *, va_t);
-opcode_t N_EQUAL(VM *, va_t);
-opcode_t LOG_AND(VM *, va_t);
-opcode_t LOG_OR(VM *, va_t);
-opcode_t LOG_NOT(VM *, va_t);
-/* END RELATIONAL & LOGICAL OPERATIONS */
+    /* 0x12 */  JUMP, JUMP_IF_TRUE, JUMP_IF_FALSE,
 
-/* SCHEDULER INSTRUCTION */
-opcode_t STAMP(VM *, va_t);
-/* END SCHEDULER INSTRUCTION */
+    /* 0x15 */  ADD, SUB, MUL, DIV, MOD, AND, XOR, OR, NOT, LSHIFT, RSHIFT,
+
+    /* 0x20 */  LESS, LESS_EQ, GREAT, GREAT_EQ, EQUAL, N_EQUAL, LOG_AND, LOG_OR, LOG_NOT,
+
+    /* 0x29 */  STAMP,
+
+    /* 0x2A */  ADD, SUB, MUL, DIV, MOD, AND, XOR, OR, NOT, LSHIFT, RSHIFT,
+
+    /* 0x35 */  LESS, LESS_EQ, GREAT, GREAT_EQ, EQUAL, N_EQUAL, LOG_AND, LOG_OR, LOG_NOT,
+
+    /* 0x3E */  ADD, SUB, MUL, DIV, MOD, AND, XOR, OR, NULL, LSHIFT, RSHIFT,
+
+    /* 0x49 */  LESS, LESS_EQ, GREAT, GREAT_EQ, EQUAL, N_EQUAL,
+
+    /* 0x4F */  STOREI, GETI,
+
+    /* 0x51 */  BLT, BLE, BGT, BGE, BEQ, BNE,
+
+    /* 0x57 */  BLT, BLE, BGT, BGE, BEQ, BNE,
+
+    /* 0x5D */  SWITCH,
+
+    /* 0x5E */  SPAWN, JOIN, YIELD, SELF, PARFOR,
+
+    /* 0x63 */  MUTEX_LOCK, MUTEX_UNLOCK, COND_WAIT, COND_SIGNAL, COND_BROADCAST, BARRIER, SLEEP_NS,
+
+    /* 0x6A */  ATOMIC_LOAD, ATOMIC_STORE, ATOMIC_XCHG, ATOMIC_FETCH_ADD, ATOMIC_CAS,
+
+    /* 0x6F */  ATOMIC_LOAD_STATIC, ATOMIC_STORE_STATIC, ATOMIC_XCHG_STATIC, ATOMIC_FETCH_ADD_STATIC,
+                ATOMIC_CAS_STATIC,
+
+    /* 0x74 */  CHAN_NEW, CHAN_SEND, CHAN_RECV, CHAN_TRY_SEND, CHAN_TRY_RECV, CHAN_SEND_N, CHAN_RECV_N,
+
+    /* 0x7B */  SPAWN_STACK,
+
+    /* 0x7C */  MALLOC_TYPED,
+
+    /* 0x7D */  FLAT_MALLOC, FLAT_FREE, FLAT_STORE, FLAT_GET,
+
+    /* 0x81 */  MALLOC_HANDLE, FREE_HANDLE, STORE_HANDLE, GET_HANDLE
+};
 
 /*
- * END OPCODE FUNCTION PROTOTYPES
+ * Operand layout of every opcode, read by csg_decode when the bytecode is
+ * loaded. Each character is one operand, in the order they are encoded:
+ *
+ *  R : REGISTER_ADDRESS (1 byte)
+ *  T : TYPE (1 byte)
+ *  L : TYPE (1 byte) followed by RAW_DATA of that type (big endian)
+ *  A : an address or size (8 bytes, big endian)
+ *  D : REGISTER_ADDRESS the result is written to (1 byte), aritreg if absent
+ *  I : a literal like L, in place of the second REGISTER_ADDRESS
+ *  J : a signed displacement from the start of the instruction (4 bytes, big
+ *      endian), checked to land on an instruction when the code is loaded
+ *  S : a jump table, the number of entries (4 bytes, big endian) followed by
+ *      the default target and the target of every entry, each like J
+ *
+ * Opcodes without a layout are illegal.
  */
+const char *opc_Format[256] =
+{
+    /* 0x00 */  "",
 
-InstructionSet opc_Execute[256] =
+    /* 0x01 */  "",
+
+    /* 0x02 */  "RL", "RR", "RT",
+
+    /* 0x05 */  "R", "", "AR", "AR",
+
+    /* 0x09 */  "AA", "AA", "AA", "A", "AAR", "AAR",
+
+    /* 0x0F */  "AA", "AAR", "AAR",
+
+    /* 0x12 */  "R", "R", "R",
+
+    /* 0x15 */  "RR", "RR", "RR", "RR", "RR", "RR", "RR", "RR", "R", "RR", "RR",
+
+    /* 0x20 */  "RR", "RR", "RR", "RR", "RR", "RR", "RR", "RR", "R",
+
+    /* 0x29 */  "R",
+
+    /* 0x2A */  "RRD", "RRD", "RRD", "RRD", "RRD", "RRD", "RRD", "RRD", "RD", "RRD", "RRD",
+
+    /* 0x35 */  "RRD", "RRD", "RRD", "RRD", "RRD", "RRD", "RRD", "RRD", "RD",
+
+    /* 0x3E */  "RID", "RID", "RID", "RID", "RID", "RID", "RID", "RID", NULL, "RID", "RID",
+
+    /* 0x49 */  "RID", "RID", "RID", "RID", "RID", "RID",
+
+    /* 0x4F */  "AARR", "AARR",
+
+    /* 0x51 */  "RRJ", "RRJ", "RRJ", "RRJ", "RRJ", "RRJ",
+
+    /* 0x57 */  "RIJ", "RIJ", "RIJ", "RIJ", "RIJ", "RIJ",
+
+    /* 0x5D */  "RS",
+
+    /* 0x5E */  "DJ", "RRD", "", "D", "RRRJ",
+
+    /* 0x63 */  "R", "R", "RR", "R", "R", "RR", "R",
+
+    /* 0x6A */  "AARR", "AARR", "AARRD", "AARRD", "AARRR",
+
+    /* 0x6F */  "AARR", "AARR", "AARRD", "AARRD", "AARRR",
+
+    /* 0x74 */  "RRD", "RR", "RD", "RR", "RD", "AARRD", "AARRD",
+
+    /* 0x7B */  "R",
+
+    /* 0x7C */  "AAT",
+
+    /* 0x7D */  "RD", "R", "RR", "RD",
+
+    /* 0x81 */  "RD", "R", "RRR", "RRD"
+};
+
+const char *opc_Name[256] =
 {
-    /* 0x00 */  NOP,
+    /* 0x00 */  "NOP",
 
-    /* 0x01 */  HLT,
+    /* 0x01 */  "HLT",
 
-    /* 0x02 */  LOAD, MOVE, CAST,
+    /* 0x02 */  "LOAD", "MOVE", "CAST",
 
-    /* 0x05 */  PUSH, POP, PUT, PEEK,
+    /* 0x05 */  "PUSH", "POP", "PUT", "PEEK",
 
-    /* 0x09 */  MALLOC, CALLOC, REALLOC, FREE, STORE, GET,
+    /* 0x09 */  "MALLOC", "CALLOC", "REALLOC", "FREE", "STORE", "GET",
 
-    /* 0x0F */  ALLOC_STATIC, STORE_STATIC, GET_STATIC,
+    /* 0x0F */  "ALLOC_STATIC", "STORE_STATIC", "GET_STATIC",
 
-    /* 0x12 */  JUMP, JUMP_IF_TRUE, JUMP_IF_FALSE,
+    /* 0x12 */  "JUMP", "JUMP_IF_TRUE", "JUMP_IF_FALSE",
 
-    /* 0x15 */  ADD, SUB, MUL, DIV, MOD, AND, XOR, OR, NOT, LSHIFT, RSHIFT,
+    /* 0x15 */  "ADD", "SUB", "MUL", "DIV", "MOD", "AND", "XOR", "OR", "NOT", "LSHIFT", "RSHIFT",
 
-    /* 0x20 */  LESS, LESS_EQ, GREAT, GREAT_EQ, EQUAL, N_EQUAL, LOG_AND, LOG_OR, LOG_NOT,
+    /* 0x20 */  "LESS", "LESS_EQ", "GREAT", "GREAT_EQ", "EQUAL", "N_EQUAL", "LOG_AND", "LOG_OR", "LOG_NOT",
+
+    /* 0x29 */  "STAMP",
+
+    /* 0x2A */  "ADD3", "SUB3", "MUL3", "DIV3", "MOD3", "AND3", "XOR3", "OR3", "NOT2", "LSHIFT3", "RSHIFT3",
+
+    /* 0x35 */  "LESS3", "LESS_EQ3", "GREAT3", "GREAT_EQ3", "EQUAL3", "N_EQUAL3", "LOG_AND3", "LOG_OR3", "LOG_NOT2",
 
-    /* 0x28 */  STAMP
+    /* 0x3E */  "ADDI", "SUBI", "MULI", "DIVI", "MODI", "ANDI", "XORI", "ORI", NULL, "LSHIFTI", "RSHIFTI",
+
+    /* 0x49 */  "LESSI", "LESS_EQI", "GREATI", "GREAT_EQI", "EQUALI", "N_EQUALI",
+
+    /* 0x4F */  "STOREI", "GETI",
+
+    /* 0x51 */  "BLT", "BLE", "BGT", "BGE", "BEQ", "BNE",
+
+    /* 0x57 */  "BLTI", "BLEI", "BGTI", "BGEI", "BEQI", "BNEI",
+
+    /* 0x5D */  "SWITCH",
+
+    /* 0x5E */  "SPAWN", "JOIN", "YIELD", "SELF", "PARFOR",
+
+    /* 0x63 */  "MUTEX_LOCK", "MUTEX_UNLOCK", "COND_WAIT", "COND_SIGNAL", "COND_BROADCAST", "BARRIER", "SLEEP_NS",
+
+    /* 0x6A */  "ATOMIC_LOAD", "ATOMIC_STORE", "ATOMIC_XCHG", "ATOMIC_FETCH_ADD", "ATOMIC_CAS",
+
+    /* 0x6F */  "ATOMIC_LOAD_STATIC", "ATOMIC_STORE_STATIC", "ATOMIC_XCHG_STATIC", "ATOMIC_FETCH_ADD_STATIC",
+                "ATOMIC_CAS_STATIC",
+
+    /* 0x74 */  "CHAN_NEW", "CHAN_SEND", "CHAN_RECV", "CHAN_TRY_SEND", "CHAN_TRY_RECV", "CHAN_SEND_N", "CHAN_RECV_N",
+
+    /* 0x7B */  "SPAWN_STACK",
+
+    /* 0x7C */  "MALLOC_TYPED",
+
+    /* 0x7D */  "FLAT_MALLOC", "FLAT_FREE", "FLAT_STORE", "FLAT_GET",
+
+    /* 0x81 */  "MALLOC_HANDLE", "FREE_HANDLE", "STORE_HANDLE", "GET_HANDLE"
 };
 
-#define fetch_code_2BYTES(vm, tid) ((fetch_code(vm, tid) << 8) | fetch_code(vm, tid))
+/*
+ * The sequences fused into superinstructions, tuned with pvm --profile. The
+ * order has to match the superinstruction labels in thr_run.
+ */
+const Fusion opc_Fusion[256 - OPC_FUSED] =
+{
+    /* 0xF0 */  {{0x20, 0x13}, 2}, {{0x21, 0x13}, 2}, {{0x22, 0x13}, 2},
+                {{0x23, 0x13}, 2}, {{0x24, 0x13}, 2}, {{0x25, 0x13}, 2},
+
+    /* 0xF6 */  {{0x20, 0x14}, 2}, {{0x21, 0x14}, 2}, {{0x22, 0x14}, 2},
+                {{0x23, 0x14}, 2}, {{0x24, 0x14}, 2}, {{0x25, 0x14}, 2},
 
-#define fetch_code_4BYTES(vm, tid) ((fetch_code_2BYTES(vm, tid) << 16) | fetch_code_2BYTES(vm, tid))
+    /* 0xFC */  {{0x15, 0x03}, 2}, {{0x16, 0x03}, 2},
 
-#define fetch_code_8BYTES(vm, tid) (((uint64_t) fetch_code_4BYTES(vm, tid) << 32) | fetch_code_4BYTES(vm, tid))
+    /* 0xFE */  {{0x02, 0x15}, 2},
+
+    /* 0xFF */  {{0x0E, 0x15, 0x0D}, 3}
+};
 
 opcode_t NOP(VM *vm, va_t tid)
 {
@@ -132,36 +246,12 @@ opcode_t NOP(VM *vm, va_t tid)
 
 opcode_t HLT(VM *vm, va_t tid)
 {
-    thr_kill(vm, tid);
+    /* A thread of a PARFOR goes on with the next chunk left instead */
+    if (!thr_nextchunk(vm, tid))
+        thr_kill(vm, tid);
     return vm->core.thread_pool[tid].controlunit.instrreg;
 }
 
-#define DATA_RETRIEVER(data)\
-(\
-    (data).storage == I8 ? (data).i8 :\
-    ((data).storage == I16 ? (data).i16 :\
-    ((data).storage == I32 ? (data).i32 :\
-    ((data).storage == I64 ? (data).i64 :\
-    ((data).storage == UI8 ? (data).ui8 :\
-    ((data).storage == UI16 ? (data).ui16 :\
-    ((data).storage == UI32 ? (data).ui32 :\
-    ((data).storage == UI64 ? (data).ui64 :\
-    ((data).storage == DBL ? (data).dbl :\
-    ((data).va)))))))))\
-)
-
-#define DATA_RETRIEVER_INT(data)\
-(\
-    (data).storage == I8 ? (data).i8 :\
-    ((data).storage == I16 ? (data).i16 :\
-    ((data).storage == I32 ? (data).i32 :\
-    ((data).storage == I64 ? (data).i64 :\
-    ((data).storage == UI8 ? (data).ui8 :\
-    ((data).storage == UI16 ? (data).ui16 :\
-    ((data).storage == UI32 ? (data).ui32 :\
-    (data).ui64))))))\
-)
-
 /*
  * REGISTER MANIPULATION
  */
@@ -169,61 +259,14 @@ opcode_t HLT(VM *vm, va_t tid)
 opcode_t LOAD(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg, prot;
-    opcode_t type;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg;
 
     /* Fetch REGISTER_ADDRESS */
-    reg = fetch_reg(vm, tid);
-
-    /* Fetch TYPE */
-    type = fetch_code(vm, tid);
-
-    /* Fetch RAW_DATA */
-    switch (type)
-    {
-        case 0:
-            prot.storage = I8;
-            prot.i8 = fetch_code(vm, tid);
-            break;
-        case 1:
-            prot.storage = UI8;
-            prot.ui8 = fetch_code(vm, tid);
-            break;
-        case 2:
-            prot.storage = I16;
-            prot.i16 = fetch_code_2BYTES(vm, tid);
-            break;
-        case 3:
-            prot.storage = UI16;
-            prot.ui16 = fetch_code_2BYTES(vm, tid);
-            break;
-        case 4:
-            prot.storage = I32;
-            prot.i32 = fetch_code_4BYTES(vm, tid);
-            break;
-        case 5:
-            prot.storage = UI32;
-            prot.ui32 = fetch_code_4BYTES(vm, tid);
-            break;
-        case 6:
-            prot.storage = I64;
-            prot.i64 = fetch_code_8BYTES(vm, tid);
-            break;
-        case 7:
-            prot.storage = UI64;
-            prot.ui64 = fetch_code_8BYTES(vm, tid);
-            break;
-        case 8:
-            prot.storage = DBL;
-            prot.dbl = fetch_code_8BYTES(vm, tid);
-            break;
-        case 9:
-            prot.storage = VA;
-            prot.va = fetch_code_8BYTES(vm, tid);
-            break;
-    }
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
-    *reg = prot;
+    /* TYPE and RAW_DATA were already turned into a PrimitiveData */
+    *reg = instr->data;
 
     return thread->controlunit.instrreg;
 }
@@ -231,13 +274,14 @@ opcode_t LOAD(VM *vm, va_t tid)
 opcode_t MOVE(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *src, *dest;
 
     /* Fetch source register address */
-    src = fetch_reg(vm, tid);
+    src = fetch_reg(vm, tid, instr->reg[0]);
 
     /* Fetch destination register address */
-    dest = fetch_reg(vm, tid);
+    dest = fetch_reg(vm, tid, instr->reg[1]);
 
     /* Copy src to dest */
     memcpy(dest, src, sizeof(*dest));
@@ -248,14 +292,15 @@ opcode_t MOVE(VM *vm, va_t tid)
 opcode_t CAST(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg, new;
     opcode_t type;
 
     /* Fetch REGISTER_ADDRESS */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
     /* Fetch TYPE */
-    type = fetch_code(vm, tid);
+    type = instr->type;
 
     switch (type)
     {
@@ -315,9 +360,10 @@ opcode_t CAST(VM *vm, va_t tid)
 opcode_t PUSH(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *data;
 
-    data = fetch_reg(vm, tid); /* fetch DATA to be pushed to stack */
+    data = fetch_reg(vm, tid, instr->reg[0]); /* fetch DATA to be pushed to stack */
     stk_push(&thread->stack, *data);
 
     return thread->controlunit.instrreg;
@@ -335,14 +381,15 @@ opcode_t POP(VM *vm, va_t tid)
 opcode_t PUT(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t stack_va;
     PrimitiveData *reg;
 
-    /* Fetch STACK_ADDRESS (8 bytes) */
-    stack_va = fetch_code_8BYTES(vm, tid);
+    /* Fetch STACK_ADDRESS */
+    stack_va = instr->imm[0];
 
     /* Fetch register */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
     /* Put data in register into stack of the given address */
     thread->stack.primdata_arr[stack_va] = *reg;
@@ -353,14 +400,15 @@ opcode_t PUT(VM *vm, va_t tid)
 opcode_t PEEK(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t stack_va;
     PrimitiveData *reg;
 
-    /* Fetch STACK_ADDRESS (8 bytes) */
-    stack_va = fetch_code_8BYTES(vm, tid);
+    /* Fetch STACK_ADDRESS */
+    stack_va = instr->imm[0];
 
     /* Fetch register */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
     /* Get data from stack to register */
     *reg = thread->stack.primdata_arr[stack_va];
@@ -376,17 +424,20 @@ opcode_t PEEK(VM *vm, va_t tid)
 opcode_t MALLOC(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t heap_va;
     size_t size;
 
-    /* Fetch HEAP_ADDRESS (8 bytes) */
-    heap_va = fetch_code_8BYTES(vm, tid);
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
 
-    /* Fetch SIZE (8 bytes) */
-    size = fetch_code_8BYTES(vm, tid);
+    /* Fetch SIZE */
+    size = instr->imm[1];
 
+    lock_memory(vm, true);
     /* Malloc VM heap at address heap_va  */
-    heap_malloc(&vm->heap, heap_va, size);
+    heap_malloc(&vm->heap, &thread->heapcache, heap_va, size);
+    unlock_memory(vm);
 
     return thread->controlunit.instrreg;
 }
@@ -394,17 +445,20 @@ opcode_t MALLOC(VM *vm, va_t tid)
 opcode_t CALLOC(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t heap_va;
     size_t size;
 
-    /* Fetch HEAP_ADDRESS (8 bytes) */
-    heap_va = fetch_code_8BYTES(vm, tid);
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
 
-    /* Fetch SIZE (8 bytes) */
-    size = fetch_code_8BYTES(vm, tid);
+    /* Fetch SIZE */
+    size = instr->imm[1];
 
+    lock_memory(vm, true);
     /* Calloc VM heap at address heap_va  */
-    heap_calloc(&vm->heap, heap_va, size);
+    heap_calloc(&vm->heap, &thread->heapcache, heap_va, size);
+    unlock_memory(vm);
 
     return thread->controlunit.instrreg;
 }
@@ -412,17 +466,20 @@ opcode_t CALLOC(VM *vm, va_t tid)
 opcode_t REALLOC(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t heap_va;
     size_t size;
 
-    /* Fetch HEAP_ADDRESS (8 bytes) */
-    heap_va = fetch_code_8BYTES(vm, tid);
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
 
-    /* Fetch SIZE (8 bytes) */
-    size = fetch_code_8BYTES(vm, tid);
+    /* Fetch SIZE */
+    size = instr->imm[1];
 
+    lock_memory(vm, true);
     /* Malloc VM heap at address heap_va */
-    heap_realloc(&vm->heap, heap_va, size);
+    heap_realloc(&vm->heap, &thread->heapcache, heap_va, size);
+    unlock_memory(vm);
 
     return thread->controlunit.instrreg;
 }
@@ -430,13 +487,16 @@ opcode_t REALLOC(VM *vm, va_t tid)
 opcode_t FREE(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t heap_va;
 
-    /* Fetch HEAP_ADDRESS (8 bytes) */
-    heap_va = fetch_code_8BYTES(vm, tid);
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
 
+    lock_memory(vm, true);
     /* Free VM heap at address heap_va */
-    heap_free(&vm->heap, heap_va);
+    heap_free(&vm->heap, &thread->heapcache, heap_va);
+    unlock_memory(vm);
 
     return thread->controlunit.instrreg;
 }
@@ -444,20 +504,23 @@ opcode_t FREE(VM *vm, va_t tid)
 opcode_t STORE(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t heap_va, offset;
     PrimitiveData *reg;
 
-    /* Fetch HEAP_ADDRESS (8 bytes) */
-    heap_va = fetch_code_8BYTES(vm, tid);
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
 
-    /* Fetch OFFSET_ADDRESS (8 bytes) */
-    offset = fetch_code_8BYTES(vm, tid);
+    /* Fetch OFFSET_ADDRESS */
+    offset = instr->imm[1];
 
     /* Fetch register */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
+    lock_memory(vm, false);
     /* Store data in given register to the address at heap */
-    vm->heap.var_pool[heap_va].block[offset] = *reg;
+    store_element(&vm->heap.var_pool[heap_va], offset, reg);
+    unlock_memory(vm);
 
     return thread->controlunit.instrreg;
 }
@@ -465,19 +528,22 @@ opcode_t STORE(VM *vm, va_t tid)
 opcode_t GET(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t heap_va, offset;
     PrimitiveData *reg, prot;
 
-    /* Fetch HEAP_ADDRESS (8 bytes) */
-    heap_va = fetch_code_8BYTES(vm, tid);
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
 
-    /* Fetch OFFSET_ADDRESS (8 bytes) */
-    offset = fetch_code_8BYTES(vm, tid);
+    /* Fetch OFFSET_ADDRESS */
+    offset = instr->imm[1];
 
-    prot = vm->heap.var_pool[heap_va].block[offset];
+    lock_memory(vm, false);
+    load_element(&vm->heap.var_pool[heap_va], offset, &prot);
+    unlock_memory(vm);
 
     /* Fetch register */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
     /* Get data in heap of given address to register */
     *reg = prot;
@@ -485,6 +551,218 @@ opcode_t GET(VM *vm, va_t tid)
     return thread->controlunit.instrreg;
 }
 
+opcode_t STOREI(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t heap_va, offset;
+    PrimitiveData *reg;
+
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
+
+    lock_memory(vm, false);
+    /* Fetch OFFSET_ADDRESS, indexed by the value of INDEX_REGISTER */
+    offset = fetch_element(vm, tid, heap_va, instr->imm[1], instr->reg[1]);
+
+    /* Fetch register */
+    reg = fetch_reg(vm, tid, instr->reg[0]);
+
+    /* Store data in given register to the address at heap */
+    store_element(&vm->heap.var_pool[heap_va], offset, reg);
+    unlock_memory(vm);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t GETI(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t heap_va, offset;
+    PrimitiveData *reg;
+
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
+
+    lock_memory(vm, false);
+    /* Fetch OFFSET_ADDRESS, indexed by the value of INDEX_REGISTER */
+    offset = fetch_element(vm, tid, heap_va, instr->imm[1], instr->reg[1]);
+
+    /* Fetch register */
+    reg = fetch_reg(vm, tid, instr->reg[0]);
+
+    /* Get data in heap of given address to register */
+    load_element(&vm->heap.var_pool[heap_va], offset, reg);
+    unlock_memory(vm);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t MALLOC_TYPED(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t heap_va;
+    size_t size;
+    uint32_t type;
+
+    /* Fetch HEAP_ADDRESS */
+    heap_va = instr->imm[0];
+
+    /* Fetch SIZE */
+    size = instr->imm[1];
+
+    /* Fetch TYPE, numbered like for CAST */
+    type = 1u << instr->type;
+
+    lock_memory(vm, true);
+    /* Malloc a native array of the type at address heap_va */
+    heap_malloctyped(&vm->heap, &thread->heapcache, heap_va, size, type);
+    unlock_memory(vm);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t FLAT_MALLOC(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg, op_res;
+    int64_t size;
+
+    /* Fetch SIZE from a register */
+    reg = fetch_reg(vm, tid, instr->reg[0]);
+    size = DATA_RETRIEVER_INT(*reg);
+    if (size < 0)
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Block of a negative size");
+
+    /* The flat region has a lock of its own and never moves, so the heap is left unlocked */
+    op_res.storage = VA;
+    op_res.va = heap_flatmalloc(&vm->heap, size);
+
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t FLAT_FREE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+
+    /* Fetch the address of the block from a register */
+    heap_flatfree(&vm->heap, DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0])));
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t FLAT_STORE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+
+    /* Store the second register at the address in the first one */
+    *fetch_flat(vm, tid, instr->reg[0]) = *fetch_reg(vm, tid, instr->reg[1]);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t FLAT_GET(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+
+    /* Get the element at the address in the first register to the destination */
+    *fetch_reg(vm, tid, instr->reg[2]) = *fetch_flat(vm, tid, instr->reg[0]);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t MALLOC_HANDLE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData op_res;
+    int64_t size;
+
+    /* Fetch SIZE from a register */
+    size = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    if (size < 0)
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Frame of a negative size");
+
+    lock_memory(vm, true);
+    /* Malloc VM heap at an address of its choice */
+    op_res.storage = VA;
+    op_res.va = heap_mallochandle(&vm->heap, &thread->heapcache, size);
+    unlock_memory(vm);
+
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t FREE_HANDLE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t heap_va;
+
+    /* Fetch HEAP_ADDRESS from a register */
+    heap_va = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+
+    lock_memory(vm, true);
+    if (heap_va >= vm->heap.size)
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Target unallocated");
+    /* Free VM heap at address heap_va */
+    heap_free(&vm->heap, &thread->heapcache, heap_va);
+    unlock_memory(vm);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t STORE_HANDLE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t heap_va, offset;
+
+    /* Fetch HEAP_ADDRESS from the second register */
+    heap_va = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[1]));
+
+    lock_memory(vm, false);
+    /* Fetch OFFSET_ADDRESS from the last register */
+    offset = fetch_element(vm, tid, heap_va, 0, instr->reg[2]);
+
+    /* Store data in the first register to the address at heap */
+    store_element(&vm->heap.var_pool[heap_va], offset, fetch_reg(vm, tid, instr->reg[0]));
+    unlock_memory(vm);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t GET_HANDLE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t heap_va, offset;
+    PrimitiveData prot;
+
+    /* Fetch HEAP_ADDRESS from the first register */
+    heap_va = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+
+    lock_memory(vm, false);
+    /* Fetch OFFSET_ADDRESS from the second register */
+    offset = fetch_element(vm, tid, heap_va, 0, instr->reg[1]);
+    load_element(&vm->heap.var_pool[heap_va], offset, &prot);
+    unlock_memory(vm);
+
+    /* Get data in heap of given address to the destination register */
+    *fetch_reg(vm, tid, instr->reg[2]) = prot;
+
+    return thread->controlunit.instrreg;
+}
+
 /* END HEAP INSTRUCTIONS */
 
 /*
@@ -494,17 +772,20 @@ opcode_t GET(VM *vm, va_t tid)
 opcode_t ALLOC_STATIC(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t va;
     size_t size;
 
-    /* Fetch STATIC_ADDRESS (8 bytes) */
-    va = fetch_code_8BYTES(vm, tid);
+    /* Fetch STATIC_ADDRESS */
+    va = instr->imm[0];
 
-    /* Fetch SIZE (8 bytes) */
-    size = fetch_code_8BYTES(vm, tid);
+    /* Fetch SIZE */
+    size = instr->imm[1];
 
+    lock_memory(vm, true);
     /* Allocate in staticic segment */
     ssg_allocate(&vm->staticseg, va, size);
+    unlock_memory(vm);
 
     return thread->controlunit.instrreg;
 }
@@ -512,20 +793,23 @@ opcode_t ALLOC_STATIC(VM *vm, va_t tid)
 opcode_t STORE_STATIC(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t va, offset;
     PrimitiveData *reg;
 
-    /* Fetch STATIC_ADDRESS (8 bytes) */
-    va = fetch_code_8BYTES(vm, tid);
+    /* Fetch STATIC_ADDRESS */
+    va = instr->imm[0];
 
-    /* Fetch OFFSET_ADDRESS (8 bytes) */
-    offset = fetch_code_8BYTES(vm, tid);
+    /* Fetch OFFSET_ADDRESS */
+    offset = instr->imm[1];
 
     /* Fetch register */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
+    lock_memory(vm, false);
     /* Store data in given register to the address at static segment */
     vm->staticseg.var_pool[va].primdata_arr[offset] = *reg;
+    unlock_memory(vm);
 
     return thread->controlunit.instrreg;
 }
@@ -533,20 +817,23 @@ opcode_t STORE_STATIC(VM *vm, va_t tid)
 opcode_t GET_STATIC(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     va_t va, offset;
     PrimitiveData *reg;
 
-    /* Fetch STATIC_ADDRESS (8 bytes) */
-    va = fetch_code_8BYTES(vm, tid);
+    /* Fetch STATIC_ADDRESS */
+    va = instr->imm[0];
 
-    /* Fetch OFFSET_ADDRESS (8 bytes) */
-    offset = fetch_code_8BYTES(vm, tid);
+    /* Fetch OFFSET_ADDRESS */
+    offset = instr->imm[1];
 
     /* Fetch register */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
+    lock_memory(vm, false);
     /* Get static data in static segment of given address to register */
     *reg = vm->staticseg.var_pool[va].primdata_arr[offset];
+    unlock_memory(vm);
 
 
     return thread->controlunit.instrreg;
@@ -561,66 +848,196 @@ opcode_t GET_STATIC(VM *vm, va_t tid)
 opcode_t JUMP(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg;
     va_t index_address;
 
     /* Fetch CODESEG_INDEX from a register to which thread will jump to */
-    reg = fetch_reg(vm, tid);
-    index_address = DATA_RETRIEVER_INT(*reg);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
+    index_address = csg_locate(&vm->codeseg, DATA_RETRIEVER_INT(*reg));
 
-    /* Configure thread, jump to codeseg_INDEX */
-    thread->flag = THR_RUN;
-    thread->controlunit.progcountreg++;
-    thread->controlunit.instrreg = vm->codeseg.content[thread->controlunit.instrpointreg = index_address];
+    /* Jump to CODESEG_INDEX, the thread carries on from there */
+    thread->controlunit.instrpointreg = index_address;
 
-    /* End cycle early */
-    return core_cycle(vm, tid);
+    return thread->controlunit.instrreg;
 }
 
 opcode_t JUMP_IF_TRUE(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg;
     va_t index_address;
 
     /* Fetch CODESEG_INDEX from a register to which thread will jump to */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
     index_address = DATA_RETRIEVER_INT(*reg);
 
     if (DATA_RETRIEVER(thread->controlunit.aritreg) == 1)
-    {
-        /* Configure thread, jump to CODESEG_INDEX */
-        thread->flag = THR_RUN;
-        thread->controlunit.progcountreg++;
-        thread->controlunit.instrreg = vm->codeseg.content[thread->controlunit.instrpointreg = index_address];
-        return core_cycle(vm, tid);
-    }
+        thread->controlunit.instrpointreg = csg_locate(&vm->codeseg, index_address);
+
     return thread->controlunit.instrreg;
 }
 
 opcode_t JUMP_IF_FALSE(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg;
     va_t index_address;
 
     /* Fetch codeseg_INDEX from a register to which thread will jump to */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
     index_address = DATA_RETRIEVER_INT(*reg);
 
     if (DATA_RETRIEVER(thread->controlunit.aritreg) == 0)
-    {
-        /* Configure thread, jump to codeseg_INDEX */
-        thread->flag = THR_RUN;
-        thread->controlunit.progcountreg++;
-        thread->controlunit.instrreg = vm->codeseg.content[thread->controlunit.instrpointreg = index_address];
-        return core_cycle(vm, tid);
-    }
+        thread->controlunit.instrpointreg = csg_locate(&vm->codeseg, index_address);
+
     return thread->controlunit.instrreg;
 }
 
-/* END FLOW INSTRUCTIONS */
-
+opcode_t BLT(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0;
+    const PrimitiveData *reg1;
+
+    /* Fetch REGISTER_ADDRESS_0 */
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
+
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
+
+    /* Branch to the target that was resolved when the code was loaded */
+    if (DATA_RETRIEVER(*reg0) < DATA_RETRIEVER(*reg1))
+        thread->controlunit.instrpointreg = instr->target;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t BLE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0;
+    const PrimitiveData *reg1;
+
+    /* Fetch REGISTER_ADDRESS_0 */
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
+
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
+
+    /* Branch to the target that was resolved when the code was loaded */
+    if (DATA_RETRIEVER(*reg0) <= DATA_RETRIEVER(*reg1))
+        thread->controlunit.instrpointreg = instr->target;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t BGT(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0;
+    const PrimitiveData *reg1;
+
+    /* Fetch REGISTER_ADDRESS_0 */
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
+
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
+
+    /* Branch to the target that was resolved when the code was loaded */
+    if (DATA_RETRIEVER(*reg0) > DATA_RETRIEVER(*reg1))
+        thread->controlunit.instrpointreg = instr->target;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t BGE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0;
+    const PrimitiveData *reg1;
+
+    /* Fetch REGISTER_ADDRESS_0 */
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
+
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
+
+    /* Branch to the target that was resolved when the code was loaded */
+    if (DATA_RETRIEVER(*reg0) >= DATA_RETRIEVER(*reg1))
+        thread->controlunit.instrpointreg = instr->target;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t BEQ(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0;
+    const PrimitiveData *reg1;
+
+    /* Fetch REGISTER_ADDRESS_0 */
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
+
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
+
+    /* Branch to the target that was resolved when the code was loaded */
+    if (DATA_RETRIEVER(*reg0) == DATA_RETRIEVER(*reg1))
+        thread->controlunit.instrpointreg = instr->target;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t BNE(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0;
+    const PrimitiveData *reg1;
+
+    /* Fetch REGISTER_ADDRESS_0 */
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
+
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
+
+    /* Branch to the target that was resolved when the code was loaded */
+    if (DATA_RETRIEVER(*reg0) != DATA_RETRIEVER(*reg1))
+        thread->controlunit.instrpointreg = instr->target;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t SWITCH(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg;
+    va_t entry;
+
+    /* Fetch the entry, negative values wrap around past the table */
+    reg = fetch_reg(vm, tid, instr->reg[0]);
+    entry = DATA_RETRIEVER_INT(*reg);
+
+    /* Branch to the entry, or the default target outside the table */
+    if (entry < instr->imm[1])
+        thread->controlunit.instrpointreg = vm->codeseg.table[instr->imm[0] + entry];
+    else
+        thread->controlunit.instrpointreg = instr->target;
+
+    return thread->controlunit.instrreg;
+}
+
+/* END FLOW INSTRUCTIONS */
+
 /*
  *ARITHMETIC & BITWISE OPERATIONS
  */
@@ -631,13 +1048,15 @@ opcode_t JUMP_IF_FALSE(VM *vm, va_t tid)
 opcode_t ADD(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -708,7 +1127,7 @@ opcode_t ADD(VM *vm, va_t tid)
             op_res.va = reg0->va + DATA_RETRIEVER(*reg1);
             break;
     }
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -716,13 +1135,15 @@ opcode_t ADD(VM *vm, va_t tid)
 opcode_t SUB(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -794,7 +1215,7 @@ opcode_t SUB(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -802,13 +1223,15 @@ opcode_t SUB(VM *vm, va_t tid)
 opcode_t MUL(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -880,7 +1303,7 @@ opcode_t MUL(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -888,13 +1311,15 @@ opcode_t MUL(VM *vm, va_t tid)
 opcode_t DIV(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -966,7 +1391,7 @@ opcode_t DIV(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -974,13 +1399,15 @@ opcode_t DIV(VM *vm, va_t tid)
 opcode_t MOD(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -1044,7 +1471,7 @@ opcode_t MOD(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1052,13 +1479,15 @@ opcode_t MOD(VM *vm, va_t tid)
 opcode_t AND(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -1094,7 +1523,7 @@ opcode_t AND(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1102,13 +1531,15 @@ opcode_t AND(VM *vm, va_t tid)
 opcode_t OR(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -1144,7 +1575,7 @@ opcode_t OR(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1152,13 +1583,15 @@ opcode_t OR(VM *vm, va_t tid)
 opcode_t XOR(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -1194,7 +1627,7 @@ opcode_t XOR(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1202,10 +1635,11 @@ opcode_t XOR(VM *vm, va_t tid)
 opcode_t NOT(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg0, op_res;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
     op_res.storage = reg0->storage;
 
@@ -1234,7 +1668,7 @@ opcode_t NOT(VM *vm, va_t tid)
             op_res.va = ~DATA_RETRIEVER_INT(*reg0);
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1242,14 +1676,16 @@ opcode_t NOT(VM *vm, va_t tid)
 opcode_t LSHIFT(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
 
-    PrimitiveData *reg0, *reg1, op_res;
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -1285,7 +1721,7 @@ opcode_t LSHIFT(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1293,14 +1729,16 @@ opcode_t LSHIFT(VM *vm, va_t tid)
 opcode_t RSHIFT(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
 
-    PrimitiveData *reg0, *reg1, op_res;
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = reg0->storage;
     switch (op_res.storage)
@@ -1336,7 +1774,7 @@ opcode_t RSHIFT(VM *vm, va_t tid)
             break;
     }
 
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1350,17 +1788,19 @@ opcode_t RSHIFT(VM *vm, va_t tid)
 opcode_t LESS(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = I8;
     op_res.i8 = DATA_RETRIEVER(*reg0) < DATA_RETRIEVER(*reg1) ? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1368,17 +1808,19 @@ opcode_t LESS(VM *vm, va_t tid)
 opcode_t LESS_EQ(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = I8;
     op_res.i8 = DATA_RETRIEVER(*reg0) <= DATA_RETRIEVER(*reg1) ? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1386,17 +1828,19 @@ opcode_t LESS_EQ(VM *vm, va_t tid)
 opcode_t GREAT(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = I8;
     op_res.i8 = DATA_RETRIEVER(*reg0) > DATA_RETRIEVER(*reg1) ? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1404,17 +1848,19 @@ opcode_t GREAT(VM *vm, va_t tid)
 opcode_t GREAT_EQ(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = I8;
     op_res.i8 = DATA_RETRIEVER(*reg0) >= DATA_RETRIEVER(*reg1) ? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1422,17 +1868,19 @@ opcode_t GREAT_EQ(VM *vm, va_t tid)
 opcode_t EQUAL(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = I8;
     op_res.i8 = DATA_RETRIEVER(*reg0) == DATA_RETRIEVER(*reg1) ? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1440,17 +1888,19 @@ opcode_t EQUAL(VM *vm, va_t tid)
 opcode_t N_EQUAL(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
-    PrimitiveData *reg0, *reg1, op_res;
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg0, op_res;
+    const PrimitiveData *reg1;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
-    /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    /* Fetch REGISTER_ADDRESS_1, or the literal of an immediate form */
+    reg1 = fetch_operand(vm, tid, instr);
 
     op_res.storage = I8;
     op_res.i8 = DATA_RETRIEVER(*reg0) != DATA_RETRIEVER(*reg1) ? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1458,17 +1908,18 @@ opcode_t N_EQUAL(VM *vm, va_t tid)
 opcode_t LOG_AND(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg0, *reg1, op_res;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
     /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    reg1 = fetch_reg(vm, tid, instr->reg[1]);
 
     op_res.storage = I8;
     op_res.i8 = DATA_RETRIEVER(*reg0) && DATA_RETRIEVER(*reg1) ? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1476,17 +1927,18 @@ opcode_t LOG_AND(VM *vm, va_t tid)
 opcode_t LOG_OR(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg0, *reg1, op_res;
 
     /* Fetch REGISTER_ADDRESS_0 */
-    reg0 = fetch_reg(vm, tid);
+    reg0 = fetch_reg(vm, tid, instr->reg[0]);
 
     /* Fetch REGISTER_ADDRESS_1 */
-    reg1 = fetch_reg(vm, tid);
+    reg1 = fetch_reg(vm, tid, instr->reg[1]);
 
     op_res.storage = I8;
     op_res.i8 = DATA_RETRIEVER(*reg0) || DATA_RETRIEVER(*reg1) ? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1494,14 +1946,15 @@ opcode_t LOG_OR(VM *vm, va_t tid)
 opcode_t LOG_NOT(VM *vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg, op_res;
 
     /* Fetch REGISTER_ADDRESS */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
     op_res.storage = I8;
     op_res.i8 = !DATA_RETRIEVER(*reg)? 1 : 0;
-    thread->controlunit.aritreg = op_res;
+    *fetch_reg(vm, tid, instr->reg[2]) = op_res;
 
     return thread->controlunit.instrreg;
 }
@@ -1515,10 +1968,11 @@ opcode_t LOG_NOT(VM *vm, va_t tid)
 opcode_t STAMP(VM * vm, va_t tid)
 {
     Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
     PrimitiveData *reg, op_res;
 
     /* Fetch REGISTER_ADDRESS */
-    reg = fetch_reg(vm, tid);
+    reg = fetch_reg(vm, tid, instr->reg[0]);
 
     op_res.storage = UI64;
     op_res.ui64 = sch_stamp(&vm->core.scheduler);
@@ -1527,54 +1981,776 @@ opcode_t STAMP(VM * vm, va_t tid)
     return thread->controlunit.instrreg;
 }
 
+opcode_t SPAWN(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg, op_res;
+
+    /* Spawn the thread at the target, with the registers as they are now */
+    op_res.storage = I32;
+    op_res.i32 = thr_id(vm, thr_fork(vm, tid, instr->target));
+
+    /* Fetch REGISTER_ADDRESS the thread ID is written to */
+    reg = fetch_reg(vm, tid, instr->reg[2]);
+    *reg = op_res;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t JOIN(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t joined;
+
+    /* Fetch THREAD_ID */
+    joined = thr_slot(vm, DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0])));
+
+    /* Performed again once the thread has halted */
+    if (thr_join(vm, tid, joined))
+    {
+        thread->controlunit.instrpointreg--;
+        return thread->controlunit.instrreg;
+    }
+
+    /* Copy the result register of the halted thread, whose slot may be reused after */
+    *fetch_reg(vm, tid, instr->reg[2]) = vm->core.thread_pool[joined].controlunit.regfile[instr->reg[1]];
+    thr_reap(vm, joined, THR_HOLD_JOIN);
+
+    return thread->controlunit.instrreg;
+}
+
+/* The interpreter ends the run of the thread after it */
+opcode_t YIELD(VM *vm, va_t tid)
+{
+    return vm->core.thread_pool[tid].controlunit.instrreg;
+}
+
+opcode_t SELF(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg;
+
+    /* Fetch REGISTER_ADDRESS */
+    reg = fetch_reg(vm, tid, instr->reg[2]);
+    reg->storage = I32;
+    reg->i32 = thr_id(vm, tid);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t PARFOR(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    int32_t start, end, grain;
+
+    /* Fetch START, END and GRAIN */
+    start = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    end = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[1]));
+    grain = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[2]));
+
+    /* The thread waits past the PARFOR, nothing is left to perform again */
+    thr_parfor(vm, tid, instr->target, start, end, grain);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t SPAWN_STACK(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    int64_t entries;
+
+    /* Fetch STACK_ENTRIES */
+    entries = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    if (entries < 1)
+        return pvm_reporterror(OPCODE_H, __FUNCTION__, "Stack of no entries");
+
+    /* Only the threads spawned from now on get stacks of that size */
+    thread->stacksize = entries;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t MUTEX_LOCK(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+
+    /* Fetch MUTEX_ID, the thread carries on once it holds the mutex */
+    syn_lock(vm, tid, DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0])));
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t MUTEX_UNLOCK(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+
+    /* Fetch MUTEX_ID */
+    syn_unlock(vm, tid, DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0])));
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t COND_WAIT(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t cond, mutex;
+
+    /* Fetch CONDITION_ID and MUTEX_ID */
+    cond = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    mutex = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[1]));
+
+    syn_wait(vm, tid, cond, mutex);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t COND_SIGNAL(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+
+    /* Fetch CONDITION_ID */
+    syn_signal(vm, DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0])), false);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t COND_BROADCAST(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+
+    /* Fetch CONDITION_ID */
+    syn_signal(vm, DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0])), true);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t BARRIER(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t barrier;
+    int64_t count;
+
+    /* Fetch BARRIER_ID and COUNT */
+    barrier = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    count = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[1]));
+
+    syn_barrier(vm, tid, barrier, count < 0 ? 0 : count > UINT32_MAX ? UINT32_MAX : count);
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t SLEEP_NS(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    int64_t ns;
+
+    /* Fetch NANOSECONDS, nothing to wait for unless positive */
+    ns = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    thr_sleepns(vm, tid, ns > 0 ? ns : 0);
+
+    return thread->controlunit.instrreg;
+}
+
 /* END SCHEDULER INSTRUCTION */
 
+/*
+ * ATOMIC INSTRUCTIONS
+ */
+
+opcode_t ATOMIC_LOAD(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, false, OPC_ATOMIC_LOAD);
+}
+
+opcode_t ATOMIC_STORE(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, false, OPC_ATOMIC_STORE);
+}
+
+opcode_t ATOMIC_XCHG(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, false, OPC_ATOMIC_XCHG);
+}
+
+opcode_t ATOMIC_FETCH_ADD(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, false, OPC_ATOMIC_FETCH_ADD);
+}
+
+opcode_t ATOMIC_CAS(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, false, OPC_ATOMIC_CAS);
+}
+
+opcode_t ATOMIC_LOAD_STATIC(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, true, OPC_ATOMIC_LOAD);
+}
+
+opcode_t ATOMIC_STORE_STATIC(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, true, OPC_ATOMIC_STORE);
+}
+
+opcode_t ATOMIC_XCHG_STATIC(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, true, OPC_ATOMIC_XCHG);
+}
+
+opcode_t ATOMIC_FETCH_ADD_STATIC(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, true, OPC_ATOMIC_FETCH_ADD);
+}
+
+opcode_t ATOMIC_CAS_STATIC(VM *vm, va_t tid)
+{
+    return atomic_slot(vm, tid, true, OPC_ATOMIC_CAS);
+}
+
+/* END ATOMIC INSTRUCTIONS */
+
+/*
+ * CHANNEL INSTRUCTIONS
+ */
+
+opcode_t CHAN_NEW(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg, op_res;
+    int64_t capacity;
+    bool single;
+
+    /* Fetch CAPACITY and whether the channel is ONE_TO_ONE */
+    capacity = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    single = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[1])) != 0;
+
+    op_res.storage = I32;
+    op_res.i32 = chn_new(vm, capacity > 0 ? capacity : 0, single);
+
+    /* Fetch REGISTER_ADDRESS the channel ID is written to */
+    reg = fetch_reg(vm, tid, instr->reg[2]);
+    *reg = op_res;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t CHAN_SEND(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t chan;
+
+    /* Fetch CHANNEL_ID */
+    chan = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+
+    /* Performed again once there is room */
+    if (chn_send(vm, tid, chan, fetch_reg(vm, tid, instr->reg[1]), 1, true) == 0)
+        thread->controlunit.instrpointreg--;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t CHAN_RECV(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg, op_res;
+    va_t chan;
+
+    /* Fetch CHANNEL_ID */
+    chan = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+
+    /* Performed again once a value is sent */
+    if (chn_recv(vm, tid, chan, &op_res, 1, true) == 0)
+    {
+        thread->controlunit.instrpointreg--;
+        return thread->controlunit.instrreg;
+    }
+
+    /* Fetch REGISTER_ADDRESS the value is written to */
+    reg = fetch_reg(vm, tid, instr->reg[2]);
+    *reg = op_res;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t CHAN_TRY_SEND(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    va_t chan;
+
+    /* Fetch CHANNEL_ID */
+    chan = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+
+    /* Whether the value was sent goes to aritreg */
+    thread->controlunit.aritreg.i32 = chn_send(vm, tid, chan, fetch_reg(vm, tid, instr->reg[1]), 1, false);
+    thread->controlunit.aritreg.storage = I32;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t CHAN_TRY_RECV(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg, op_res;
+    va_t chan;
+    size_t received;
+
+    /* Fetch CHANNEL_ID */
+    chan = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+
+    /* Fetch REGISTER_ADDRESS the value is written to, left as it is if none was received */
+    received = chn_recv(vm, tid, chan, &op_res, 1, false);
+    reg = fetch_reg(vm, tid, instr->reg[2]);
+    if (received > 0)
+        *reg = op_res;
+
+    /* Whether a value was received goes to aritreg */
+    thread->controlunit.aritreg.storage = I32;
+    thread->controlunit.aritreg.i32 = received;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t CHAN_SEND_N(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg, op_res;
+    va_t chan;
+    int64_t count;
+
+    /* Fetch CHANNEL_ID and COUNT */
+    chan = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    count = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[1]));
+
+    /* Send the values at HEAP_ADDRESS from OFFSET_ADDRESS on, performed again until one is */
+    lock_memory(vm, false);
+    op_res.storage = I32;
+    op_res.i32 = count > 0 ? chn_send(vm, tid, chan, fetch_frame(vm, instr->imm[0], instr->imm[1], count), count,
+                                      true) : 0;
+    unlock_memory(vm);
+    if (count > 0 && op_res.i32 == 0)
+    {
+        thread->controlunit.instrpointreg--;
+        return thread->controlunit.instrreg;
+    }
+
+    /* Fetch REGISTER_ADDRESS the number of values sent is written to */
+    reg = fetch_reg(vm, tid, instr->reg[2]);
+    *reg = op_res;
+
+    return thread->controlunit.instrreg;
+}
+
+opcode_t CHAN_RECV_N(VM *vm, va_t tid)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *reg, op_res;
+    va_t chan;
+    int64_t count;
+
+    /* Fetch CHANNEL_ID and COUNT */
+    chan = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[0]));
+    count = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, instr->reg[1]));
+
+    /* Receive values to HEAP_ADDRESS from OFFSET_ADDRESS on, performed again until one is */
+    lock_memory(vm, false);
+    op_res.storage = I32;
+    op_res.i32 = count > 0 ? chn_recv(vm, tid, chan, fetch_frame(vm, instr->imm[0], instr->imm[1], count), count,
+                                      true) : 0;
+    unlock_memory(vm);
+    if (count > 0 && op_res.i32 == 0)
+    {
+        thread->controlunit.instrpointreg--;
+        return thread->controlunit.instrreg;
+    }
+
+    /* Fetch REGISTER_ADDRESS the number of values received is written to */
+    reg = fetch_reg(vm, tid, instr->reg[2]);
+    *reg = op_res;
+
+    return thread->controlunit.instrreg;
+}
+
+/* END CHANNEL INSTRUCTIONS */
+
 /*
  *UTILITY FUNCTIONS
  */
 
-PrimitiveData *fetch_reg(VM *vm, va_t tid)
+/*
+ * Returns the decoded instruction the thread is performing. Its instruction
+ * pointer already points to the next one.
+ */
+inline const Instruction *fetch_instr(VM *vm, va_t tid)
+{
+    return &vm->codeseg.instr[vm->core.thread_pool[tid].controlunit.instrpointreg - 1];
+}
+
+/* Returns the register of a decoded REGISTER_ADDRESS operand */
+inline PrimitiveData *fetch_reg(VM *vm, va_t tid, uint8_t index)
 {
-    opcode_t regid = fetch_code(vm, tid);
-    PrimitiveData *reg;
+    return &vm->core.thread_pool[tid].controlunit.regfile[index];
+}
+
+/*
+ * Returns the second operand of a binary instruction, the literal of the
+ * instruction itself for an immediate form
+ */
+inline const PrimitiveData *fetch_operand(VM *vm, va_t tid, const Instruction *instr)
+{
+    return instr->reg[1] == REG_IMM ? &instr->data : fetch_reg(vm, tid, instr->reg[1]);
+}
+
+/*
+ * Returns the offset of the heap block an immediate offset and an index
+ * register point to, reporting an error if it is not in an allocated frame
+ */
+va_t fetch_element(VM *vm, va_t tid, va_t heap_va, va_t offset, uint8_t index)
+{
+    offset += DATA_RETRIEVER_INT(*fetch_reg(vm, tid, index));
+    if (heap_va >= vm->heap.size || !vm->heap.var_pool[heap_va].occupied ||
+        offset >= vm->heap.var_pool[heap_va].framesize)
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Heap index out of bounds");
+
+    return offset;
+}
+
+/*
+ * Returns the slot of the static segment an immediate offset and an index
+ * register point to, reporting an error if it is not in a static variable
+ */
+static PrimitiveData *fetch_static(VM *vm, va_t tid, va_t va, va_t offset, uint8_t index)
+{
+    offset += DATA_RETRIEVER_INT(*fetch_reg(vm, tid, index));
+    if (va >= vm->staticseg.size || offset >= vm->staticseg.var_pool[va].size)
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Static index out of bounds");
+
+    return &vm->staticseg.var_pool[va].primdata_arr[offset];
+}
 
-    switch (regid)
+/*
+ * Returns the heap block at an offset of a frame, reporting an error unless
+ * the frame holds a number of blocks from there on
+ */
+static PrimitiveData *fetch_frame(VM *vm, va_t heap_va, va_t offset, int64_t count)
+{
+    if (heap_va >= vm->heap.size || !vm->heap.var_pool[heap_va].occupied ||
+        offset > vm->heap.var_pool[heap_va].framesize ||
+        count > vm->heap.var_pool[heap_va].framesize - offset)
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Heap index out of bounds");
+    if (vm->heap.var_pool[heap_va].type != 0)
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Typed frame holds no PrimitiveData");
+
+    return &vm->heap.var_pool[heap_va].block[offset];
+}
+
+/*
+ * Returns the element of the flat region at the address a register holds,
+ * reporting an error unless it was given out by FLAT_MALLOC
+ */
+static PrimitiveData *fetch_flat(VM *vm, va_t tid, uint8_t index)
+{
+    va_t va = DATA_RETRIEVER_INT(*fetch_reg(vm, tid, index));
+
+    if (va == 0 || va >= __atomic_load_n(&vm->heap.flattop, __ATOMIC_ACQUIRE))
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Heap index out of bounds");
+
+    return &vm->heap.flat[va];
+}
+
+/*
+ * Reads an element of a frame into a register. The element of a typed frame
+ * is widened into the payload, and the register takes the type of the frame.
+ */
+static void load_element(const HeapFrame *frame, va_t offset, PrimitiveData *reg)
+{
+    if (frame->type == 0)
+    {
+        *reg = frame->block[offset];
+        return;
+    }
+
+    reg->storage = frame->type;
+    switch (frame->type)
     {
-        case 0x00:
-            reg = &vm->core.thread_pool[tid].controlunit.genpreg[0];
+        case I8:
+            reg->i64 = ((const int8_t *) frame->raw)[offset];
+            break;
+        case UI8:
+            reg->ui64 = ((const uint8_t *) frame->raw)[offset];
             break;
-        case 0x01:
-            reg = &vm->core.thread_pool[tid].controlunit.genpreg[1];
+        case I16:
+            reg->i64 = ((const int16_t *) frame->raw)[offset];
             break;
-        case 0x02:
-            reg = &vm->core.thread_pool[tid].controlunit.genpreg[2];
+        case UI16:
+            reg->ui64 = ((const uint16_t *) frame->raw)[offset];
             break;
-        case 0x04:
-            reg = &vm->core.thread_pool[tid].controlunit.genpreg[3];
+        case I32:
+            reg->i64 = ((const int32_t *) frame->raw)[offset];
             break;
-        case 0x08:
-            reg = &vm->core.thread_pool[tid].controlunit.genpreg[4];
+        case UI32:
+            reg->ui64 = ((const uint32_t *) frame->raw)[offset];
             break;
-        case 0x10:
-            reg = &vm->core.thread_pool[tid].controlunit.genpreg[5];
+        case DBL:
+            reg->dbl = ((const double *) frame->raw)[offset];
             break;
-        case 0x20:
-            reg = &vm->core.thread_pool[tid].controlunit.genpreg[6];
+        default:
+            reg->ui64 = ((const uint64_t *) frame->raw)[offset];
             break;
-        case 0x40:
-            reg = &vm->core.thread_pool[tid].controlunit.genpreg[7];
+    }
+}
+
+/*
+ * Writes a register to an element of a frame. A typed frame takes the value
+ * converted to its type, integers narrowed to their low bytes.
+ */
+static void store_element(HeapFrame *frame, va_t offset, const PrimitiveData *reg)
+{
+    uint64_t bits;
+
+    if (frame->type == 0)
+    {
+        frame->block[offset] = *reg;
+        return;
+    }
+    if (frame->type == DBL)
+    {
+        ((double *) frame->raw)[offset] = DATA_RETRIEVER(*reg);
+        return;
+    }
+
+    bits = reg->storage == DBL ? (uint64_t) (int64_t) reg->dbl : (uint64_t) DATA_RETRIEVER_INT(*reg);
+    switch (heap_width(frame->type))
+    {
+        case 1:
+            ((uint8_t *) frame->raw)[offset] = bits;
             break;
-        case 0x80:
-            reg = &vm->core.thread_pool[tid].controlunit.aritreg;
+        case 2:
+            ((uint16_t *) frame->raw)[offset] = bits;
             break;
+        case 4:
+            ((uint32_t *) frame->raw)[offset] = bits;
+            break;
+        default:
+            ((uint64_t *) frame->raw)[offset] = bits;
+            break;
+    }
+}
+
+/* Size of the payload of a type, 0 for no type at all */
+static size_t atomic_width(uint32_t type)
+{
+    switch (type)
+    {
+        case I8: case UI8:
+            return 1;
+        case I16: case UI16:
+            return 2;
+        case I32: case UI32:
+            return 4;
+        case I64: case UI64: case DBL: case VA:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+/* Payload of a value as wide as it is, the bytes past it may be anything */
+static uint64_t atomic_bits(const PrimitiveData *data, size_t width)
+{
+    return width == 8 ? data->ui64 : data->ui64 & ((UINT64_C(1) << width * 8) - 1);
+}
+
+/* Performs an __atomic builtin on the payload of a slot, as wide as its type */
+#define ATOMIC_PAYLOAD(slot, width, builtin, ...)\
+(\
+    (width) == 1 ? builtin(&(slot)->ui8, __VA_ARGS__) :\
+    ((width) == 2 ? builtin(&(slot)->ui16, __VA_ARGS__) :\
+    ((width) == 4 ? builtin(&(slot)->ui32, __VA_ARGS__) :\
+    builtin(&(slot)->ui64, __VA_ARGS__)))\
+)
+
+/* Swaps the payload of a slot if it holds 'expected', which gets what it holds */
+static bool atomic_cas(PrimitiveData *slot, size_t width, uint64_t *expected, uint64_t desired)
+{
+    uint8_t e8 = *expected;
+    uint16_t e16 = *expected;
+    uint32_t e32 = *expected;
+    bool swapped;
+
+    switch (width)
+    {
+        case 1:
+            swapped = __atomic_compare_exchange_n(&slot->ui8, &e8, desired, false, __ATOMIC_SEQ_CST,
+                                                  __ATOMIC_SEQ_CST);
+            *expected = e8;
+            return swapped;
+        case 2:
+            swapped = __atomic_compare_exchange_n(&slot->ui16, &e16, desired, false, __ATOMIC_SEQ_CST,
+                                                  __ATOMIC_SEQ_CST);
+            *expected = e16;
+            return swapped;
+        case 4:
+            swapped = __atomic_compare_exchange_n(&slot->ui32, &e32, desired, false, __ATOMIC_SEQ_CST,
+                                                  __ATOMIC_SEQ_CST);
+            *expected = e32;
+            return swapped;
+        default:
+            return __atomic_compare_exchange_n(&slot->ui64, expected, desired, false, __ATOMIC_SEQ_CST,
+                                               __ATOMIC_SEQ_CST);
+    }
+}
+
+/*
+ * Performs an atomic opcode on a slot of the heap or of the static segment.
+ * The storage tag only ever goes from untyped to the type of the first value
+ * written, so the payload is always read and written as wide as the tag says.
+ */
+static opcode_t atomic_slot(VM *vm, va_t tid, bool statics, opcode_t op)
+{
+    Thread *thread = &vm->core.thread_pool[tid];
+    const Instruction *instr = fetch_instr(vm, tid);
+    PrimitiveData *slot, *reg, *expected, sum;
+    va_t offset;
+    uint32_t type, tag = 0;
+    uint64_t bits = 0, found = 0;
+    size_t width;
+    bool swapped = false;
+
+    /* Fetch VALUE_REGISTER, or the destination of a load */
+    reg = fetch_reg(vm, tid, instr->reg[0]);
+
+    lock_memory(vm, false);
+    /* Fetch the slot at HEAP_ADDRESS or STATIC_ADDRESS, indexed by INDEX_REGISTER */
+    if (statics)
+        slot = fetch_static(vm, tid, instr->imm[0], instr->imm[1], instr->reg[1]);
+    else
+    {
+        offset = fetch_element(vm, tid, instr->imm[0], instr->imm[1], instr->reg[1]);
+        if (vm->heap.var_pool[instr->imm[0]].type != 0)
+            pvm_reporterror(OPCODE_H, __FUNCTION__, "Atomic operation on a typed frame");
+        slot = &vm->heap.var_pool[instr->imm[0]].block[offset];
+    }
+
+    if (op == OPC_ATOMIC_LOAD)
+    {
+        /* An untyped slot reads like GET does */
+        type = __atomic_load_n((uint32_t *) &slot->storage, __ATOMIC_ACQUIRE);
+        width = type == 0 ? 8 : atomic_width(type);
+        if (width == 0)
+            pvm_reporterror(OPCODE_H, __FUNCTION__, "Atomic operation on a slot of no type");
+        bits = ATOMIC_PAYLOAD(slot, width, __atomic_load_n, __ATOMIC_ACQUIRE);
+        unlock_memory(vm);
+
+        reg->storage = type;
+        reg->ui64 = bits;
+        return thread->controlunit.instrreg;
+    }
+
+    /* An untyped slot takes the type of the value, an addend is converted */
+    type = reg->storage;
+    if (!__atomic_compare_exchange_n((uint32_t *) &slot->storage, &tag, type, false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_ACQUIRE) && tag != type)
+    {
+        if (op != OPC_ATOMIC_FETCH_ADD)
+            pvm_reporterror(OPCODE_H, __FUNCTION__, "Atomic operation on a slot of another type");
+        type = tag;
+    }
+    width = atomic_width(type);
+    if (width == 0)
+        pvm_reporterror(OPCODE_H, __FUNCTION__, "Atomic operation on a slot of no type");
+
+    switch (op)
+    {
+        case OPC_ATOMIC_STORE:
+            ATOMIC_PAYLOAD(slot, width, __atomic_store_n, atomic_bits(reg, width), __ATOMIC_RELEASE);
+            break;
+        case OPC_ATOMIC_XCHG:
+            found = ATOMIC_PAYLOAD(slot, width, __atomic_exchange_n, atomic_bits(reg, width), __ATOMIC_SEQ_CST);
+            break;
+        case OPC_ATOMIC_FETCH_ADD:
+            if (type != DBL)
+            {
+                /* A DBL addend is truncated like CAST does, its bits mean nothing to an integer */
+                bits = reg->storage == DBL ? (uint64_t) (int64_t) reg->dbl : (uint64_t) DATA_RETRIEVER_INT(*reg);
+                found = ATOMIC_PAYLOAD(slot, width, __atomic_fetch_add, bits, __ATOMIC_SEQ_CST);
+                break;
+            }
+
+            /* There is no native floating point addition, retry until nobody wrote in between */
+            found = __atomic_load_n(&slot->ui64, __ATOMIC_RELAXED);
+            do
+            {
+                sum.ui64 = found;
+                sum.dbl += DATA_RETRIEVER(*reg);
+            } while (!atomic_cas(slot, 8, &found, sum.ui64));
+            break;
+        case OPC_ATOMIC_CAS:
+            /* Fetch EXPECTED_REGISTER */
+            expected = fetch_reg(vm, tid, instr->reg[2]);
+            if (expected->storage != type)
+                pvm_reporterror(OPCODE_H, __FUNCTION__, "Atomic operation on a slot of another type");
+            bits = atomic_bits(expected, width);
+            swapped = atomic_cas(slot, width, &bits, atomic_bits(reg, width));
+            found = bits;
+            break;
+    }
+    unlock_memory(vm);
+
+    if (op == OPC_ATOMIC_STORE)
+        return thread->controlunit.instrreg;
+
+    /* Fetch the register the previous value is written to */
+    reg = fetch_reg(vm, tid, instr->reg[2]);
+    reg->storage = type;
+    reg->ui64 = found;
+
+    if (op == OPC_ATOMIC_CAS)
+    {
+        thread->controlunit.aritreg.storage = I32;
+        thread->controlunit.aritreg.i32 = swapped;
     }
 
-    return reg;
+    return thread->controlunit.instrreg;
+}
+
+/*
+ * With several workers, the heap and the static segment are shared by threads
+ * running at the same time. Allocations lock them for writing, element
+ * accesses for reading. A lone worker never waits on the lock.
+ */
+inline void lock_memory(VM *vm, bool write)
+{
+    if (vm->core.worker_num == 1)
+        return;
+    if (write)
+        pthread_rwlock_wrlock(&vm->core.memlock);
+    else
+        pthread_rwlock_rdlock(&vm->core.memlock);
 }
 
-inline uint8_t fetch_code(VM *vm, va_t tid)
+inline void unlock_memory(VM *vm)
 {
-    return vm->codeseg.content[vm->core.thread_pool[tid].controlunit.instrpointreg++];
+    if (vm->core.worker_num > 1)
+        pthread_rwlock_unlock(&vm->core.memlock);
 }
 
 /* END UTILITY FUNCTIONS */
@@ -1,18 +1,70 @@
 #include "../include/options.h"
 #include <string.h>
 
-int opt_execute(char * arg)
+int opt_execute(char * arg, const Options *options)
 {
     int retcode;
     VM vm;
 
     vm = pvm_initialise(arg);
+    if (options->quantum > 0)
+        vm.core.scheduler.quantum = options->quantum;
+    if (options->workers > 0)
+        vm.core.worker_num = options->workers;
+    if (options->stack > 0)
+        vm.core.stack_size = options->stack;
+    /* A profile is taken from the plain interpreter */
+    if (options->profile)
+        csg_profile(&vm.codeseg);
+    else if (options->jit)
+        jit_enable(&vm);
     retcode = pvm_run(&vm);
+    if (options->profile)
+        csg_dumpprofile(&vm.codeseg, stdout);
     pvm_finalise(&vm);
 
     return retcode;
 }
 
+int opt_compact(char *arg, const char *out)
+{
+    VM vm;
+    FILE *in, *fp;
+    long size;
+    opcode_t *header;
+
+    vm = pvm_initialise(arg);
+    if (vm.codeseg.compact)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Already in the compact encoding");
+    in = fopen(arg, "rb");
+    fp = fopen(out, "wb");
+    if (in == NULL || fp == NULL)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Cannot open file");
+
+    /* Everything before the code segment is copied, only the magic changes */
+    fseek(in, 0, SEEK_END);
+    size = ftell(in) - vm.codeseg.size;
+    header = malloc(size);
+    if (header == NULL)
+        return pvm_reporterror(CODESEG_H, __FUNCTION__, "Allocation failed");
+    fseek(in, 0, SEEK_SET);
+    fread(header, size, 1, in);
+    header[0] = MAGIC_COMPACT >> 24;
+    header[1] = MAGIC_COMPACT >> 16 & 0xFF;
+    header[2] = MAGIC_COMPACT >> 8 & 0xFF;
+    header[3] = MAGIC_COMPACT & 0xFF;
+    fwrite(header, size, 1, fp);
+
+    csg_compact(&vm.codeseg, fp);
+
+    free(header);
+    fclose(in);
+    fclose(fp);
+    pvm_finalise(&vm);
+
+    return 0;
+}
+
 
 /*
  * TODO: Add more option outputs for specific OSes. Perhaps add a centralised
@@ -34,12 +86,20 @@ int opt_help(void)
     (
         "Usage: pvm [options] [args]\n"
         "           (general options)\n"
-        "   or  pvm [file]\n"
+        "   or  pvm [-j | -p] [-q n] [-w n] [-s n] [file]\n"
         "           (to execute bytecode file)\n"
+        "   or  pvm -c out [file]\n"
+        "           (to write bytecode file in the compact encoding)\n"
         "\n"
         "List of possible options:\n"
         "   -h  : prints this message.\n"
         "   -e  : executes bytecode file. (args: file name in current directory)\n"
+        "   -c  : writes the compact encoding of a bytecode file. (args: output file name)\n"
+        "   -j  : compiles hot loops into native code (x86-64 only).\n"
+        "   -p  : prints the opcode pairs and triples performed most often.\n"
+        "   -q  : instructions a thread runs for before switching. (args: number, default 1000)\n"
+        "   -w  : OS threads the VM threads run on. (args: number, default 1)\n"
+        "   -s  : stack entries of each thread, unless SPAWN_STACK sets them. (args: number, default 1024)\n"
         "   -v  : prints product version.\n"
     );
     return 0;
@@ -10,16 +10,94 @@
  * as recalculating cooldowns of any sleeping threads.
  ******************************************************************************/
 
-#include "../include/scheduler.h"
+#include "../include/thread.h"
+#include <time.h>
 
 inline int sch_initialise(Scheduler *scheduler)
 {
     scheduler->flag = SCH_ON;
-    scheduler->clocks = 0;
+    scheduler->clocks = scheduler->wheelclock = 0;
+    scheduler->quantum = SCH_QUANTUM;
+    scheduler->head = scheduler->tail = scheduler->timers = SCH_NIL;
+    scheduler->sleeping = scheduler->runnable = 0;
+
+    for (size_t level = 0; level < SCH_WHEEL_LEVELS; level++)
+    {
+        for (size_t slot = 0; slot < SCH_WHEEL_SLOTS; slot++)
+            scheduler->wheel[level][slot] = SCH_NIL;
+        scheduler->occupied[level] = 0;
+    }
 
     return 0;
 }
 
+/* Files a sleeping thread in the timer wheel, relative to the wheel clock */
+static void wheel_insert(Scheduler *scheduler, Thread *pool, va_t tid)
+{
+    vmclock_t wakeup = pool[tid].wakeup;
+    unsigned int level, slot;
+
+    if (wakeup <= scheduler->wheelclock)
+    {
+        pool[tid].flag = THR_ALIVE;
+        sch_ready(scheduler, pool, tid);
+        return;
+    }
+
+    /* The highest bits that still differ from the clock pick the level */
+    level = (sizeof(vmclock_t) * 8 - 1 - __builtin_clzl(wakeup ^ scheduler->wheelclock)) / SCH_WHEEL_BITS;
+    slot = wakeup >> (level * SCH_WHEEL_BITS) & (SCH_WHEEL_SLOTS - 1);
+
+    pool[tid].link = scheduler->wheel[level][slot];
+    scheduler->wheel[level][slot] = tid;
+    scheduler->occupied[level] |= (uint64_t) 1 << slot;
+    scheduler->sleeping++;
+}
+
+/*
+ * Refiles the threads of every slot the wheel clock passed since 'from'. Each of
+ * them is either due and runs again, or goes down to a lower level. Slots
+ * the clock did not reach stay where they are.
+ */
+static void wheel_expire(Scheduler *scheduler, Thread *pool, vmclock_t from)
+{
+    for (unsigned int level = 0; level < SCH_WHEEL_LEVELS; level++)
+    {
+        unsigned int shift = level * SCH_WHEEL_BITS;
+        vmclock_t span = (scheduler->wheelclock >> shift) - (from >> shift);
+        unsigned int first = ((from >> shift) + 1) & (SCH_WHEEL_SLOTS - 1);
+        uint64_t passed, pending;
+
+        /* Nothing at this level or above has come any closer */
+        if (span == 0)
+            break;
+
+        /* The slots after the one of 'from' up to the one of the clock */
+        passed = span >= SCH_WHEEL_SLOTS ? ~(uint64_t) 0 : ((uint64_t) 1 << span) - 1;
+        passed = passed << first | passed >> ((SCH_WHEEL_SLOTS - first) & (SCH_WHEEL_SLOTS - 1));
+        pending = scheduler->occupied[level] & passed;
+        scheduler->occupied[level] &= ~pending;
+
+        while (pending != 0)
+        {
+            unsigned int slot = __builtin_ctzl(pending);
+            va_t tid = scheduler->wheel[level][slot];
+
+            pending &= pending - 1;
+            scheduler->wheel[level][slot] = SCH_NIL;
+            while (tid != SCH_NIL)
+            {
+                va_t next = pool[tid].link;
+
+                scheduler->sleeping--;
+                if (!(pool[tid].flag & THR_DEAD))
+                    wheel_insert(scheduler, pool, tid);
+                tid = next;
+            }
+        }
+    }
+}
+
 inline int sch_pause(Scheduler *scheduler)
 {
     if (scheduler->flag == SCH_OFF)
@@ -39,10 +117,161 @@ inline int sch_resume(Scheduler *scheduler)
 }
 
 inline int sch_cycle(Scheduler *scheduler)
+{
+    return sch_advance(scheduler, 1);
+}
+
+inline int sch_advance(Scheduler *scheduler, vmclock_t cycles)
 {
     if (scheduler->flag == SCH_OFF)
         return pvm_reporterror(SCHEDULER_H, __FUNCTION__, NULL);
-    scheduler->clocks++;
+    __atomic_fetch_add(&scheduler->clocks, cycles, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+int sch_expire(Scheduler *scheduler, Thread *pool)
+{
+    vmclock_t from = scheduler->wheelclock;
+
+    scheduler->wheelclock = sch_stamp(scheduler);
+    if (scheduler->sleeping > 0)
+        wheel_expire(scheduler, pool, from);
+
+    return 0;
+}
+
+int sch_ready(Scheduler *scheduler, Thread *pool, va_t tid)
+{
+    pool[tid].link = SCH_NIL;
+    if (scheduler->tail == SCH_NIL)
+        scheduler->head = tid;
+    else
+        pool[scheduler->tail].link = tid;
+    scheduler->tail = tid;
+    __atomic_fetch_add(&scheduler->runnable, 1, __ATOMIC_SEQ_CST);
+
+    return 0;
+}
+
+int sch_sleep(Scheduler *scheduler, Thread *pool, va_t tid)
+{
+    /* Filed relative to the current clock, not to where the wheel lags */
+    sch_expire(scheduler, pool);
+    __atomic_fetch_sub(&scheduler->runnable, 1, __ATOMIC_SEQ_CST);
+    wheel_insert(scheduler, pool, tid);
+
+    return 0;
+}
+
+int sch_wait(Scheduler *scheduler, Thread *pool, va_t tid)
+{
+    Thread *joined = &pool[pool[tid].joining];
+
+    __atomic_fetch_sub(&scheduler->runnable, 1, __ATOMIC_SEQ_CST);
+    if (pool[tid].joining == tid)
+        return sch_release(scheduler, pool, tid);
+    if (joined->flag & THR_DEAD)
+    {
+        pool[tid].flag = THR_ALIVE;
+        return sch_ready(scheduler, pool, tid);
+    }
+    pool[tid].link = joined->waiters;
+    joined->waiters = tid;
+
+    return 0;
+}
+
+int sch_wake(Scheduler *scheduler, Thread *pool, va_t tid)
+{
+    va_t waiter = pool[tid].waiters, next;
+
+    pool[tid].waiters = SCH_NIL;
+    for (; waiter != SCH_NIL; waiter = next)
+    {
+        next = pool[waiter].link;
+        if (pool[waiter].flag & THR_DEAD)
+            continue;
+        pool[waiter].flag = THR_ALIVE;
+        sch_ready(scheduler, pool, waiter);
+    }
+
+    return 0;
+}
+
+int sch_release(Scheduler *scheduler, Thread *pool, va_t tid)
+{
+    if (--pool[tid].pending > 0 || pool[tid].flag & THR_DEAD)
+        return 0;
+    pool[tid].flag = THR_ALIVE;
+
+    return sch_ready(scheduler, pool, tid);
+}
+
+int sch_timer(Scheduler *scheduler, Thread *pool, va_t tid)
+{
+    va_t *at = &scheduler->timers;
+
+    /* Threads due at the same time are released in the order they were filed */
+    while (*at != SCH_NIL && pool[*at].deadline <= pool[tid].deadline)
+        at = &pool[*at].link;
+    pool[tid].link = *at;
+    __atomic_store_n(at, tid, __ATOMIC_RELAXED);
+
+    return 0;
+}
+
+int sch_alarm(Scheduler *scheduler, Thread *pool, uint64_t now)
+{
+    va_t tid;
+
+    while ((tid = scheduler->timers) != SCH_NIL && pool[tid].deadline <= now)
+    {
+        __atomic_store_n(&scheduler->timers, pool[tid].link, __ATOMIC_RELAXED);
+        sch_release(scheduler, pool, tid);
+    }
+
+    return 0;
+}
+
+va_t sch_next(Scheduler *scheduler, Thread *pool)
+{
+    va_t tid;
+
+    do
+    {
+        tid = scheduler->head;
+        if (tid == SCH_NIL)
+            return SCH_NIL;
+        scheduler->head = pool[tid].link;
+        if (scheduler->head == SCH_NIL)
+            scheduler->tail = SCH_NIL;
+    } while (pool[tid].flag & THR_DEAD);
+
+    return tid;
+}
+
+int sch_idle(Scheduler *scheduler, Thread *pool)
+{
+    sch_expire(scheduler, pool);
+
+    /* Nothing runnable, the clock jumps to the first slot that holds a thread */
+    while (scheduler->head == SCH_NIL && scheduler->sleeping > 0)
+    {
+        unsigned int level, shift, slot;
+        vmclock_t from = scheduler->wheelclock, base;
+
+        for (level = 0; scheduler->occupied[level] == 0; level++);
+        shift = level * SCH_WHEEL_BITS;
+        base = from >> shift;
+        slot = (base & (SCH_WHEEL_SLOTS - 1)) + 1 +
+               __builtin_ctzl(scheduler->occupied[level] >> (base & (SCH_WHEEL_SLOTS - 1)) >> 1);
+        scheduler->wheelclock = (base - (base & (SCH_WHEEL_SLOTS - 1)) + slot) << shift;
+
+        /* A worker may still be accounting for its last run, keep its cycles */
+        __atomic_fetch_add(&scheduler->clocks, scheduler->wheelclock - from, __ATOMIC_RELAXED);
+        wheel_expire(scheduler, pool, from);
+    }
 
     return 0;
 }
@@ -54,5 +283,14 @@ inline int sch_reset(Scheduler *scheduler)
 
 inline vmclock_t sch_stamp(Scheduler *scheduler)
 {
-    return scheduler->clocks;
+    return __atomic_load_n(&scheduler->clocks, __ATOMIC_RELAXED);
+}
+
+uint64_t sch_walltime(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
 }
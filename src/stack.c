@@ -9,23 +9,44 @@
  ******************************************************************************/
 
 #include "../include/stack.h"
+#include <sys/mman.h>
+#include <unistd.h>
 
-int stk_initialise(Stack *stack)
+int stk_initialise(Stack *stack, size_t size)
 {
-    *stack = (Stack) {.pointer = 0, .primdata_arr = malloc(sizeof(PrimitiveData) *STACK_SIZE)};
-    return stack->primdata_arr == NULL ? pvm_reporterror(STACK_H, __FUNCTION__, "Allocation failed") : 0;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t bytes = (sizeof(PrimitiveData) * size + page - 1) / page * page;
+    char *mapping;
+
+    /* Pages are only committed once the thread pushes onto them */
+    mapping = mmap(NULL, bytes + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+        return 1;
+
+    /* The guard page splits the mapping in two, which the OS may refuse */
+    if (mprotect(mapping + bytes, page, PROT_NONE) != 0)
+    {
+        munmap(mapping, bytes + page);
+        return 1;
+    }
+
+    /* The last entry is right below the guard page */
+    *stack = (Stack) {.pointer = 0, .primdata_arr = (PrimitiveData *) (mapping + bytes) - size, .size = size,
+                      .mapping = mapping, .length = bytes + page};
+    return 0;
 }
 
 int stk_finalise(Stack *stack)
 {
-    free(stack->primdata_arr);
+    if (stack->mapping != NULL)
+        munmap(stack->mapping, stack->length);
+    stack->mapping = NULL;
+    stack->primdata_arr = NULL;
     return 0;
 }
 
 stackva_t stk_push(Stack *stack, PrimitiveData data)
 {
-    if (stack->pointer == STACK_SIZE)
-        pvm_reporterror(STACK_H, __FUNCTION__, "Stack overflow");
     stack->primdata_arr[stack->pointer] = data;
     return ++stack->pointer;
 }
@@ -39,7 +60,15 @@ stackva_t stk_pop(Stack *stack)
 
 PrimitiveData stk_peek(Stack stack)
 {
-    if (stack.pointer == STACK_SIZE)
+    if (stack.pointer == 0)
         pvm_reporterror(STACK_H, __FUNCTION__, "Stack underflow");
     return stack.primdata_arr[stack.pointer - 1];
 }
+
+bool stk_guarded(const Stack *stack, const void *addr)
+{
+    const char *guard = (const char *) (stack->primdata_arr + stack->size);
+
+    return stack->mapping != NULL && (const char *) addr >= guard &&
+           (const char *) addr < (const char *) stack->mapping + stack->length;
+}
@@ -15,7 +15,7 @@
 
 int ssg_initialise(StaticSeg *staticseg, FILE * fp)
 {
-    int type;
+    uint8_t type;
     size_t totaldata = 0;
 
     /* Initialise staticseg */
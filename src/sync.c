@@ -0,0 +1,215 @@
+/*******************************************************************************
+ * File             : sync.c
+ * Path             : pvm/src
+ * Author           : Muhammad Adriano Raksi
+ * Created          : 17-10-26 (DD-MM-YY)
+ *------------------------------------------------------------------------------
+ * Contains the implementation of the VM's synchronisation objects. Blocked
+ * threads wait in a list of their object and are released with sch_release,
+ * so they hold no worker while they wait.
+ ******************************************************************************/
+
+#include "../include/sync.h"
+#include "../include/vm.h"
+
+int syn_initialise(Sync *sync)
+{
+    sync->state = SYN_UNLOCKED;
+    sync->owner = sync->head = sync->tail = SCH_NIL;
+    sync->arrived = 0;
+
+    return 0;
+}
+
+/* Returns the object with the given ID */
+static Sync *syn_fetch(VM *vm, va_t id)
+{
+    if (id >= SYNC_LIMIT)
+        pvm_reporterror(SYNC_H, __FUNCTION__, "No such synchronisation object");
+
+    return &vm->core.sync[id];
+}
+
+/* Puts a thread at the back of the threads blocked on an object */
+static void syn_push(Thread *pool, Sync *sync, va_t tid)
+{
+    pool[tid].link = SCH_NIL;
+    if (sync->tail == SCH_NIL)
+        __atomic_store_n(&sync->head, tid, __ATOMIC_RELAXED);
+    else
+        pool[sync->tail].link = tid;
+    sync->tail = tid;
+}
+
+/* Takes the thread at the front of the threads blocked on an object, SCH_NIL if none */
+static va_t syn_pop(Thread *pool, Sync *sync)
+{
+    va_t tid = sync->head;
+
+    if (tid == SCH_NIL)
+        return SCH_NIL;
+    __atomic_store_n(&sync->head, pool[tid].link, __ATOMIC_RELAXED);
+    if (sync->head == SCH_NIL)
+        sync->tail = SCH_NIL;
+
+    return tid;
+}
+
+/*
+ * Gives a contended mutex its next holder, or leaves it unlocked when nobody
+ * waits. Called with the core lock held, by the thread that releases it.
+ */
+static void syn_handoff(VM *vm, Sync *mutex)
+{
+    va_t next = syn_pop(vm->core.thread_pool, mutex);
+
+    if (next == SCH_NIL)
+    {
+        __atomic_store_n(&mutex->state, SYN_UNLOCKED, __ATOMIC_RELEASE);
+        return;
+    }
+
+    /* The mutex never looks unlocked in between, so no other thread takes it */
+    __atomic_store_n(&mutex->owner, next, __ATOMIC_RELAXED);
+    if (mutex->head == SCH_NIL)
+        __atomic_store_n(&mutex->state, SYN_LOCKED, __ATOMIC_RELAXED);
+    sch_release(&vm->core.scheduler, vm->core.thread_pool, next);
+}
+
+/*
+ * Makes a blocked thread take a mutex, or wait for it in its list. Called with
+ * the core lock held. Returns whether the thread got the mutex.
+ */
+static bool syn_acquire(VM *vm, Sync *mutex, va_t tid)
+{
+    /* Either it was released since, or its holder finds it contended */
+    if (__atomic_exchange_n(&mutex->state, SYN_CONTENDED, __ATOMIC_ACQUIRE) == SYN_UNLOCKED)
+    {
+        __atomic_store_n(&mutex->owner, tid, __ATOMIC_RELAXED);
+        return true;
+    }
+    syn_push(vm->core.thread_pool, mutex, tid);
+
+    return false;
+}
+
+int syn_lock(VM *vm, va_t tid, va_t id)
+{
+    Sync *mutex = syn_fetch(vm, id);
+    uint32_t expected = SYN_UNLOCKED;
+
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) == tid)
+        return pvm_reporterror(SYNC_H, __FUNCTION__, "Mutex already held by the thread");
+
+    /* Uncontended, without the core lock */
+    if (__atomic_compare_exchange_n(&mutex->state, &expected, SYN_LOCKED, false, __ATOMIC_ACQUIRE,
+                                    __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&mutex->owner, tid, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    core_lock(vm);
+    if (syn_acquire(vm, mutex, tid))
+    {
+        core_unlock(vm);
+        return 0;
+    }
+    thr_block(vm, tid);
+    core_unlock(vm);
+
+    return 1;
+}
+
+int syn_unlock(VM *vm, va_t tid, va_t id)
+{
+    Sync *mutex = syn_fetch(vm, id);
+    uint32_t expected = SYN_LOCKED;
+
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != tid)
+        return pvm_reporterror(SYNC_H, __FUNCTION__, "Mutex not held by the thread");
+
+    __atomic_store_n(&mutex->owner, SCH_NIL, __ATOMIC_RELAXED);
+    if (__atomic_compare_exchange_n(&mutex->state, &expected, SYN_UNLOCKED, false, __ATOMIC_RELEASE,
+                                    __ATOMIC_RELAXED))
+        return 0;
+
+    core_lock(vm);
+    syn_handoff(vm, mutex);
+    core_unlock(vm);
+
+    return 0;
+}
+
+int syn_wait(VM *vm, va_t tid, va_t cond, va_t id)
+{
+    Sync *condvar = syn_fetch(vm, cond), *mutex = syn_fetch(vm, id);
+    uint32_t expected = SYN_LOCKED;
+
+    if (__atomic_load_n(&mutex->owner, __ATOMIC_RELAXED) != tid)
+        return pvm_reporterror(SYNC_H, __FUNCTION__, "Mutex not held by the thread");
+    if (cond == id)
+        return pvm_reporterror(SYNC_H, __FUNCTION__, "A mutex cannot be its own condition variable");
+
+    /* Signals take the core lock too, so none comes before the thread waits */
+    core_lock(vm);
+    vm->core.thread_pool[tid].relock = id;
+    syn_push(vm->core.thread_pool, condvar, tid);
+    thr_block(vm, tid);
+
+    __atomic_store_n(&mutex->owner, SCH_NIL, __ATOMIC_RELAXED);
+    if (!__atomic_compare_exchange_n(&mutex->state, &expected, SYN_UNLOCKED, false, __ATOMIC_RELEASE,
+                                     __ATOMIC_RELAXED))
+        syn_handoff(vm, mutex);
+    core_unlock(vm);
+
+    return 0;
+}
+
+int syn_signal(VM *vm, va_t cond, bool all)
+{
+    Sync *condvar = syn_fetch(vm, cond);
+    Thread *pool = vm->core.thread_pool;
+    va_t tid;
+
+    /* Waiters queue under the mutex the signalling thread is expected to hold */
+    if (__atomic_load_n(&condvar->head, __ATOMIC_RELAXED) == SCH_NIL)
+        return 0;
+
+    core_lock(vm);
+    while ((tid = syn_pop(pool, condvar)) != SCH_NIL)
+    {
+        /* Runs once it holds the mutex again, it waits for it otherwise */
+        if (syn_acquire(vm, &vm->core.sync[pool[tid].relock], tid))
+            sch_release(&vm->core.scheduler, pool, tid);
+        if (!all)
+            break;
+    }
+    core_unlock(vm);
+
+    return 0;
+}
+
+int syn_barrier(VM *vm, va_t tid, va_t id, uint32_t count)
+{
+    Sync *barrier = syn_fetch(vm, id);
+    Thread *pool = vm->core.thread_pool;
+    va_t waiter;
+
+    core_lock(vm);
+    if (++barrier->arrived < count)
+    {
+        syn_push(pool, barrier, tid);
+        thr_block(vm, tid);
+        core_unlock(vm);
+        return 1;
+    }
+
+    /* The last thread to arrive opens the barrier for the others */
+    barrier->arrived = 0;
+    while ((waiter = syn_pop(pool, barrier)) != SCH_NIL)
+        sch_release(&vm->core.scheduler, pool, waiter);
+    core_unlock(vm);
+
+    return 0;
+}
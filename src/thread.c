@@ -10,23 +10,199 @@
 
 #include "../include/thread.h"
 #include "../include/vm.h"
+#include <limits.h>
+#include <float.h>
+#include <string.h>
 
-int thr_spawn(VM *vm, va_t instrpointreg)
+/*
+ * Takes a free slot, the last one given back or else a new one, and queues a
+ * thread in it to start at a decoded instruction with a stack of the given
+ * number of entries. Called with the core lock held.
+ */
+static va_t thr_create(VM *vm, va_t index, size_t stacksize)
 {
+    Core *core = &vm->core;
     va_t i;
     Thread *tmp;
 
-    /* Find an uninitialised thread */
-    for (i = 0x0; vm->core.thread_pool[i].flag != THR_UNINIT; i++);
+    /* Every thread alive holds a stack, two mappings of the OS */
+    if (__atomic_load_n(&core->thread_num, __ATOMIC_RELAXED) >= core->thread_limit)
+        return pvm_reporterror(THREAD_H, __FUNCTION__, "Thread limit reached");
+
+    if (core->thread_free != SCH_NIL)
+    {
+        i = core->thread_free;
+        core->thread_free = core->thread_pool[i].link;
+    }
+    else if (core->thread_top < THREAD_LIMIT)
+        i = core->thread_top;
+    else
+        return pvm_reporterror(THREAD_H, __FUNCTION__, "Thread limit reached");
 
     /* Initialise thread */
-    tmp = &vm->core.thread_pool[i];
+    tmp = &core->thread_pool[i];
     tmp->flag = THR_ALIVE;
-    tmp->countdown = 0;
+    tmp->wakeup = 0;
+    tmp->waiters = SCH_NIL;
+    tmp->parent = SCH_NIL;
+    tmp->stacksize = stacksize;
+    tmp->holds = THR_HOLD_WORKER | THR_HOLD_JOIN;
     tmp->controlunit.progcountreg = 0;
-    tmp->controlunit.instrpointreg = instrpointreg;
+    tmp->controlunit.instrpointreg = index;
+
+    /* The mappings of the heap count against the same limit of the OS */
+    if (stk_initialise(&tmp->stack, stacksize) != 0)
+        return pvm_reporterror(THREAD_H, __FUNCTION__, "Thread limit reached");
+
+    /* The slot is set up before the signal handler and thr_slot look at it */
+    if (i == core->thread_top)
+        __atomic_store_n(&core->thread_top, i + 1, __ATOMIC_RELEASE);
+
+    /* Runs after the threads that are runnable already */
+    sch_ready(&core->scheduler, core->thread_pool, i);
+    __atomic_fetch_add(&core->thread_num, 1, __ATOMIC_RELAXED);
+
+    return i;
+}
+
+int thr_spawn(VM *vm, va_t instrpointreg)
+{
+    va_t index = csg_locate(&vm->codeseg, instrpointreg);
 
-    vm->core.thread_num++;
+    /* Workers may spawn threads at the same time */
+    core_lock(vm);
+    thr_create(vm, index, vm->core.stack_size);
+    core_unlock(vm);
+
+    return 0;
+}
+
+va_t thr_fork(VM *vm, va_t tid, va_t index)
+{
+    va_t i;
+
+    core_lock(vm);
+    i = thr_create(vm, index, vm->core.thread_pool[tid].stacksize);
+
+    /* The registers are copied before the new thread can run anywhere */
+    memcpy(vm->core.thread_pool[i].controlunit.regfile, vm->core.thread_pool[tid].controlunit.regfile,
+           sizeof(vm->core.thread_pool[i].controlunit.regfile));
+    core_unlock(vm);
+
+    return i;
+}
+
+/* Claims the next chunk of the PARFOR of a parent, the first index of it or the end if none is left */
+static int64_t thr_claimchunk(Thread *parent)
+{
+    int64_t from = __atomic_fetch_add(&parent->chunknext, parent->chunkgrain, __ATOMIC_RELAXED);
+
+    return from < parent->chunkend ? from : parent->chunkend;
+}
+
+/* Sets a thread of the PARFOR of a parent up to perform the chunk starting at an index */
+static void thr_startchunk(Thread *chunk, Thread *parent, int64_t from)
+{
+    /* The parent waits until every thread of the PARFOR halted, its registers stay as they were */
+    memcpy(chunk->controlunit.regfile, parent->controlunit.regfile, sizeof(chunk->controlunit.regfile));
+    chunk->controlunit.genpreg[0].storage = I32;
+    chunk->controlunit.genpreg[0].i32 = from;
+    chunk->controlunit.genpreg[1].storage = I32;
+    chunk->controlunit.genpreg[1].i32 = from + parent->chunkgrain < parent->chunkend ?
+                                        from + parent->chunkgrain : parent->chunkend;
+    chunk->controlunit.instrpointreg = parent->chunkbody;
+    chunk->stack.pointer = 0;
+}
+
+/* Spawns a thread for a chunk of the PARFOR of a parent, called with the core lock held */
+static void thr_spawnchunk(VM *vm, va_t tid, int64_t from)
+{
+    Thread *parent = &vm->core.thread_pool[tid], *chunk;
+    va_t i = thr_create(vm, parent->chunkbody, parent->stacksize);
+
+    chunk = &vm->core.thread_pool[i];
+    thr_startchunk(chunk, parent, from);
+    chunk->parent = tid;
+    chunk->holds = THR_HOLD_WORKER;
+    parent->pending++;
+}
+
+int thr_parfor(VM *vm, va_t tid, va_t index, int32_t start, int32_t end, int32_t grain)
+{
+    Thread *tmp = &vm->core.thread_pool[tid];
+    int64_t chunks, threads;
+
+    if (start >= end)
+        return 0;
+    if (grain < 1)
+        grain = ((int64_t) end - start + vm->core.worker_num - 1) / vm->core.worker_num;
+
+    /* A few threads per worker take the chunks in turn, however many there are */
+    chunks = ((int64_t) end - start + grain - 1) / grain;
+    threads = (int64_t) THR_PARFOR_SPREAD * vm->core.worker_num;
+    if (threads > chunks)
+        threads = chunks;
+    tmp->chunknext = start;
+    tmp->chunkend = end;
+    tmp->chunkgrain = grain;
+    tmp->chunkbody = index;
+
+    /* Counts the parent too, until its worker parks it */
+    core_lock(vm);
+    tmp->pending = 1;
+    for (int64_t n = 0; n < threads; n++)
+        thr_spawnchunk(vm, tid, thr_claimchunk(tmp));
+    core_unlock(vm);
+
+    tmp->joining = tid;
+    tmp->flag |= THR_WAIT;
+
+    return 1;
+}
+
+int thr_nextchunk(VM *vm, va_t tid)
+{
+    Thread *tmp = &vm->core.thread_pool[tid], *parent;
+    int64_t from;
+
+    if (tmp->parent == SCH_NIL)
+        return 0;
+
+    parent = &vm->core.thread_pool[tmp->parent];
+    from = thr_claimchunk(parent);
+    if (from == parent->chunkend)
+        return 0;
+    thr_startchunk(tmp, parent, from);
+
+    return 1;
+}
+
+int thr_handoff(VM *vm, va_t tid)
+{
+    Thread *tmp = &vm->core.thread_pool[tid], *parent;
+    int64_t from;
+
+    if (tmp->parent == SCH_NIL)
+        return 0;
+
+    /* The chunks left would otherwise wait behind the one that waits */
+    parent = &vm->core.thread_pool[tmp->parent];
+    from = thr_claimchunk(parent);
+    if (from == parent->chunkend)
+        return 0;
+    thr_spawnchunk(vm, tmp->parent, from);
+
+    return 1;
+}
+
+int thr_block(VM *vm, va_t tid)
+{
+    Thread *tmp = &vm->core.thread_pool[tid];
+
+    /* Released once by whoever wakes it up, and once when its worker parks it */
+    tmp->pending = 2;
+    tmp->joining = tid;
+    tmp->flag |= THR_WAIT;
 
     return 0;
 }
@@ -34,40 +210,741 @@ int thr_spawn(VM *vm, va_t instrpointreg)
 int thr_kill(VM *vm, va_t tid)
 {
     Thread *tmp = &vm->core.thread_pool[tid];
+    uint8_t flag = tmp->flag;
 
     /* Check if thread is dead already */
-    if (tmp->flag & THR_DEAD)
+    if (flag & THR_DEAD)
         return pvm_reporterror(THREAD_H, __FUNCTION__, NULL);
 
-    if (tmp->flag & THR_RUN)
-        tmp->flag = THR_DEAD;
+    /* A queued, sleeping or waiting thread is dropped once the scheduler reaches it */
+    stk_finalise(&tmp->stack);
+    heap_flush(&vm->heap, &tmp->heapcache);
+    __atomic_store_n(&tmp->flag, THR_DEAD, __ATOMIC_RELEASE);
+
+    /* Joins that wait for it carry on, under the lock they queue themselves with */
+    core_lock(vm);
+    sch_wake(&vm->core.scheduler, vm->core.thread_pool, tid);
+    if (tmp->parent != SCH_NIL)
+        sch_release(&vm->core.scheduler, vm->core.thread_pool, tmp->parent);
+
+    /*
+     * Only a thread in the timer wheel or waiting was not counted as runnable.
+     * It stops counting once the threads it wakes count, so no worker finds
+     * nothing left to run in between.
+     */
+    if (flag != THR_SLEEP && flag != THR_WAIT)
+        __atomic_fetch_sub(&vm->core.scheduler.runnable, 1, __ATOMIC_SEQ_CST);
+    core_unlock(vm);
+
+    __atomic_fetch_sub(&vm->core.thread_num, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int thr_reap(VM *vm, va_t tid, uint8_t hold)
+{
+    Core *core = &vm->core;
+    Thread *tmp = &core->thread_pool[tid];
+
+    core_lock(vm);
+    if (tmp->holds != 0)
+    {
+        tmp->holds &= ~hold;
+        if (tmp->holds == 0)
+        {
+            /* Stale IDs of the slot no longer match */
+            tmp->generation++;
+            tmp->flag = THR_UNINIT;
+            tmp->link = core->thread_free;
+            core->thread_free = tid;
+        }
+    }
+    core_unlock(vm);
 
-    vm->core.thread_num--;
     return 0;
 }
 
-int thr_run(VM *vm, va_t tid)
+int32_t thr_id(VM *vm, va_t tid)
 {
+    /* THREAD_LIMIT takes the 16 bits below, 15 are left for the generation */
+    return (int32_t) (tid | (va_t) (vm->core.thread_pool[tid].generation & 0x7FFF) << 16);
+}
+
+va_t thr_slot(VM *vm, int64_t id)
+{
+    va_t tid = (va_t) id & (THREAD_LIMIT - 1);
+
+    if (id < 0 || tid >= __atomic_load_n(&vm->core.thread_top, __ATOMIC_ACQUIRE) || thr_id(vm, tid) != id)
+        return pvm_reporterror(THREAD_H, __FUNCTION__, "No such thread");
+
+    return tid;
+}
+
+vmclock_t thr_run(VM *vm, va_t tid)
+{
+    /* Threaded code: every opcode owns a label, dispatched by address */
+    static const void *dispatch[256] =
+    {
+        [0x00 ... 0xFF] = &&op_ILLEGAL,
+
+        [0x00] = &&op_NOP, &&op_HLT,
+        [0x02] = &&op_LOAD, &&op_MOVE, &&op_CAST,
+        [0x05] = &&op_PUSH, &&op_POP, &&op_PUT, &&op_PEEK,
+        [0x09] = &&op_MALLOC, &&op_CALLOC, &&op_REALLOC, &&op_FREE, &&op_STORE, &&op_GET,
+        [0x0F] = &&op_ALLOC_STATIC, &&op_STORE_STATIC, &&op_GET_STATIC,
+        [0x12] = &&op_JUMP, &&op_JUMP_IF_TRUE, &&op_JUMP_IF_FALSE,
+        [0x15] = &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_MOD, &&op_AND, &&op_XOR, &&op_OR, &&op_NOT, &&op_LSHIFT, &&op_RSHIFT,
+        [0x20] = &&op_LESS, &&op_LESS_EQ, &&op_GREAT, &&op_GREAT_EQ, &&op_EQUAL, &&op_N_EQUAL, &&op_LOG_AND, &&op_LOG_OR, &&op_LOG_NOT,
+        [0x29] = &&op_STAMP,
+
+        /* Forms with a destination register share the labels */
+        [0x2A] = &&op_ADD, &&op_SUB, &&op_MUL, &&op_DIV, &&op_MOD, &&op_AND, &&op_XOR, &&op_OR, &&op_NOT, &&op_LSHIFT, &&op_RSHIFT,
+        [0x35] = &&op_LESS, &&op_LESS_EQ, &&op_GREAT, &&op_GREAT_EQ, &&op_EQUAL, &&op_N_EQUAL, &&op_LOG_AND, &&op_LOG_OR, &&op_LOG_NOT,
+
+        /* Immediate forms quicken on their own, the rest share the labels */
+        [0x3E] = &&op_ADDI, &&op_SUBI, &&op_MULI, &&op_DIV, &&op_MOD, &&op_AND, &&op_XOR, &&op_OR,
+        [0x47] = &&op_LSHIFT, &&op_RSHIFT,
+        [0x49] = &&op_LESSI, &&op_LESS_EQI, &&op_GREATI, &&op_GREAT_EQI, &&op_EQUALI, &&op_N_EQUALI,
+        [0x4F] = &&op_STOREI, &&op_GETI,
+        [0x51] = &&op_BLT, &&op_BLE, &&op_BGT, &&op_BGE, &&op_BEQ, &&op_BNE,
+        [0x57] = &&op_BLTI, &&op_BLEI, &&op_BGTI, &&op_BGEI, &&op_BEQI, &&op_BNEI,
+        [0x5D] = &&op_SWITCH, &&op_SPAWN, &&op_JOIN, &&op_YIELD, &&op_SELF, &&op_PARFOR,
+        [0x63] = &&op_MUTEX_LOCK, &&op_MUTEX_UNLOCK, &&op_COND_WAIT, &&op_COND_SIGNAL, &&op_COND_BROADCAST,
+                 &&op_BARRIER, &&op_SLEEP_NS,
+        [0x6A] = &&op_ATOMIC_LOAD, &&op_ATOMIC_STORE, &&op_ATOMIC_XCHG, &&op_ATOMIC_FETCH_ADD, &&op_ATOMIC_CAS,
+        [0x6F] = &&op_ATOMIC_LOAD_STATIC, &&op_ATOMIC_STORE_STATIC, &&op_ATOMIC_XCHG_STATIC,
+                 &&op_ATOMIC_FETCH_ADD_STATIC, &&op_ATOMIC_CAS_STATIC,
+        [0x74] = &&op_CHAN_NEW, &&op_CHAN_SEND, &&op_CHAN_RECV, &&op_CHAN_TRY_SEND, &&op_CHAN_TRY_RECV,
+                 &&op_CHAN_SEND_N, &&op_CHAN_RECV_N, &&op_SPAWN_STACK, &&op_MALLOC_TYPED,
+        [0x7D] = &&op_FLAT_MALLOC, &&op_FLAT_FREE, &&op_FLAT_STORE, &&op_FLAT_GET,
+                 &&op_MALLOC_HANDLE, &&op_FREE_HANDLE, &&op_STORE_HANDLE, &&op_GET_HANDLE,
+
+        /* Superinstructions, in the order of opc_Fusion */
+        [0xF0] = &&op_LESS_JUMP_IF_TRUE, &&op_LESS_EQ_JUMP_IF_TRUE, &&op_GREAT_JUMP_IF_TRUE,
+                 &&op_GREAT_EQ_JUMP_IF_TRUE, &&op_EQUAL_JUMP_IF_TRUE, &&op_N_EQUAL_JUMP_IF_TRUE,
+        [0xF6] = &&op_LESS_JUMP_IF_FALSE, &&op_LESS_EQ_JUMP_IF_FALSE, &&op_GREAT_JUMP_IF_FALSE,
+                 &&op_GREAT_EQ_JUMP_IF_FALSE, &&op_EQUAL_JUMP_IF_FALSE, &&op_N_EQUAL_JUMP_IF_FALSE,
+        [0xFC] = &&op_ADD_MOVE, &&op_SUB_MOVE, &&op_LOAD_ADD, &&op_GET_ADD_STORE
+    };
+
     Thread *tmp = &vm->core.thread_pool[tid];
 
-    if (tmp->flag & (THR_DEAD) || ((tmp->flag & THR_SLEEP) && tmp->countdown > 0))
-        return core_managethread(vm, tid);
+    if (tmp->flag & (THR_DEAD | THR_SLEEP | THR_WAIT))
+        return 0;
 
-    vm->core.running_thread = tid;
     tmp->flag = THR_RUN;
-    tmp->controlunit.progcountreg++;
-    tmp->controlunit.instrreg = vm->codeseg.content[tmp->controlunit.instrpointreg++];
-// printf("%d\n", tmp->controlunit.instrreg);
-    opc_Execute[tmp->controlunit.instrreg](vm, tid); /* Actual VM operation */
 
-    return core_cycle(vm, tid);
+    /*
+     * Resolve the handler of every decoded instruction on the first run, by
+     * the first worker to get there. A profiled run counts every instruction
+     * before dispatching it.
+     */
+    if (!__atomic_load_n(&vm->codeseg.linked, __ATOMIC_ACQUIRE))
+    {
+        core_lock(vm);
+        if (!vm->codeseg.linked)
+            for (va_t i = 0; i <= vm->codeseg.length; i++)
+                vm->codeseg.instr[i].handler = vm->codeseg.profile != NULL ? &&op_PROFILE :
+                                               dispatch[vm->codeseg.instr[i].opcode];
+        __atomic_store_n(&vm->codeseg.linked, true, __ATOMIC_RELEASE);
+        core_unlock(vm);
+    }
+
+    /* Keep the hot state of the thread in locals until the next switch point */
+    ControlUnit *cu = &tmp->controlunit;
+    PrimitiveData *regfile = cu->regfile;
+    Instruction *instr = vm->codeseg.instr;
+    Instruction *pc = &instr[cu->instrpointreg];
+    vmclock_t retired = 0;
+    va_t index_address;
+    int64_t value;
+    double dvalue;
+
+/*
+ * Dispatch the instruction pc points to. Other workers may quicken it at the
+ * same time, the handler is loaded atomically so either address is whole.
+ */
+#define DISPATCH()\
+    do\
+    {\
+        retired++;\
+        goto *__atomic_load_n(&pc->handler, __ATOMIC_RELAXED);\
+    } while (0)
+
+/* Move on to the next instruction */
+#define NEXT()\
+    do\
+    {\
+        pc++;\
+        DISPATCH();\
+    } while (0)
+
+/* Perform the instruction with its opcode function, which may move pc */
+#define EXECUTE(handler)\
+    do\
+    {\
+        cu->instrreg = pc->opcode;\
+        cu->instrpointreg = pc - instr + 1;\
+        handler(vm, tid);\
+        pc = &instr[cu->instrpointreg];\
+    } while (0)
+
+/* Second operand of a binary instruction, and of its immediate form */
+#define OPERAND     regfile[pc->reg[1]]
+#define LITERAL     pc->data
+
+/*
+ * Quickening: the first time a generic arithmetic or relational instruction is
+ * performed, it is rewritten in place into the variant specialised for the
+ * types of its operands, if there is one. The variant guards the types it was
+ * specialised for and turns the instruction back into the generic opcode
+ * function for good when they change. Workers may rewrite an instruction at
+ * the same time, but every handler either of them stores performs it. The
+ * instructions are shared between workers, so handlers are stored atomically.
+ */
+#define REWRITE(label)\
+    __atomic_store_n(&pc->handler, &&label, __ATOMIC_RELAXED)
+
+#define QUICKEN(name, source)\
+    do\
+    {\
+        if (vm->codeseg.profile != NULL)\
+            break;\
+        if (regfile[pc->reg[0]].storage == (source).storage)\
+            switch (regfile[pc->reg[0]].storage)\
+            {\
+                case I32: REWRITE(op_##name##_I32); break;\
+                case I64: REWRITE(op_##name##_I64); break;\
+                case DBL: REWRITE(op_##name##_DBL); break;\
+                default: REWRITE(op_##name##_GENERIC); break;\
+            }\
+        else\
+            REWRITE(op_##name##_GENERIC);\
+    } while (0)
+
+#define GUARD(name, type, source)\
+    do\
+    {\
+        if (regfile[pc->reg[0]].storage != (type) || (source).storage != (type))\
+        {\
+            REWRITE(op_##name##_GENERIC);\
+            goto op_##name##_GENERIC;\
+        }\
+    } while (0)
+
+/* Wraps around on overflow and underflow the same way ADD, SUB and MUL do */
+#define WRAP(result, value, min, max)\
+    (result) = (value) > (max) ? (min) + ((value) - (max)) :\
+               (value) < (min) ? (max) + ((value) - (min)) :\
+               (value)
+
+/*
+ * WRAP for I32 results computed in 64 bits. A product can wrap around more
+ * than once. The generic opcode functions then convert an out of range double
+ * back, which gives INT_MIN on x86-64, so that is the result here too.
+ */
+#define WRAP_I32(result, value)\
+    do\
+    {\
+        WRAP(value, value, INT_MIN, INT_MAX);\
+        (result) = (value) < INT_MIN || (value) > INT_MAX ? INT_MIN : (value);\
+    } while (0)
+
+/*
+ * Specialised arithmetic. Integers are computed in 64 bits, which holds any
+ * 32-bit result exactly. 64-bit integers go through a double like they do in
+ * the generic opcode functions, so results stay identical.
+ */
+#define ARITHMETIC(name, op, source)\
+op_##name##_I32:\
+    GUARD(name, I32, source);\
+    value = (int64_t) regfile[pc->reg[0]].i32 op (source).i32;\
+    regfile[pc->reg[2]].storage = I32;\
+    WRAP_I32(regfile[pc->reg[2]].i32, value);\
+    NEXT();\
+op_##name##_I64:\
+    GUARD(name, I64, source);\
+    dvalue = (double) regfile[pc->reg[0]].i64 op (double) (source).i64;\
+    regfile[pc->reg[2]].storage = I64;\
+    WRAP(regfile[pc->reg[2]].i64, dvalue, LONG_MIN, LONG_MAX);\
+    NEXT();\
+op_##name##_DBL:\
+    GUARD(name, DBL, source);\
+    dvalue = regfile[pc->reg[0]].dbl op (source).dbl;\
+    regfile[pc->reg[2]].storage = DBL;\
+    WRAP(regfile[pc->reg[2]].dbl, dvalue, DBL_MIN, DBL_MAX);\
+    NEXT();
+
+/* Specialised comparison, 64-bit integers are compared as doubles */
+#define RELATIONAL(name, op, source)\
+op_##name##_I32:\
+    GUARD(name, I32, source);\
+    value = regfile[pc->reg[0]].i32 op (source).i32;\
+    regfile[pc->reg[2]].storage = I8;\
+    regfile[pc->reg[2]].i8 = value;\
+    NEXT();\
+op_##name##_I64:\
+    GUARD(name, I64, source);\
+    value = (double) regfile[pc->reg[0]].i64 op (double) (source).i64;\
+    regfile[pc->reg[2]].storage = I8;\
+    regfile[pc->reg[2]].i8 = value;\
+    NEXT();\
+op_##name##_DBL:\
+    GUARD(name, DBL, source);\
+    value = regfile[pc->reg[0]].dbl op (source).dbl;\
+    regfile[pc->reg[2]].storage = I8;\
+    regfile[pc->reg[2]].i8 = value;\
+    NEXT();
+
+/*
+ * Whether the thread has used up its quantum while other threads wait. With
+ * several workers it also has to notice when the run is over.
+ */
+#define EXPIRED()\
+    (retired >= vm->core.scheduler.quantum &&\
+     (__atomic_load_n(&vm->core.thread_num, __ATOMIC_RELAXED) > 1 || vm->core.worker_num > 1))
+
+/*
+ * Transfer control to the instruction at index. This is a switch point, but
+ * the run only ends there once the thread has used up its quantum and another
+ * thread could take over. Backward jumps and branches close loops, which the
+ * JIT counts and runs natively once they are hot.
+ */
+#define GO_TO(index)\
+    do\
+    {\
+        Instruction *from = pc;\
+        pc = &instr[index];\
+        if (EXPIRED())\
+            goto yield;\
+        if (pc <= from && vm->jit.enabled)\
+        {\
+            pc = &instr[jit_run(vm, tid, pc - instr, &retired)];\
+            if (EXPIRED())\
+                goto yield;\
+        }\
+        DISPATCH();\
+    } while (0)
+
+/* Transfer control to CODESEG_INDEX, a byte offset in the bytecode */
+#define JUMP_TO(offset)\
+    GO_TO(csg_locate(&vm->codeseg, offset))
+
+/*
+ * Compare-and-branch. The generic form compares like the relational opcode
+ * functions do, the specialised ones like RELATIONAL.
+ */
+#define BRANCH(name, op, source)\
+op_##name##_GENERIC:\
+    if (DATA_RETRIEVER(regfile[pc->reg[0]]) op DATA_RETRIEVER(source))\
+        GO_TO(pc->target);\
+    NEXT();\
+op_##name##_I32:\
+    GUARD(name, I32, source);\
+    if (regfile[pc->reg[0]].i32 op (source).i32)\
+        GO_TO(pc->target);\
+    NEXT();\
+op_##name##_I64:\
+    GUARD(name, I64, source);\
+    if ((double) regfile[pc->reg[0]].i64 op (double) (source).i64)\
+        GO_TO(pc->target);\
+    NEXT();\
+op_##name##_DBL:\
+    GUARD(name, DBL, source);\
+    if (regfile[pc->reg[0]].dbl op (source).dbl)\
+        GO_TO(pc->target);\
+    NEXT();
+
+/*
+ * Superinstructions. The first instruction of a frequent sequence performs the
+ * whole sequence, saving the dispatches in between. The rest of the sequence
+ * stays in place for jumps that land inside it. Each part has an inline I32
+ * path and calls its opcode function otherwise.
+ */
+
+/* Performs the arithmetic instruction at pc and moves pc past it */
+#define FUSED_ARITHMETIC(name, op)\
+    do\
+    {\
+        if (regfile[pc->reg[0]].storage == I32 && regfile[pc->reg[1]].storage == I32)\
+        {\
+            value = (int64_t) regfile[pc->reg[0]].i32 op regfile[pc->reg[1]].i32;\
+            regfile[pc->reg[2]].storage = I32;\
+            WRAP_I32(regfile[pc->reg[2]].i32, value);\
+            pc++;\
+        }\
+        else\
+            EXECUTE(name);\
+    } while (0)
+
+/* Relational instruction followed by a conditional jump */
+#define COMPARE_BRANCH(name, op, jump, condition)\
+op_##name##_##jump:\
+    retired++;\
+    if (regfile[pc->reg[0]].storage == I32 && regfile[pc->reg[1]].storage == I32)\
+    {\
+        cu->aritreg.storage = I8;\
+        cu->aritreg.i8 = regfile[pc->reg[0]].i32 op regfile[pc->reg[1]].i32;\
+        pc++;\
+    }\
+    else\
+        EXECUTE(name);\
+    if (cu->aritreg.i8 == (condition))\
+        JUMP_TO(DATA_RETRIEVER_INT(regfile[pc->reg[0]]));\
+    NEXT();
+
+/* Arithmetic instruction followed by a MOVE, usually of its result */
+#define ARITHMETIC_MOVE(name, op)\
+op_##name##_MOVE:\
+    retired++;\
+    FUSED_ARITHMETIC(name, op);\
+    regfile[pc->reg[1]] = regfile[pc->reg[0]];\
+    NEXT();
+
+    DISPATCH();
+
+op_NOP:
+    NEXT();
+
+op_HLT:                 EXECUTE(HLT);
+    goto yield;
+
+op_LOAD:                EXECUTE(LOAD);          DISPATCH();
+op_CAST:                EXECUTE(CAST);          DISPATCH();
+op_PUSH:                EXECUTE(PUSH);          DISPATCH();
+op_POP:                 EXECUTE(POP);           DISPATCH();
+op_PUT:                 EXECUTE(PUT);           DISPATCH();
+op_PEEK:                EXECUTE(PEEK);          DISPATCH();
+op_MALLOC:              EXECUTE(MALLOC);        DISPATCH();
+op_CALLOC:              EXECUTE(CALLOC);        DISPATCH();
+op_REALLOC:             EXECUTE(REALLOC);       DISPATCH();
+op_FREE:                EXECUTE(FREE);          DISPATCH();
+op_STORE:               EXECUTE(STORE);         DISPATCH();
+op_GET:                 EXECUTE(GET);           DISPATCH();
+op_ALLOC_STATIC:        EXECUTE(ALLOC_STATIC);  DISPATCH();
+op_STORE_STATIC:        EXECUTE(STORE_STATIC);  DISPATCH();
+op_GET_STATIC:          EXECUTE(GET_STATIC);    DISPATCH();
+op_ADD:                 QUICKEN(ADD, OPERAND);
+op_ADD_GENERIC:         EXECUTE(ADD);           DISPATCH();
+op_SUB:                 QUICKEN(SUB, OPERAND);
+op_SUB_GENERIC:         EXECUTE(SUB);           DISPATCH();
+op_MUL:                 QUICKEN(MUL, OPERAND);
+op_MUL_GENERIC:         EXECUTE(MUL);           DISPATCH();
+op_DIV:                 EXECUTE(DIV);           DISPATCH();
+op_MOD:                 EXECUTE(MOD);           DISPATCH();
+op_AND:                 EXECUTE(AND);           DISPATCH();
+op_XOR:                 EXECUTE(XOR);           DISPATCH();
+op_OR:                  EXECUTE(OR);            DISPATCH();
+op_NOT:                 EXECUTE(NOT);           DISPATCH();
+op_LSHIFT:              EXECUTE(LSHIFT);        DISPATCH();
+op_RSHIFT:              EXECUTE(RSHIFT);        DISPATCH();
+op_LESS:                QUICKEN(LESS, OPERAND);
+op_LESS_GENERIC:        EXECUTE(LESS);          DISPATCH();
+op_LESS_EQ:             QUICKEN(LESS_EQ, OPERAND);
+op_LESS_EQ_GENERIC:     EXECUTE(LESS_EQ);       DISPATCH();
+op_GREAT:               QUICKEN(GREAT, OPERAND);
+op_GREAT_GENERIC:       EXECUTE(GREAT);         DISPATCH();
+op_GREAT_EQ:            QUICKEN(GREAT_EQ, OPERAND);
+op_GREAT_EQ_GENERIC:    EXECUTE(GREAT_EQ);      DISPATCH();
+op_EQUAL:               QUICKEN(EQUAL, OPERAND);
+op_EQUAL_GENERIC:       EXECUTE(EQUAL);         DISPATCH();
+op_N_EQUAL:             QUICKEN(N_EQUAL, OPERAND);
+op_N_EQUAL_GENERIC:     EXECUTE(N_EQUAL);       DISPATCH();
+op_LOG_AND:             EXECUTE(LOG_AND);       DISPATCH();
+op_LOG_OR:              EXECUTE(LOG_OR);        DISPATCH();
+op_LOG_NOT:             EXECUTE(LOG_NOT);       DISPATCH();
+op_ADDI:                QUICKEN(ADDI, LITERAL);
+op_ADDI_GENERIC:        EXECUTE(ADD);           DISPATCH();
+op_SUBI:                QUICKEN(SUBI, LITERAL);
+op_SUBI_GENERIC:        EXECUTE(SUB);           DISPATCH();
+op_MULI:                QUICKEN(MULI, LITERAL);
+op_MULI_GENERIC:        EXECUTE(MUL);           DISPATCH();
+op_LESSI:               QUICKEN(LESSI, LITERAL);
+op_LESSI_GENERIC:       EXECUTE(LESS);          DISPATCH();
+op_LESS_EQI:            QUICKEN(LESS_EQI, LITERAL);
+op_LESS_EQI_GENERIC:    EXECUTE(LESS_EQ);       DISPATCH();
+op_GREATI:              QUICKEN(GREATI, LITERAL);
+op_GREATI_GENERIC:      EXECUTE(GREAT);         DISPATCH();
+op_GREAT_EQI:           QUICKEN(GREAT_EQI, LITERAL);
+op_GREAT_EQI_GENERIC:   EXECUTE(GREAT_EQ);      DISPATCH();
+op_EQUALI:              QUICKEN(EQUALI, LITERAL);
+op_EQUALI_GENERIC:      EXECUTE(EQUAL);         DISPATCH();
+op_N_EQUALI:            QUICKEN(N_EQUALI, LITERAL);
+op_N_EQUALI_GENERIC:    EXECUTE(N_EQUAL);       DISPATCH();
+op_STOREI:              EXECUTE(STOREI);        DISPATCH();
+op_GETI:                EXECUTE(GETI);          DISPATCH();
+
+ARITHMETIC(ADD, +, OPERAND)
+ARITHMETIC(SUB, -, OPERAND)
+ARITHMETIC(MUL, *, OPERAND)
+ARITHMETIC(ADDI, +, LITERAL)
+ARITHMETIC(SUBI, -, LITERAL)
+ARITHMETIC(MULI, *, LITERAL)
+
+RELATIONAL(LESS, <, OPERAND)
+RELATIONAL(LESS_EQ, <=, OPERAND)
+RELATIONAL(GREAT, >, OPERAND)
+RELATIONAL(GREAT_EQ, >=, OPERAND)
+RELATIONAL(EQUAL, ==, OPERAND)
+RELATIONAL(N_EQUAL, !=, OPERAND)
+RELATIONAL(LESSI, <, LITERAL)
+RELATIONAL(LESS_EQI, <=, LITERAL)
+RELATIONAL(GREATI, >, LITERAL)
+RELATIONAL(GREAT_EQI, >=, LITERAL)
+RELATIONAL(EQUALI, ==, LITERAL)
+RELATIONAL(N_EQUALI, !=, LITERAL)
+
+op_MOVE:
+    /* Copy source register to destination register */
+    regfile[pc->reg[1]] = regfile[pc->reg[0]];
+    NEXT();
+
+op_FLAT_STORE:
+    /* One store from the base of the flat region, the opcode function reports a bad address */
+    index_address = DATA_RETRIEVER_INT(regfile[pc->reg[0]]);
+    if (index_address == 0 || index_address >= __atomic_load_n(&vm->heap.flattop, __ATOMIC_ACQUIRE))
+    {
+        EXECUTE(FLAT_STORE);
+        DISPATCH();
+    }
+    vm->heap.flat[index_address] = regfile[pc->reg[1]];
+    NEXT();
+
+op_FLAT_GET:
+    index_address = DATA_RETRIEVER_INT(regfile[pc->reg[0]]);
+    if (index_address == 0 || index_address >= __atomic_load_n(&vm->heap.flattop, __ATOMIC_ACQUIRE))
+    {
+        EXECUTE(FLAT_GET);
+        DISPATCH();
+    }
+    regfile[pc->reg[2]] = vm->heap.flat[index_address];
+    NEXT();
+
+op_JUMP:
+    /* Fetch CODESEG_INDEX from a register to which thread will jump to */
+    JUMP_TO(DATA_RETRIEVER_INT(regfile[pc->reg[0]]));
+
+op_JUMP_IF_TRUE:
+    index_address = DATA_RETRIEVER_INT(regfile[pc->reg[0]]);
+    if (DATA_RETRIEVER(cu->aritreg) == 1)
+        JUMP_TO(index_address);
+    NEXT();
+
+op_JUMP_IF_FALSE:
+    index_address = DATA_RETRIEVER_INT(regfile[pc->reg[0]]);
+    if (DATA_RETRIEVER(cu->aritreg) == 0)
+        JUMP_TO(index_address);
+    NEXT();
+
+op_BLT:                 QUICKEN(BLT, OPERAND);
+BRANCH(BLT, <, OPERAND)
+op_BLE:                 QUICKEN(BLE, OPERAND);
+BRANCH(BLE, <=, OPERAND)
+op_BGT:                 QUICKEN(BGT, OPERAND);
+BRANCH(BGT, >, OPERAND)
+op_BGE:                 QUICKEN(BGE, OPERAND);
+BRANCH(BGE, >=, OPERAND)
+op_BEQ:                 QUICKEN(BEQ, OPERAND);
+BRANCH(BEQ, ==, OPERAND)
+op_BNE:                 QUICKEN(BNE, OPERAND);
+BRANCH(BNE, !=, OPERAND)
+op_BLTI:                QUICKEN(BLTI, LITERAL);
+BRANCH(BLTI, <, LITERAL)
+op_BLEI:                QUICKEN(BLEI, LITERAL);
+BRANCH(BLEI, <=, LITERAL)
+op_BGTI:                QUICKEN(BGTI, LITERAL);
+BRANCH(BGTI, >, LITERAL)
+op_BGEI:                QUICKEN(BGEI, LITERAL);
+BRANCH(BGEI, >=, LITERAL)
+op_BEQI:                QUICKEN(BEQI, LITERAL);
+BRANCH(BEQI, ==, LITERAL)
+op_BNEI:                QUICKEN(BNEI, LITERAL);
+BRANCH(BNEI, !=, LITERAL)
+
+op_SWITCH:
+    /* The table was checked at load time, negative values wrap around past it */
+    index_address = DATA_RETRIEVER_INT(regfile[pc->reg[0]]);
+    GO_TO(index_address < pc->imm[1] ? vm->codeseg.table[pc->imm[0] + index_address] : pc->target);
+
+op_SPAWN:               EXECUTE(SPAWN);         DISPATCH();
+op_SELF:                EXECUTE(SELF);          DISPATCH();
+op_SPAWN_STACK:         EXECUTE(SPAWN_STACK);   DISPATCH();
+op_MALLOC_TYPED:        EXECUTE(MALLOC_TYPED);  DISPATCH();
+op_FLAT_MALLOC:         EXECUTE(FLAT_MALLOC);   DISPATCH();
+op_FLAT_FREE:           EXECUTE(FLAT_FREE);     DISPATCH();
+op_MALLOC_HANDLE:       EXECUTE(MALLOC_HANDLE); DISPATCH();
+op_FREE_HANDLE:         EXECUTE(FREE_HANDLE);   DISPATCH();
+op_STORE_HANDLE:        EXECUTE(STORE_HANDLE);  DISPATCH();
+op_GET_HANDLE:          EXECUTE(GET_HANDLE);    DISPATCH();
+
+op_JOIN:                EXECUTE(JOIN);          goto retry;
+op_CHAN_SEND:           EXECUTE(CHAN_SEND);     goto retry;
+op_CHAN_RECV:           EXECUTE(CHAN_RECV);     goto retry;
+op_CHAN_SEND_N:         EXECUTE(CHAN_SEND_N);   goto retry;
+op_CHAN_RECV_N:         EXECUTE(CHAN_RECV_N);
+retry:
+    /*
+     * Waits at the instruction, then performs it again. It was counted as it
+     * was dispatched and is counted again then, it only retires once.
+     */
+    if (tmp->flag & THR_WAIT)
+    {
+        retired--;
+        goto yield;
+    }
+    DISPATCH();
+
+op_YIELD:               EXECUTE(YIELD);
+    goto yield;
+
+op_PARFOR:              EXECUTE(PARFOR);        goto block;
+op_MUTEX_LOCK:          EXECUTE(MUTEX_LOCK);    goto block;
+op_COND_WAIT:           EXECUTE(COND_WAIT);     goto block;
+op_BARRIER:             EXECUTE(BARRIER);       goto block;
+op_SLEEP_NS:            EXECUTE(SLEEP_NS);
+block:
+    /* Carries on past the instruction once the thread stops waiting */
+    if (tmp->flag & THR_WAIT)
+        goto yield;
+    DISPATCH();
+
+op_MUTEX_UNLOCK:        EXECUTE(MUTEX_UNLOCK);  DISPATCH();
+op_COND_SIGNAL:         EXECUTE(COND_SIGNAL);   DISPATCH();
+op_COND_BROADCAST:      EXECUTE(COND_BROADCAST); DISPATCH();
+
+op_CHAN_NEW:            EXECUTE(CHAN_NEW);      DISPATCH();
+op_CHAN_TRY_SEND:       EXECUTE(CHAN_TRY_SEND); DISPATCH();
+op_CHAN_TRY_RECV:       EXECUTE(CHAN_TRY_RECV); DISPATCH();
+
+op_ATOMIC_LOAD:                 EXECUTE(ATOMIC_LOAD);               DISPATCH();
+op_ATOMIC_STORE:                EXECUTE(ATOMIC_STORE);              DISPATCH();
+op_ATOMIC_XCHG:                 EXECUTE(ATOMIC_XCHG);               DISPATCH();
+op_ATOMIC_FETCH_ADD:            EXECUTE(ATOMIC_FETCH_ADD);          DISPATCH();
+op_ATOMIC_CAS:                  EXECUTE(ATOMIC_CAS);                DISPATCH();
+op_ATOMIC_LOAD_STATIC:          EXECUTE(ATOMIC_LOAD_STATIC);        DISPATCH();
+op_ATOMIC_STORE_STATIC:         EXECUTE(ATOMIC_STORE_STATIC);       DISPATCH();
+op_ATOMIC_XCHG_STATIC:          EXECUTE(ATOMIC_XCHG_STATIC);        DISPATCH();
+op_ATOMIC_FETCH_ADD_STATIC:     EXECUTE(ATOMIC_FETCH_ADD_STATIC);   DISPATCH();
+op_ATOMIC_CAS_STATIC:           EXECUTE(ATOMIC_CAS_STATIC);         DISPATCH();
+
+op_STAMP:
+    /* The scheduler has not been told about this run yet, account for it */
+    regfile[pc->reg[0]].storage = UI64;
+    regfile[pc->reg[0]].ui64 = sch_stamp(&vm->core.scheduler) + retired - 1;
+    NEXT();
+
+COMPARE_BRANCH(LESS, <, JUMP_IF_TRUE, 1)
+COMPARE_BRANCH(LESS_EQ, <=, JUMP_IF_TRUE, 1)
+COMPARE_BRANCH(GREAT, >, JUMP_IF_TRUE, 1)
+COMPARE_BRANCH(GREAT_EQ, >=, JUMP_IF_TRUE, 1)
+COMPARE_BRANCH(EQUAL, ==, JUMP_IF_TRUE, 1)
+COMPARE_BRANCH(N_EQUAL, !=, JUMP_IF_TRUE, 1)
+COMPARE_BRANCH(LESS, <, JUMP_IF_FALSE, 0)
+COMPARE_BRANCH(LESS_EQ, <=, JUMP_IF_FALSE, 0)
+COMPARE_BRANCH(GREAT, >, JUMP_IF_FALSE, 0)
+COMPARE_BRANCH(GREAT_EQ, >=, JUMP_IF_FALSE, 0)
+COMPARE_BRANCH(EQUAL, ==, JUMP_IF_FALSE, 0)
+COMPARE_BRANCH(N_EQUAL, !=, JUMP_IF_FALSE, 0)
+
+ARITHMETIC_MOVE(ADD, +)
+ARITHMETIC_MOVE(SUB, -)
+
+op_LOAD_ADD:
+    retired++;
+    regfile[pc->reg[0]] = pc->data;
+    pc++;
+    FUSED_ARITHMETIC(ADD, +);
+    DISPATCH();
+
+op_GET_ADD_STORE:
+    retired += 2;
+    EXECUTE(GET);
+    FUSED_ARITHMETIC(ADD, +);
+    EXECUTE(STORE);
+    DISPATCH();
+
+op_PROFILE:
+    /* pvm --profile: count the instruction, then perform it as decoded */
+    __atomic_fetch_add(&vm->codeseg.profile[pc - instr], 1, __ATOMIC_RELAXED);
+    goto *dispatch[pc->opcode];
+
+op_ILLEGAL:
+    return pvm_reporterror(THREAD_H, __FUNCTION__, "Illegal instruction");
+
+yield:
+    /* Switch point, write the thread state back and let the core decide */
+    cu->instrpointreg = pc - instr;
+    cu->progcountreg += retired;
+
+#undef DISPATCH
+#undef NEXT
+#undef EXECUTE
+#undef OPERAND
+#undef LITERAL
+#undef REWRITE
+#undef QUICKEN
+#undef GUARD
+#undef WRAP
+#undef WRAP_I32
+#undef ARITHMETIC
+#undef RELATIONAL
+#undef EXPIRED
+#undef GO_TO
+#undef JUMP_TO
+#undef BRANCH
+#undef FUSED_ARITHMETIC
+#undef COMPARE_BRANCH
+#undef ARITHMETIC_MOVE
+
+    return retired;
 }
 
 int thr_sleep(VM *vm, va_t tid, vmclock_t cycle)
 {
     Thread *tmp = &vm->core.thread_pool[tid];
-    tmp->flag = THR_SLEEP;
-    tmp->countdown = cycle;
+    vmclock_t clocks = sch_stamp(&vm->core.scheduler);
+
+    /* A sleep past the end of the clock lasts until then */
+    tmp->wakeup = cycle > (vmclock_t) -1 - clocks ? (vmclock_t) -1 : clocks + cycle;
+
+    /* Its worker files it in the timer wheel at its next switch point */
+    tmp->flag |= THR_SLEEP;
 
     return 0;
 }
+
+int thr_join(VM *vm, va_t tid, va_t joined)
+{
+    Thread *tmp = &vm->core.thread_pool[tid];
+
+    if (joined >= __atomic_load_n(&vm->core.thread_top, __ATOMIC_ACQUIRE) ||
+        __atomic_load_n(&vm->core.thread_pool[joined].flag, __ATOMIC_ACQUIRE) == THR_UNINIT)
+        return pvm_reporterror(THREAD_H, __FUNCTION__, "No such thread");
+    if (joined == tid)
+        return pvm_reporterror(THREAD_H, __FUNCTION__, "A thread cannot join itself");
+
+    /* Its registers were final before it was flagged dead */
+    if (__atomic_load_n(&vm->core.thread_pool[joined].flag, __ATOMIC_ACQUIRE) & THR_DEAD)
+        return 0;
+
+    /* Its worker queues it among the waiters at its next switch point */
+    tmp->joining = joined;
+    tmp->flag |= THR_WAIT;
+
+    return 1;
+}
+
+int thr_sleepns(VM *vm, va_t tid, uint64_t ns)
+{
+    Thread *tmp = &vm->core.thread_pool[tid];
+
+    if (ns == 0)
+        return 0;
+
+    tmp->deadline = sch_walltime() + ns;
+    core_lock(vm);
+    sch_timer(&vm->core.scheduler, vm->core.thread_pool, tid);
+    thr_block(vm, tid);
+    core_unlock(vm);
+
+    return 1;
+}
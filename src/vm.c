@@ -35,14 +35,15 @@ VM pvm_initialise(const char *path)
     /* Check file header */
     fread(&fheader, sizeof(uint32_t), 1, fp);
     fheader = REVERSE_32(fheader);
-    if (fheader != MAGIC_NUMBER)
+    if (fheader != MAGIC_NUMBER && fheader != MAGIC_COMPACT)
         pvm_reporterror(VM_H, __FUNCTION__, "Incorrect file type");
 
-    /* Initialise segments */
+    /* Initialise segments, only the code segment differs between encodings */
     ssg_initialise(&vm.staticseg, fp);
     heap_initialise(&vm.heap, fp);
-    csg_initialise(&vm.codeseg, path, fp);
+    csg_initialise(&vm.codeseg, path, fp, fheader == MAGIC_COMPACT);
     core_initialise(&vm);
+    jit_initialise(&vm.jit);
 
     /* Initialise memory map */
     vm.memmap.codeseg = 0;
@@ -60,6 +61,8 @@ int pvm_finalise(VM *vm)
     ssg_finalise(&vm->staticseg);
     csg_finalise(&vm->codeseg);
     heap_finalise(&vm->heap);
+    jit_finalise(&vm->jit);
+    core_unmap(vm);
 
     return 0;
 }
@@ -0,0 +1,342 @@
+#include "../include/vm.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Benchmark of the channels. Producers send a stream of values to consumers
+ * through one channel, one value per instruction, for channels of one to one
+ * and of several threads on both sides, with more and more room. Then one
+ * producer streams batches of values to one consumer, and two threads send a
+ * value back and forth through two channels of one cell, which times a round
+ * trip. The throughput should grow with the capacity and the batch size, as
+ * threads park less often.
+ *
+ * The consumers of the stream add up the values they receive into the first
+ * frame of the heap, with how many there were, which are checked against what
+ * the producers sent on every number of workers.
+ *
+ * The parameters of a program are the I32 values of its static segment.
+ */
+
+static const unsigned char stream[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* Static Segment Size of 0x0 */
+    0x00, 0x00, 0x00, 0x04,
+    /* Static Segment 0x0:0x0, messages per producer */
+    0x04, 0x00, 0x00, 0x00, 0x00,
+    /* Static Segment 0x0:0x1, capacity */
+    0x04, 0x00, 0x00, 0x00, 0x00,
+    /* Static Segment 0x0:0x2, one to one */
+    0x04, 0x00, 0x00, 0x00, 0x00,
+    /* Static Segment 0x0:0x3, producers and consumers */
+    0x04, 0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 2 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR2 I64 0 */
+    0x02, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* ATOMIC_STORE 0 0 GPR2 GPR7 */
+    0x6B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x40,
+    /* GET_STATIC 0 0 GPR5 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+    /* GET_STATIC 0 1 GPR1 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01,
+    /* GET_STATIC 0 2 GPR2 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x02,
+    /* GET_STATIC 0 3 GPR3 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x04,
+    /* CHAN_NEW GPR1 GPR2 GPR4 */
+    0x74, 0x01, 0x02, 0x08,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* ADD3 GPR3 GPR3 GPR1 */
+    0x2A, 0x04, 0x04, 0x01,
+    /* LOAD GPR2 I32 1 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* PARFOR GPR0 GPR1 GPR2 +9 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x09,
+    /* HLT */
+    0x01,
+    /* body: */
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* BLT GPR0 GPR3 +88 (producer) */
+    0x51, 0x00, 0x04, 0x00, 0x00, 0x00, 0x58,
+    /* LOAD GPR2 I64 0 */
+    0x02, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* consumer: */
+    /* CHAN_RECV GPR4 GPR1 */
+    0x76, 0x08, 0x01,
+    /* ADD3 GPR2 GPR1 GPR2 */
+    0x2A, 0x02, 0x01, 0x02,
+    /* ADDI GPR6 I32 1 GPR6 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* BLT GPR6 GPR5 -15 (consumer) */
+    0x51, 0x20, 0x10, 0xFF, 0xFF, 0xFF, 0xF1,
+    /* ATOMIC_FETCH_ADD 0 0 GPR2 GPR7 GPR1 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x40, 0x01,
+    /* LOAD GPR7 I32 1 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* ATOMIC_FETCH_ADD 0 0 GPR6 GPR7 GPR1 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x40, 0x01,
+    /* HLT */
+    0x01,
+    /* producer: */
+    /* CHAN_SEND GPR4 GPR6 */
+    0x75, 0x08, 0x20,
+    /* ADDI GPR6 I32 1 GPR6 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* BLT GPR6 GPR5 -11 (producer) */
+    0x51, 0x20, 0x10, 0xFF, 0xFF, 0xFF, 0xF5,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char batch[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* Static Segment Size of 0x0 */
+    0x00, 0x00, 0x00, 0x03,
+    /* Static Segment 0x0:0x0, messages */
+    0x04, 0x00, 0x00, 0x00, 0x00,
+    /* Static Segment 0x0:0x1, capacity */
+    0x04, 0x00, 0x00, 0x00, 0x00,
+    /* Static Segment 0x0:0x2, values per batch */
+    0x04, 0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x02,
+    /* GET_STATIC 0 0 GPR5 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+    /* GET_STATIC 0 1 GPR1 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01,
+    /* GET_STATIC 0 2 GPR3 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x04,
+    /* LOAD GPR2 I32 1 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* CHAN_NEW GPR1 GPR2 GPR4 */
+    0x74, 0x01, 0x02, 0x08,
+    /* MALLOC 0 1024 */
+    0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+    /* MALLOC 1 1024 */
+    0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* fill: */
+    /* STOREI 0 0 GPR6 GPR6 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x20,
+    /* ADDI GPR6 I32 1 GPR6 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* BLTI GPR6 I32 1024 -27 (fill) */
+    0x57, 0x20, 0x04, 0x00, 0x00, 0x04, 0x00, 0xFF, 0xFF, 0xFF, 0xE5,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 2 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x02,
+    /* PARFOR GPR0 GPR1 GPR2 +9 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x09,
+    /* HLT */
+    0x01,
+    /* body: */
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* BEQI GPR0 I32 0 +43 (producer) */
+    0x5B, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2B,
+    /* consumer: */
+    /* CHAN_RECV_N 1 0 GPR4 GPR3 GPR2 */
+    0x7A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x04, 0x02,
+    /* ADD3 GPR6 GPR2 GPR6 */
+    0x2A, 0x20, 0x02, 0x20,
+    /* BLT GPR6 GPR5 -24 (consumer) */
+    0x51, 0x20, 0x10, 0xFF, 0xFF, 0xFF, 0xE8,
+    /* HLT */
+    0x01,
+    /* producer: */
+    /* CHAN_SEND_N 0 0 GPR4 GPR3 GPR2 */
+    0x79, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x04, 0x02,
+    /* ADD3 GPR6 GPR2 GPR6 */
+    0x2A, 0x20, 0x02, 0x20,
+    /* BLT GPR6 GPR5 -24 (producer) */
+    0x51, 0x20, 0x10, 0xFF, 0xFF, 0xFF, 0xE8,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char pingpong[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* Static Segment Size of 0x0 */
+    0x00, 0x00, 0x00, 0x01,
+    /* Static Segment 0x0:0x0, round trips */
+    0x04, 0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* GET_STATIC 0 0 GPR3 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04,
+    /* LOAD GPR1 I32 1 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* CHAN_NEW GPR1 GPR1 GPR4 */
+    0x74, 0x01, 0x01, 0x08,
+    /* CHAN_NEW GPR1 GPR1 GPR5 */
+    0x74, 0x01, 0x01, 0x10,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 2 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR2 I32 1 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* PARFOR GPR0 GPR1 GPR2 +9 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x09,
+    /* HLT */
+    0x01,
+    /* body: */
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* BEQI GPR0 I32 0 +33 (ping) */
+    0x5B, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21,
+    /* pong: */
+    /* CHAN_RECV GPR4 GPR1 */
+    0x76, 0x08, 0x01,
+    /* CHAN_SEND GPR5 GPR1 */
+    0x75, 0x10, 0x01,
+    /* ADDI GPR6 I32 1 GPR6 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* BLT GPR6 GPR3 -14 (pong) */
+    0x51, 0x20, 0x04, 0xFF, 0xFF, 0xFF, 0xF2,
+    /* HLT */
+    0x01,
+    /* ping: */
+    /* CHAN_SEND GPR4 GPR6 */
+    0x75, 0x08, 0x20,
+    /* CHAN_RECV GPR5 GPR1 */
+    0x76, 0x10, 0x01,
+    /* ADDI GPR6 I32 1 GPR6 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* BLT GPR6 GPR3 -14 (ping) */
+    0x51, 0x20, 0x04, 0xFF, 0xFF, 0xFF, 0xF2,
+    /* HLT */
+    0x01
+};
+
+
+/* Where the nth parameter goes in a program */
+#define PARAM_AT(n) (13 + 5 * (n))
+
+/*
+ * Runs a program with its parameters on a number of workers, returns the
+ * seconds taken. The first two elements of the first heap frame go to
+ * 'received' unless it is NULL.
+ */
+static double run(const char *path, const unsigned char *program, size_t size, const uint32_t *params,
+                  size_t nparams, unsigned int workers, int64_t *received)
+{
+    unsigned char *code = malloc(size);
+    struct timespec start, end;
+    FILE *fp;
+    VM vm;
+
+    memcpy(code, program, size);
+    for (size_t n = 0; n < nparams; n++)
+        for (int b = 0; b < 4; b++)
+            code[PARAM_AT(n) + b] = params[n] >> (8 * b);
+    fp = fopen(path, "wb");
+    fwrite(code, size, 1, fp);
+    fclose(fp);
+    free(code);
+
+    vm = pvm_initialise(path);
+    vm.core.worker_num = workers;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pvm_run(&vm);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (received != NULL)
+        for (int n = 0; n < 2; n++)
+            received[n] = DATA_RETRIEVER_INT(vm.heap.var_pool[0].block[n]);
+    pvm_finalise(&vm);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint32_t capacities[] = {1, 16, 1024};
+    static const uint32_t batches[] = {1, 16, 256};
+    unsigned int workers = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    char path[] = "/tmp/pvmchanXXXXXX";
+    int fd = mkstemp(path);
+    uint32_t params[4];
+    int64_t received[2], sent;
+    double seconds;
+    int failures = 0;
+
+    if (fd < 0)
+        return 1;
+    close(fd);
+    if (workers < 2)
+        workers = 2;
+    if (workers > WORKER_LIMIT)
+        workers = WORKER_LIMIT;
+
+    /* One to one, then four producers and four consumers */
+    printf("channel   threads   capacity   workers   Mvalues/s\n");
+    for (uint32_t pairs = 1; pairs <= 4; pairs += 3)
+        for (size_t c = 0; c < sizeof(capacities) / sizeof(capacities[0]); c++)
+            for (unsigned int w = 1; w <= workers; w = w < workers ? workers : w + 1)
+            {
+                params[0] = 400000 / pairs;
+                params[1] = capacities[c];
+                params[2] = pairs == 1;
+                params[3] = pairs;
+                seconds = run(path, stream, sizeof(stream), params, 4, w, received);
+                printf("%7s %9u %10u %9u %11.2f", pairs == 1 ? "spsc" : "mpmc", 2 * pairs, capacities[c], w,
+                       params[0] * pairs / seconds / 1e6);
+
+                /* Every producer sends 0 up to the number of messages */
+                sent = (int64_t) params[0] * (params[0] - 1) / 2 * pairs;
+                if (received[0] != sent || received[1] != (int64_t) params[0] * pairs)
+                {
+                    printf("   received %lld values adding up to %lld, not %lld adding up to %lld",
+                           (long long) received[1], (long long) received[0], (long long) params[0] * pairs,
+                           (long long) sent);
+                    failures++;
+                }
+                printf("\n");
+            }
+
+    printf("\nbatch   capacity   workers   Mvalues/s\n");
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++)
+        for (unsigned int w = 1; w <= workers; w = w < workers ? workers : w + 1)
+        {
+            params[0] = 2000000;
+            params[1] = 1024;
+            params[2] = batches[b];
+            seconds = run(path, batch, sizeof(batch), params, 3, w, NULL);
+            printf("%5u %10u %9u %11.2f\n", batches[b], params[1], w, params[0] / seconds / 1e6);
+        }
+
+    printf("\nworkers   ns/round trip\n");
+    for (unsigned int w = 1; w <= 2; w++)
+    {
+        params[0] = 100000;
+        seconds = run(path, pingpong, sizeof(pingpong), params, 1, w, NULL);
+        printf("%7u %15.1f\n", w, seconds * 1e9 / params[0]);
+    }
+    unlink(path);
+
+    return failures != 0;
+}
@@ -0,0 +1,120 @@
+#include "../include/vm.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Allocation churn benchmark of the heap. A loop allocates four frames of the
+ * same size, three with MALLOC and one with CALLOC, writes to each and frees
+ * them in another order, for frames of growing sizes. Every size runs with the
+ * frames malloc'd like before the slabs, then carved out of the slabs. Frames
+ * larger than HEAP_SLAB_MAX are malloc'd either way.
+ */
+
+static const unsigned char churn[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x05,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* loop: */
+    /* MALLOC 1 1 */
+    0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    /* STOREI 1 0 GPR0 GPR7 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+    /* MALLOC 2 1 */
+    0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    /* STOREI 2 0 GPR0 GPR7 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+    /* CALLOC 3 1 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    /* STOREI 3 0 GPR0 GPR7 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+    /* MALLOC 4 1 */
+    0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    /* STOREI 4 0 GPR0 GPR7 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40,
+    /* FREE 2 */
+    0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    /* FREE 4 */
+    0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04,
+    /* FREE 1 */
+    0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    /* FREE 3 */
+    0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* BLTI GPR0 I32 100 -188 (loop) */
+    0x57, 0x00, 0x04, 0x00, 0x00, 0x00, 0x64, 0xFF, 0xFF, 0xFF, 0x44,
+    /* HLT */
+    0x01
+};
+
+/* Where the frame size goes in the nth allocation of churn, 8 bytes big endian */
+#define SIZE_AT(n) (35 + 36 * (n))
+
+/* Where the number of iterations goes in churn */
+#define ITERATIONS_AT 217
+
+/* Allocations per iteration of churn */
+#define ALLOCATIONS 4
+
+/* Runs churn for frames of the given size, returns the seconds taken */
+static double run(const char *path, uint64_t size, uint32_t iterations, bool slabs)
+{
+    unsigned char code[sizeof(churn)];
+    struct timespec start, end;
+    FILE *fp;
+    VM vm;
+
+    memcpy(code, churn, sizeof(churn));
+    for (int n = 0; n < ALLOCATIONS; n++)
+        for (int b = 0; b < 8; b++)
+            code[SIZE_AT(n) + b] = size >> (56 - 8 * b);
+    for (int b = 0; b < 4; b++)
+        code[ITERATIONS_AT + b] = iterations >> (24 - 8 * b);
+    fp = fopen(path, "wb");
+    fwrite(code, sizeof(code), 1, fp);
+    fclose(fp);
+
+    vm = pvm_initialise(path);
+    vm.heap.slabs = slabs;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pvm_run(&vm);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    pvm_finalise(&vm);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(void)
+{
+    static const uint64_t sizes[] = {1, 4, 16, 64, 256, 1024};
+    const uint32_t iterations = 1000000;
+    char path[] = "/tmp/pvmchurnXXXXXX";
+    int fd = mkstemp(path);
+    double libc, slab;
+
+    if (fd < 0)
+        return 1;
+    close(fd);
+
+    printf("frame size   malloc ns/alloc   slab ns/alloc   speedup\n");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        libc = run(path, sizes[s], iterations, false) * 1e9 / iterations / ALLOCATIONS;
+        slab = run(path, sizes[s], iterations, true) * 1e9 / iterations / ALLOCATIONS;
+        printf("%10lu %17.1f %15.1f %9.2f\n", sizes[s], libc, slab, libc / slab);
+    }
+    unlink(path);
+
+    return 0;
+}
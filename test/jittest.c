@@ -0,0 +1,1492 @@
+#include "../include/vm.h"
+#include "../include/options.h"
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Differential tests of the JIT and the superinstructions. Every program below
+ * is run by the interpreter alone, again with the JIT compiling its loops,
+ * again profiled, which runs it without superinstructions or quickening, and
+ * again from its compact encoding. All runs must finish with the same
+ * registers, static segment, heap and clocks. Jump targets only have to be the
+ * same instruction, their offsets differ between encodings. As every run
+ * shares the opcode functions, programs computing a known result are also
+ * checked against it.
+ */
+
+static const unsigned char arithmetic[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 1 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR2 I32 3000 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x0B, 0xB8,
+    /* LOAD GPR3 I32 0x40 (loop) */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x40,
+    /* LOAD GPR4 DBL 0 */
+    0x02, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR5 I32 7 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x00, 0x07,
+    /* LOAD GPR6 I32 1 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR7 I64 5 */
+    0x02, 0x40, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05,
+    /* loop: */
+    /* ADD GPR0 GPR1 */
+    0x15, 0x00, 0x01,
+    /* MOVE AR GPR0 */
+    0x03, 0x80, 0x00,
+    /* MUL GPR6 GPR5 */
+    0x17, 0x20, 0x10,
+    /* MOVE AR GPR6 */
+    0x03, 0x80, 0x20,
+    /* SUB GPR6 GPR0 */
+    0x16, 0x20, 0x00,
+    /* MOVE AR GPR6 */
+    0x03, 0x80, 0x20,
+    /* ADD GPR4 GPR1 */
+    0x15, 0x08, 0x01,
+    /* MOVE AR GPR4 */
+    0x03, 0x80, 0x08,
+    /* SUB GPR7 GPR1 */
+    0x16, 0x40, 0x01,
+    /* MOVE AR GPR7 */
+    0x03, 0x80, 0x40,
+    /* LESS GPR0 GPR2 */
+    0x20, 0x00, 0x02,
+    /* JUMP_IF_TRUE GPR3 */
+    0x13, 0x04,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char retype[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 1 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR2 I32 2000 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x07, 0xD0,
+    /* LOAD GPR3 I32 0x2A (loop) */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x2A,
+    /* LOAD GPR5 I32 1000 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x03, 0xE8,
+    /* LOAD GPR6 I32 0x38 (skip) */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x38,
+    /* loop: */
+    /* ADD GPR0 GPR1 */
+    0x15, 0x00, 0x01,
+    /* MOVE AR GPR0 */
+    0x03, 0x80, 0x00,
+    /* N_EQUAL GPR0 GPR5 */
+    0x25, 0x00, 0x10,
+    /* JUMP_IF_TRUE GPR6 */
+    0x13, 0x20,
+    /* CAST GPR0 DBL */
+    0x04, 0x00, 0x08,
+    /* skip: */
+    /* LOAD GPR4 I32 5 */
+    0x02, 0x08, 0x04, 0x00, 0x00, 0x00, 0x05,
+    /* ADD GPR4 GPR0 */
+    0x15, 0x08, 0x00,
+    /* GREAT_EQ GPR0 GPR2 */
+    0x23, 0x00, 0x02,
+    /* JUMP_IF_FALSE GPR3 */
+    0x14, 0x04,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char memory[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x02,
+    /* Static Segment Size of 0x0 */
+    0x00, 0x00, 0x00, 0x01,
+    /* Static Segment 0x0:0x0 */
+    0x04, 0x01, 0x00, 0x00, 0x00,
+    /* Static Segment Size of 0x1 */
+    0x00, 0x00, 0x00, 0x02,
+    /* Static Segment 0x1:0x0 */
+    0x04, 0x02, 0x00, 0x00, 0x00,
+    /* Static Segment 0x1:0x1 */
+    0x04, 0x0A, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* MALLOC 0 3 */
+    0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 1 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR2 I32 500 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x01, 0xF4,
+    /* LOAD GPR3 I32 0x46 (loop) */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x46,
+    /* LOAD GPR5 I32 90 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x00, 0x5A,
+    /* STORE 0 0 GPR0 */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* loop: */
+    /* GET 0 0 GPR4 */
+    0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08,
+    /* ADD GPR4 GPR1 */
+    0x15, 0x08, 0x01,
+    /* STORE 0 0 AR */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    /* XOR GPR4 GPR5 */
+    0x1B, 0x08, 0x10,
+    /* STORE 0 1 AR */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x80,
+    /* LSHIFT GPR4 GPR1 */
+    0x1E, 0x08, 0x01,
+    /* MOVE AR GPR7 */
+    0x03, 0x80, 0x40,
+    /* MOD GPR7 GPR5 */
+    0x19, 0x40, 0x10,
+    /* STORE_STATIC 0 0 AR */
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+    /* GET_STATIC 1 1 GPR6 */
+    0x11, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* OR GPR6 GPR0 */
+    0x1C, 0x20, 0x00,
+    /* STORE_STATIC 1 1 AR */
+    0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x80,
+    /* NOT GPR6 */
+    0x1D, 0x20,
+    /* STORE 0 2 AR */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x80,
+    /* LOG_AND GPR0 GPR5 */
+    0x26, 0x00, 0x10,
+    /* LOG_NOT AR */
+    0x28, 0x80,
+    /* ADD GPR0 GPR1 */
+    0x15, 0x00, 0x01,
+    /* MOVE AR GPR0 */
+    0x03, 0x80, 0x00,
+    /* LESS_EQ GPR0 GPR2 */
+    0x21, 0x00, 0x02,
+    /* JUMP_IF_TRUE GPR3 */
+    0x13, 0x04,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char nested[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 1 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR2 I32 50 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x32,
+    /* LOAD GPR3 I32 0x2A (outer) */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x2A,
+    /* LOAD GPR4 I32 0x31 (inner) */
+    0x02, 0x08, 0x04, 0x00, 0x00, 0x00, 0x31,
+    /* LOAD GPR5 I32 100 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x00, 0x64,
+    /* outer: */
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* inner: */
+    /* ADD GPR6 GPR1 */
+    0x15, 0x20, 0x01,
+    /* MOVE AR GPR6 */
+    0x03, 0x80, 0x20,
+    /* LESS GPR6 GPR5 */
+    0x20, 0x20, 0x10,
+    /* JUMP_IF_TRUE GPR4 */
+    0x13, 0x08,
+    /* ADD GPR0 GPR1 */
+    0x15, 0x00, 0x01,
+    /* MOVE AR GPR0 */
+    0x03, 0x80, 0x00,
+    /* STAMP GPR7 */
+    0x29, 0x40,
+    /* LESS GPR0 GPR2 */
+    0x20, 0x00, 0x02,
+    /* JUMP_IF_TRUE GPR3 */
+    0x13, 0x04,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char jump[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 3 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x03,
+    /* LOAD GPR2 I32 10000 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x27, 0x10,
+    /* LOAD GPR3 I32 0x23 (loop) */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x23,
+    /* LOAD GPR4 I32 0x34 (done) */
+    0x02, 0x08, 0x04, 0x00, 0x00, 0x00, 0x34,
+    /* loop: */
+    /* ADD GPR0 GPR1 */
+    0x15, 0x00, 0x01,
+    /* MOVE AR GPR0 */
+    0x03, 0x80, 0x00,
+    /* GREAT GPR0 GPR2 */
+    0x22, 0x00, 0x02,
+    /* JUMP_IF_TRUE GPR4 */
+    0x13, 0x08,
+    /* EQUAL GPR0 GPR2 */
+    0x24, 0x00, 0x02,
+    /* NOP */
+    0x00,
+    /* JUMP GPR3 */
+    0x12, 0x04,
+    /* done: */
+    /* HLT */
+    0x01
+};
+
+
+static const unsigned char destination[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 1 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR2 I32 3000 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x0B, 0xB8,
+    /* LOAD GPR3 I32 0x35 (loop) */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x35,
+    /* LOAD GPR4 DBL 0 */
+    0x02, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR5 I32 7 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x00, 0x07,
+    /* LOAD GPR6 I32 1 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* loop: */
+    /* ADD3 GPR0 GPR1 GPR0 */
+    0x2A, 0x00, 0x01, 0x00,
+    /* MUL3 GPR6 GPR5 GPR6 */
+    0x2C, 0x20, 0x10, 0x20,
+    /* SUB3 GPR6 GPR0 GPR6 */
+    0x2B, 0x20, 0x00, 0x20,
+    /* ADD3 GPR4 GPR1 GPR4 */
+    0x2A, 0x08, 0x01, 0x08,
+    /* XOR3 GPR0 GPR5 GPR7 */
+    0x30, 0x00, 0x10, 0x40,
+    /* NOT2 GPR7 GPR7 */
+    0x32, 0x40, 0x40,
+    /* LSHIFT3 GPR7 GPR1 GPR7 */
+    0x33, 0x40, 0x01, 0x40,
+    /* GREAT_EQ3 GPR0 GPR2 GPR7 */
+    0x38, 0x00, 0x02, 0x40,
+    /* LOG_NOT2 GPR7 GPR7 */
+    0x3D, 0x40, 0x40,
+    /* LESS3 GPR0 GPR2 AR */
+    0x35, 0x00, 0x02, 0x80,
+    /* JUMP_IF_TRUE GPR3 */
+    0x13, 0x04,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char immediate[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 8 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR3 I32 0x31 (loop) */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x31,
+    /* LOAD GPR4 DBL 0 */
+    0x02, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR6 I32 1 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* loop: */
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* MULI GPR6 I32 7 GPR6 */
+    0x40, 0x20, 0x04, 0x00, 0x00, 0x00, 0x07, 0x20,
+    /* SUBI GPR6 I32 -3 GPR6 */
+    0x3F, 0x20, 0x04, 0xFF, 0xFF, 0xFF, 0xFD, 0x20,
+    /* ADDI GPR4 I32 2 GPR4 */
+    0x3E, 0x08, 0x04, 0x00, 0x00, 0x00, 0x02, 0x08,
+    /* ANDI GPR0 I32 7 GPR1 */
+    0x43, 0x00, 0x04, 0x00, 0x00, 0x00, 0x07, 0x01,
+    /* STOREI 0 0 GPR0 GPR1 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    /* GETI 0 0 GPR2 GPR1 */
+    0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x01,
+    /* ADDI GPR2 I64 5 GPR2 */
+    0x3E, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x02,
+    /* RSHIFTI GPR0 I32 1 GPR5 */
+    0x48, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x10,
+    /* GREATI GPR0 I64 2000 GPR5 */
+    0x4B, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0xD0, 0x10,
+    /* EQUALI GPR0 I32 1000 GPR7 */
+    0x4D, 0x00, 0x04, 0x00, 0x00, 0x03, 0xE8, 0x40,
+    /* LESSI GPR0 I32 3000 AR */
+    0x49, 0x00, 0x04, 0x00, 0x00, 0x0B, 0xB8, 0x80,
+    /* JUMP_IF_TRUE GPR3 */
+    0x13, 0x04,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char branch[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 0 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR2 DBL 0 */
+    0x02, 0x02, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR5 I32 3000 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x0B, 0xB8,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* loop: */
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* ANDI GPR0 I32 3 GPR6 */
+    0x43, 0x00, 0x04, 0x00, 0x00, 0x00, 0x03, 0x20,
+    /* BNEI GPR6 I32 0 +19 (skip) */
+    0x5C, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x13,
+    /* ADDI GPR1 I32 1 GPR1 */
+    0x3E, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01, 0x01,
+    /* skip: */
+    /* ADDI GPR2 I32 1 GPR2 */
+    0x3E, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01, 0x02,
+    /* BLEI GPR2 I64 2000 +23 (low) */
+    0x58, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0xD0, 0x00, 0x00, 0x00, 0x17,
+    /* ADDI GPR7 I32 1 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* low: */
+    /* BGE GPR1 GPR5 +14 (done) */
+    0x54, 0x01, 0x10, 0x00, 0x00, 0x00, 0x0E,
+    /* BLT GPR0 GPR5 -73 (loop) */
+    0x51, 0x00, 0x10, 0xFF, 0xFF, 0xFF, 0xB7,
+    /* done: */
+    /* HLT */
+    0x01
+};
+
+static const unsigned char multiway[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 0 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR3 I32 0 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR5 I32 3000 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x0B, 0xB8,
+    /* loop: */
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* SWITCH GPR3 4 entries, default +92 (other), +26 (s0), +48 (s1), +70 (s2), +48 (s1) */
+    0x5D, 0x04, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x5C, 0x00, 0x00, 0x00, 0x1A, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00, 0x00, 0x46, 0x00, 0x00, 0x00, 0x30,
+    /* s0: */
+    /* ADDI GPR1 I32 1 GPR1 */
+    0x3E, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01, 0x01,
+    /* LOAD GPR3 I32 3 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x03,
+    /* BEQ GPR0 GPR0 +66 (next) */
+    0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x42,
+    /* s1: */
+    /* ADDI GPR1 I32 3 GPR1 */
+    0x3E, 0x01, 0x04, 0x00, 0x00, 0x00, 0x03, 0x01,
+    /* LOAD GPR3 I32 2 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x02,
+    /* BEQ GPR0 GPR0 +44 (next) */
+    0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2C,
+    /* s2: */
+    /* SUBI GPR1 I32 7 GPR1 */
+    0x3F, 0x01, 0x04, 0x00, 0x00, 0x00, 0x07, 0x01,
+    /* LOAD GPR3 I32 -1 */
+    0x02, 0x04, 0x04, 0xFF, 0xFF, 0xFF, 0xFF,
+    /* BEQ GPR0 GPR0 +22 (next) */
+    0x55, 0x00, 0x00, 0x00, 0x00, 0x00, 0x16,
+    /* other: */
+    /* XORI GPR1 I32 5 GPR1 */
+    0x44, 0x01, 0x04, 0x00, 0x00, 0x00, 0x05, 0x01,
+    /* LOAD GPR3 I32 0 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* next: */
+    /* BLT GPR0 GPR5 -115 (loop) */
+    0x51, 0x00, 0x10, 0xFF, 0xFF, 0xFF, 0x8D,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char threads[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* SPAWN GPR2 +56 (worker) */
+    0x5E, 0x02, 0x00, 0x00, 0x00, 0x38,
+    /* LOAD GPR0 I32 1000 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x03, 0xE8,
+    /* SPAWN GPR3 +43 (worker) */
+    0x5E, 0x04, 0x00, 0x00, 0x00, 0x2B,
+    /* LOAD GPR0 I32 2000 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x07, 0xD0,
+    /* SPAWN GPR4 +30 (worker) */
+    0x5E, 0x08, 0x00, 0x00, 0x00, 0x1E,
+    /* SELF GPR5 */
+    0x61, 0x10,
+    /* YIELD */
+    0x60,
+    /* JOIN GPR2 GPR6 GPR6 */
+    0x5F, 0x02, 0x20, 0x20,
+    /* JOIN GPR3 GPR6 GPR7 */
+    0x5F, 0x04, 0x20, 0x40,
+    /* ADD3 GPR6 GPR7 GPR6 */
+    0x2A, 0x20, 0x40, 0x20,
+    /* JOIN GPR4 GPR6 GPR7 */
+    0x5F, 0x08, 0x20, 0x40,
+    /* ADD3 GPR6 GPR7 GPR6 */
+    0x2A, 0x20, 0x40, 0x20,
+    /* HLT */
+    0x01,
+    /* worker: */
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* ADDI GPR0 I32 1000 GPR1 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x03, 0xE8, 0x01,
+    /* loop: */
+    /* ADD3 GPR6 GPR0 GPR6 */
+    0x2A, 0x20, 0x00, 0x20,
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* BLT GPR0 GPR1 -12 (loop) */
+    0x51, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xF4,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char parfor[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 1000 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xE8,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 1000 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x03, 0xE8,
+    /* LOAD GPR2 I32 64 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x40,
+    /* PARFOR GPR0 GPR1 GPR2 +65 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x41,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* sum: */
+    /* GETI 0 0 GPR3 GPR0 */
+    0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+    /* ADD3 GPR6 GPR3 GPR6 */
+    0x2A, 0x20, 0x04, 0x20,
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* BLTI GPR0 I32 1000 -31 (sum) */
+    0x57, 0x00, 0x04, 0x00, 0x00, 0x03, 0xE8, 0xFF, 0xFF, 0xFF, 0xE1,
+    /* HLT */
+    0x01,
+    /* body: */
+    /* MUL3 GPR0 GPR0 GPR3 */
+    0x2C, 0x00, 0x00, 0x04,
+    /* STOREI 0 0 GPR3 GPR0 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00,
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* BLT GPR0 GPR1 -31 (body) */
+    0x51, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0xE1,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char spread[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 1 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR3 I64 0 */
+    0x02, 0x04, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* ATOMIC_STORE 0 0 GPR3 GPR7 */
+    0x6B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 100000 */
+    0x02, 0x01, 0x04, 0x00, 0x01, 0x86, 0xA0,
+    /* LOAD GPR2 I32 1 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* PARFOR GPR0 GPR1 GPR2 +28 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x1C,
+    /* ATOMIC_LOAD 0 0 GPR5 GPR7 */
+    0x6A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x40,
+    /* HLT */
+    0x01,
+    /* body: */
+    /* ATOMIC_FETCH_ADD 0 0 GPR0 GPR7 GPR6 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x20,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char rendezvous[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 1 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR3 I64 0 */
+    0x02, 0x04, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* ATOMIC_STORE 0 0 GPR3 GPR7 */
+    0x6B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 100 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x64,
+    /* LOAD GPR2 I32 1 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* PARFOR GPR0 GPR1 GPR2 +28 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x1C,
+    /* ATOMIC_LOAD 0 0 GPR5 GPR7 */
+    0x6A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x40,
+    /* HLT */
+    0x01,
+    /* body: every chunk waits for all the others before adding its index */
+    /* LOAD GPR4 I32 0 */
+    0x02, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR6 I32 100 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x64,
+    /* BARRIER GPR4 GPR6 */
+    0x68, 0x08, 0x20,
+    /* ATOMIC_FETCH_ADD 0 0 GPR0 GPR7 GPR6 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x20,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char mutex[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 2 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR3 I32 0 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* STOREI 0 0 GPR3 GPR7 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* LOAD GPR7 I32 1 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* STOREI 0 0 GPR3 GPR7 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 4 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x04,
+    /* LOAD GPR2 I32 1 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* PARFOR GPR0 GPR1 GPR2 +61 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x3D,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* GETI 0 0 GPR6 GPR7 */
+    0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x40,
+    /* LOAD GPR7 I32 1 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* GETI 0 0 GPR5 GPR7 */
+    0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x40,
+    /* HLT */
+    0x01,
+    /* body: */
+    /* LOAD GPR5 I32 0 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR2 I32 0 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* loop: */
+    /* MUTEX_LOCK GPR5 */
+    0x63, 0x10,
+    /* GETI 0 0 GPR3 GPR7 */
+    0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* YIELD */
+    0x60,
+    /* ADDI GPR3 I32 1 GPR3 */
+    0x3E, 0x04, 0x04, 0x00, 0x00, 0x00, 0x01, 0x04,
+    /* STOREI 0 0 GPR3 GPR7 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* MUTEX_UNLOCK GPR5 */
+    0x64, 0x10,
+    /* ADDI GPR2 I32 1 GPR2 */
+    0x3E, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01, 0x02,
+    /* BLTI GPR2 I32 1000 -59 (loop) */
+    0x57, 0x02, 0x04, 0x00, 0x00, 0x03, 0xE8, 0xFF, 0xFF, 0xFF, 0xC5,
+    /* LOAD GPR4 I32 1 */
+    0x02, 0x08, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR6 I32 4 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x04,
+    /* BARRIER GPR4 GPR6 */
+    0x68, 0x08, 0x20,
+    /* GETI 0 0 GPR3 GPR7 */
+    0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* MUTEX_LOCK GPR5 */
+    0x63, 0x10,
+    /* LOAD GPR1 I32 1 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* GETI 0 0 GPR6 GPR1 */
+    0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x01,
+    /* ADD3 GPR6 GPR3 GPR6 */
+    0x2A, 0x20, 0x04, 0x20,
+    /* STOREI 0 0 GPR6 GPR1 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x01,
+    /* MUTEX_UNLOCK GPR5 */
+    0x64, 0x10,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char atomic[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* Static Segment Size of 0x0 */
+    0x00, 0x00, 0x00, 0x01,
+    /* Static Segment 0x0:0x0 */
+    0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 2 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR4 I32 1 */
+    0x02, 0x08, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR3 I32 0 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* ATOMIC_STORE 0 0 GPR3 GPR4 */
+    0x6B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x08,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 4000 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x0F, 0xA0,
+    /* LOAD GPR2 I32 0 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* PARFOR GPR0 GPR1 GPR2 +74 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x4A,
+    /* LOAD GPR3 I32 0 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* ATOMIC_XCHG 0 0 GPR3 GPR7 GPR6 */
+    0x6C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40, 0x20,
+    /* ATOMIC_LOAD 0 0 GPR5 GPR4 */
+    0x6A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x08,
+    /* ATOMIC_LOAD_STATIC 0 0 GPR4 GPR7 */
+    0x6F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x40,
+    /* HLT */
+    0x01,
+    /* body: */
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR4 I32 1 */
+    0x02, 0x08, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR3 I32 1 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* loop: */
+    /* ATOMIC_FETCH_ADD 0 0 GPR3 GPR7 GPR6 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40, 0x20,
+    /* ATOMIC_FETCH_ADD_STATIC 0 0 GPR0 GPR7 GPR6 */
+    0x72, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x20,
+    /* ATOMIC_LOAD 0 0 GPR2 GPR4 */
+    0x6A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x08,
+    /* retry: */
+    /* ADD3 GPR2 GPR0 GPR5 */
+    0x2A, 0x02, 0x00, 0x10,
+    /* ATOMIC_CAS 0 0 GPR5 GPR4 GPR2 */
+    0x6E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x08, 0x02,
+    /* BEQI AR I32 0 -24 (retry) */
+    0x5B, 0x80, 0x04, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xE8,
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* BLT GPR0 GPR1 -102 (loop) */
+    0x51, 0x00, 0x01, 0xFF, 0xFF, 0xFF, 0x9A,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char convert[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 2 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR3 I64 100 */
+    0x02, 0x04, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64,
+    /* ATOMIC_STORE 0 0 GPR3 GPR7 */
+    0x6B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* LOAD GPR4 DBL 3 */
+    0x02, 0x08, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+    /* ATOMIC_FETCH_ADD 0 0 GPR4 GPR7 GPR6 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x40, 0x20,
+    /* LOAD GPR7 I32 1 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR2 DBL 2 */
+    0x02, 0x02, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    /* ATOMIC_STORE 0 0 GPR2 GPR7 */
+    0x6B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x40,
+    /* LOAD GPR3 I64 5 */
+    0x02, 0x04, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05,
+    /* ATOMIC_FETCH_ADD 0 0 GPR3 GPR7 GPR6 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40, 0x20,
+    /* ATOMIC_LOAD 0 0 GPR1 GPR7 */
+    0x6A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* CAST GPR1 I64 */
+    0x04, 0x01, 0x06,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* ATOMIC_LOAD 0 0 GPR5 GPR7 */
+    0x6A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x40,
+    /* ADD3 GPR5 GPR1 GPR5 */
+    0x2A, 0x10, 0x01, 0x10,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char channel[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 2 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR3 I64 0 */
+    0x02, 0x04, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* ATOMIC_STORE 0 0 GPR3 GPR7 */
+    0x6B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x40,
+    /* LOAD GPR1 I32 3 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x03,
+    /* LOAD GPR2 I32 0 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* CHAN_NEW GPR1 GPR2 GPR4 */
+    0x74, 0x01, 0x02, 0x08,
+    /* LOAD GPR3 I32 2 */
+    0x02, 0x04, 0x04, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* ADD3 GPR3 GPR3 GPR1 */
+    0x2A, 0x04, 0x04, 0x01,
+    /* LOAD GPR2 I32 1 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* PARFOR GPR0 GPR1 GPR2 +61 (body) */
+    0x62, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x3D,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* ATOMIC_LOAD 0 0 GPR5 GPR7 */
+    0x6A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x40,
+    /* LOAD GPR6 I32 1 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* ATOMIC_LOAD 0 0 GPR6 GPR6 */
+    0x6A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x20,
+    /* HLT */
+    0x01,
+    /* body: */
+    /* LOAD GPR5 I32 100 */
+    0x02, 0x10, 0x04, 0x00, 0x00, 0x00, 0x64,
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* BLT GPR0 GPR3 +88 (producer) */
+    0x51, 0x00, 0x04, 0x00, 0x00, 0x00, 0x58,
+    /* LOAD GPR2 I64 0 */
+    0x02, 0x02, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* cl: */
+    /* CHAN_RECV GPR4 GPR1 */
+    0x76, 0x08, 0x01,
+    /* ADD3 GPR2 GPR1 GPR2 */
+    0x2A, 0x02, 0x01, 0x02,
+    /* ADDI GPR6 I32 1 GPR6 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* BLT GPR6 GPR5 -15 (cl) */
+    0x51, 0x20, 0x10, 0xFF, 0xFF, 0xFF, 0xF1,
+    /* ATOMIC_FETCH_ADD 0 0 GPR2 GPR7 GPR1 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x40, 0x01,
+    /* LOAD GPR7 I32 1 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* ATOMIC_FETCH_ADD 0 0 GPR6 GPR7 GPR1 */
+    0x6D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x40, 0x01,
+    /* HLT */
+    0x01,
+    /* producer: */
+    /* pl: */
+    /* CHAN_SEND GPR4 GPR6 */
+    0x75, 0x08, 0x20,
+    /* ADDI GPR6 I32 1 GPR6 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* BLT GPR6 GPR5 -11 (pl) */
+    0x51, 0x20, 0x10, 0xFF, 0xFF, 0xFF, 0xF5,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char retire[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 1 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR2 I32 0 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* CHAN_NEW GPR1 GPR2 GPR4 */
+    0x74, 0x01, 0x02, 0x08,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* SPAWN GPR3 +16 (worker) */
+    0x5E, 0x04, 0x00, 0x00, 0x00, 0x10,
+    /* Both wait for the worker, yet retire once: 7 instructions here and 2002 there */
+    /* CHAN_RECV GPR4 GPR5 */
+    0x76, 0x08, 0x10,
+    /* JOIN GPR3 GPR6 GPR6 */
+    0x5F, 0x04, 0x20, 0x20,
+    /* STAMP GPR7 */
+    0x29, 0x40,
+    /* HLT */
+    0x01,
+    /* worker: */
+    /* CHAN_SEND GPR4 GPR1 */
+    0x75, 0x08, 0x01,
+    /* loop: */
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* BLTI GPR0 I32 1000 -8 (loop) */
+    0x57, 0x00, 0x04, 0x00, 0x00, 0x03, 0xE8, 0xFF, 0xFF, 0xFF, 0xF8,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char reuse[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR1 I32 16 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x10,
+    /* SPAWN_STACK GPR1 */
+    0x7B, 0x01,
+    /* LOAD GPR5 I64 0 */
+    0x02, 0x10, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR6 I32 0 */
+    0x02, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* loop: */
+    /* SPAWN GPR4 +34 (child) */
+    0x5E, 0x08, 0x00, 0x00, 0x00, 0x22,
+    /* JOIN GPR4 GPR0 GPR1 */
+    0x5F, 0x08, 0x00, 0x01,
+    /* ADD3 GPR5 GPR1 GPR5 */
+    0x2A, 0x10, 0x01, 0x10,
+    /* ADDI GPR6 I32 1 GPR6 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* BLTI GPR6 I32 600 -22 (loop) */
+    0x57, 0x20, 0x04, 0x00, 0x00, 0x02, 0x58, 0xFF, 0xFF, 0xFF, 0xEA,
+    /* HLT */
+    0x01,
+    /* child: */
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* push: */
+    /* PUSH GPR7 */
+    0x05, 0x40,
+    /* ADDI GPR7 I32 1 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* BLTI GPR7 I32 16 -10 (push) */
+    0x57, 0x40, 0x04, 0x00, 0x00, 0x00, 0x10, 0xFF, 0xFF, 0xFF, 0xF6,
+    /* ADDI GPR6 I32 1 GPR0 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char typed[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x02,
+    /* MALLOC_TYPED 0 300 UI8 */
+    0x7C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x2C, 0x01,
+    /* MALLOC_TYPED 1 2 DBL */
+    0x7C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x08,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* fill: */
+    /* ADDI GPR7 I32 250 GPR1 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0xFA, 0x01,
+    /* STOREI 0 0 GPR1 GPR7 */
+    0x4F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* ADDI GPR7 I32 1 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* BLTI GPR7 I32 300 -35 (fill) */
+    0x57, 0x40, 0x04, 0x00, 0x00, 0x01, 0x2C, 0xFF, 0xFF, 0xFF, 0xDD,
+    /* REALLOC 0 600 */
+    0x0B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x58,
+    /* LOAD GPR5 I64 0 */
+    0x02, 0x10, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* sum: */
+    /* GETI 0 0 GPR1 GPR7 */
+    0x50, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* ADD3 GPR5 GPR1 GPR5 */
+    0x2A, 0x10, 0x01, 0x10,
+    /* ADDI GPR7 I32 1 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* BLTI GPR7 I32 300 -31 (sum) */
+    0x57, 0x40, 0x04, 0x00, 0x00, 0x01, 0x2C, 0xFF, 0xFF, 0xFF, 0xE1,
+    /* STORE 1 0 GPR5 */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+    /* LOAD GPR1 I32 -3 */
+    0x02, 0x01, 0x04, 0xFF, 0xFF, 0xFF, 0xFD,
+    /* STORE 1 1 GPR1 */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01,
+    /* GET 1 1 GPR6 */
+    0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x20,
+    /* GET 0 5 GPR4 */
+    0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x08,
+    /* FREE 0 */
+    0x0C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char mapped[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x01,
+    /* CALLOC 0 0x3000 */
+    0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x00,
+    /* LOAD GPR1 I32 7 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x07,
+    /* STORE 0 0x2FFF GPR1 */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2F, 0xFF, 0x01,
+    /* LOAD GPR1 I32 11 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x0B,
+    /* STORE 0 5 GPR1 */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x01,
+    /* REALLOC 0 0x6000 */
+    0x0B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x60, 0x00,
+    /* LOAD GPR1 I32 13 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x0D,
+    /* STORE 0 0x5FFF GPR1 */
+    0x0D, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5F, 0xFF, 0x01,
+    /* GET 0 0x2FFF GPR2 */
+    0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2F, 0xFF, 0x02,
+    /* GET 0 0x5FFF GPR3 */
+    0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x5F, 0xFF, 0x04,
+    /* REALLOC 0 0x10 */
+    0x0B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+    /* GET 0 5 GPR5 */
+    0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x10,
+    /* REALLOC 0 0x4000 */
+    0x0B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x00,
+    /* GET 0 5 GPR6 */
+    0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x20,
+    /* ADD3 GPR2 GPR3 GPR7 */
+    0x2A, 0x02, 0x04, 0x40,
+    /* ADD3 GPR7 GPR5 GPR7 */
+    0x2A, 0x40, 0x10, 0x40,
+    /* ADD3 GPR7 GPR6 GPR7 */
+    0x2A, 0x40, 0x20, 0x40,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char flat[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR6 VA 0 */
+    0x02, 0x20, 0x09, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR2 I32 2 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* build: */
+    /* FLAT_MALLOC GPR2 GPR4 */
+    0x7D, 0x02, 0x08,
+    /* FLAT_STORE GPR4 GPR7 */
+    0x7F, 0x08, 0x40,
+    /* ADDI GPR4 I32 1 GPR3 */
+    0x3E, 0x08, 0x04, 0x00, 0x00, 0x00, 0x01, 0x04,
+    /* FLAT_STORE GPR3 GPR6 */
+    0x7F, 0x04, 0x20,
+    /* MOVE GPR4 GPR6 */
+    0x03, 0x08, 0x20,
+    /* ADDI GPR7 I32 1 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* BLTI GPR7 I32 500 -28 (build) */
+    0x57, 0x40, 0x04, 0x00, 0x00, 0x01, 0xF4, 0xFF, 0xFF, 0xFF, 0xE4,
+    /* LOAD GPR5 I64 0 */
+    0x02, 0x10, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* MOVE GPR6 GPR0 */
+    0x03, 0x20, 0x00,
+    /* walk: */
+    /* FLAT_GET GPR0 GPR1 */
+    0x80, 0x00, 0x01,
+    /* ADD3 GPR5 GPR1 GPR5 */
+    0x2A, 0x10, 0x01, 0x10,
+    /* ADDI GPR0 I32 1 GPR3 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x04,
+    /* FLAT_GET GPR3 GPR0 */
+    0x80, 0x04, 0x00,
+    /* BNEI GPR0 I32 0 -18 (walk) */
+    0x5C, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xEE,
+    /* free: */
+    /* ADDI GPR6 I32 1 GPR3 */
+    0x3E, 0x20, 0x04, 0x00, 0x00, 0x00, 0x01, 0x04,
+    /* FLAT_GET GPR3 GPR4 */
+    0x80, 0x04, 0x08,
+    /* FLAT_FREE GPR6 */
+    0x7E, 0x20,
+    /* MOVE GPR4 GPR6 */
+    0x03, 0x08, 0x20,
+    /* BNEI GPR6 I32 0 -16 (free) */
+    0x5C, 0x20, 0x04, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xF0,
+    /* FLAT_MALLOC GPR2 GPR6 */
+    0x7D, 0x02, 0x20,
+    /* LOAD GPR2 I32 10000 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x27, 0x10,
+    /* FLAT_MALLOC GPR2 GPR4 */
+    0x7D, 0x02, 0x08,
+    /* ADDI GPR4 I32 9000 GPR3 */
+    0x3E, 0x08, 0x04, 0x00, 0x00, 0x23, 0x28, 0x04,
+    /* FLAT_STORE GPR3 GPR7 */
+    0x7F, 0x04, 0x40,
+    /* FLAT_FREE GPR4 */
+    0x7E, 0x08,
+    /* FLAT_MALLOC GPR2 GPR4 */
+    0x7D, 0x02, 0x08,
+    /* ADDI GPR4 I32 9000 GPR3 */
+    0x3E, 0x08, 0x04, 0x00, 0x00, 0x23, 0x28, 0x04,
+    /* FLAT_GET GPR3 GPR1 */
+    0x80, 0x04, 0x01,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char forge[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR2 I32 2 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x02,
+    /* LOAD GPR7 I64 0x100000000000 */
+    0x02, 0x40, 0x06, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* FLAT_MALLOC GPR2 GPR4 */
+    0x7D, 0x02, 0x08,
+    /* FLAT_FREE GPR4 */
+    0x7E, 0x08,
+    /* ADDI GPR4 I32 -1 GPR3 */
+    0x3E, 0x08, 0x04, 0xFF, 0xFF, 0xFF, 0xFF, 0x04,
+    /* FLAT_STORE GPR3 GPR7 */
+    0x7F, 0x04, 0x40,
+    /* FLAT_MALLOC GPR2 GPR5 */
+    0x7D, 0x02, 0x10,
+    /* FLAT_MALLOC GPR2 GPR6 */
+    0x7D, 0x02, 0x20,
+    /* ADDI GPR6 I32 -1 GPR3 */
+    0x3E, 0x20, 0x04, 0xFF, 0xFF, 0xFF, 0xFF, 0x04,
+    /* FLAT_STORE GPR3 GPR7 */
+    0x7F, 0x04, 0x40,
+    /* FLAT_FREE GPR6 */
+    0x7E, 0x20,
+    /* FLAT_MALLOC GPR2 GPR0 */
+    0x7D, 0x02, 0x00,
+    /* ADD3 GPR5 GPR0 GPR1 */
+    0x2A, 0x10, 0x00, 0x01,
+    /* HLT */
+    0x01
+};
+
+static const unsigned char handles[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR2 I32 64 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x40,
+    /* MALLOC_HANDLE GPR2 GPR0 */
+    0x81, 0x02, 0x00,
+    /* LOAD GPR2 I32 1 */
+    0x02, 0x02, 0x04, 0x00, 0x00, 0x00, 0x01,
+    /* LOAD GPR1 I32 0 */
+    0x02, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* new: */
+    /* MALLOC_HANDLE GPR2 GPR4 */
+    0x81, 0x02, 0x08,
+    /* STORE_HANDLE GPR4 GPR0 GPR7 */
+    0x83, 0x08, 0x00, 0x40,
+    /* STORE_HANDLE GPR7 GPR4 GPR1 */
+    0x83, 0x40, 0x08, 0x01,
+    /* ADDI GPR7 I32 1 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* BLTI GPR7 I32 40 -19 (new) */
+    0x57, 0x40, 0x04, 0x00, 0x00, 0x00, 0x28, 0xFF, 0xFF, 0xFF, 0xED,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* free: */
+    /* GET_HANDLE GPR0 GPR7 GPR4 */
+    0x84, 0x00, 0x40, 0x08,
+    /* FREE_HANDLE GPR4 */
+    0x82, 0x08,
+    /* ADDI GPR7 I32 2 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x02, 0x40,
+    /* BLTI GPR7 I32 40 -14 (free) */
+    0x57, 0x40, 0x04, 0x00, 0x00, 0x00, 0x28, 0xFF, 0xFF, 0xFF, 0xF2,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* again: */
+    /* MALLOC_HANDLE GPR2 GPR4 */
+    0x81, 0x02, 0x08,
+    /* STORE_HANDLE GPR4 GPR0 GPR7 */
+    0x83, 0x08, 0x00, 0x40,
+    /* ADDI GPR7 I32 100 GPR3 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x64, 0x04,
+    /* STORE_HANDLE GPR3 GPR4 GPR1 */
+    0x83, 0x04, 0x08, 0x01,
+    /* ADDI GPR7 I32 2 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x02, 0x40,
+    /* BLTI GPR7 I32 40 -27 (again) */
+    0x57, 0x40, 0x04, 0x00, 0x00, 0x00, 0x28, 0xFF, 0xFF, 0xFF, 0xE5,
+    /* LOAD GPR5 I64 0 */
+    0x02, 0x10, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR7 I32 0 */
+    0x02, 0x40, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* sum: */
+    /* GET_HANDLE GPR0 GPR7 GPR4 */
+    0x84, 0x00, 0x40, 0x08,
+    /* GET_HANDLE GPR4 GPR1 GPR3 */
+    0x84, 0x08, 0x01, 0x04,
+    /* ADD3 GPR5 GPR3 GPR5 */
+    0x2A, 0x10, 0x04, 0x10,
+    /* ADDI GPR7 I32 1 GPR7 */
+    0x3E, 0x40, 0x04, 0x00, 0x00, 0x00, 0x01, 0x40,
+    /* BLTI GPR7 I32 40 -20 (sum) */
+    0x57, 0x40, 0x04, 0x00, 0x00, 0x00, 0x28, 0xFF, 0xFF, 0xFF, 0xEC,
+    /* MOVE GPR4 GPR6 */
+    0x03, 0x08, 0x20,
+    /* HLT */
+    0x01
+};
+
+
+/*
+ * Programs, and the register of the first thread holding their result once
+ * they halt with the value it must hold, -1 for no result to check
+ */
+static const struct
+{
+    const char *name;
+    const unsigned char *code;
+    size_t size;
+    int reg;
+    int64_t value;
+} programs[] =
+{
+    {"arithmetic",  arithmetic,  sizeof(arithmetic),  -1,          0},
+    {"retype",      retype,      sizeof(retype),      -1,          0},
+    {"memory",      memory,      sizeof(memory),      -1,          0},
+    {"nested",      nested,      sizeof(nested),      -1,          0},
+    {"jump",        jump,        sizeof(jump),        -1,          0},
+    {"destination", destination, sizeof(destination), -1,          0},
+    {"immediate",   immediate,   sizeof(immediate),   -1,          0},
+    {"branch",      branch,      sizeof(branch),      -1,          0},
+    {"multiway",    multiway,    sizeof(multiway),    -1,          0},
+    {"threads",     threads,     sizeof(threads),      6,    4498500},
+    {"parfor",      parfor,      sizeof(parfor),       6,  332833500},
+    {"spread",      spread,      sizeof(spread),       5, 4999950000},
+    {"rendezvous",  rendezvous,  sizeof(rendezvous),   5,       4950},
+    {"mutex",       mutex,       sizeof(mutex),        5,      16000},
+    {"atomic",      atomic,      sizeof(atomic),       5,    7998000},
+    {"convert",     convert,     sizeof(convert),      5,        110},
+    {"channel",     channel,     sizeof(channel),      5,       9900},
+    {"retire",      retire,      sizeof(retire),       7,       2009},
+    {"reuse",       reuse,       sizeof(reuse),        5,     180300},
+    {"typed",       typed,       sizeof(typed),        5,      34858},
+    {"mapped",      mapped,      sizeof(mapped),       7,         42},
+    {"flat",        flat,        sizeof(flat),         5,     124750},
+    {"forge",       forge,       sizeof(forge),        1,          7},
+    {"handles",     handles,     sizeof(handles),      5,       2780}
+};
+
+/* Threshold that runs the bytecode profiled instead */
+#define PLAIN UINT32_MAX
+
+/* Runs the bytecode, compiling loops once they ran threshold times if > 0 */
+static VM run(const char *path, uint32_t threshold)
+{
+    VM vm = pvm_initialise(path);
+
+    if (threshold == PLAIN)
+        csg_profile(&vm.codeseg);
+    else if (threshold > 0)
+    {
+        jit_enable(&vm);
+        vm.jit.threshold = threshold;
+    }
+    pvm_run(&vm);
+
+    return vm;
+}
+
+/* Compares the values two PrimitiveData hold, ignoring unused bytes */
+static int same(const PrimitiveData *a, const PrimitiveData *b)
+{
+    if (a->storage != b->storage)
+        return 0;
+
+    switch (a->storage)
+    {
+        case I8: case UI8:   return a->ui8 == b->ui8;
+        case I16: case UI16: return a->ui16 == b->ui16;
+        case I32: case UI32: return a->ui32 == b->ui32;
+        default:             return a->ui64 == b->ui64;
+    }
+}
+
+/* Whether two registers hold offsets of the same instruction */
+static int same_target(const VM *a, const VM *b, const PrimitiveData *x, const PrimitiveData *y)
+{
+    va_t i = DATA_RETRIEVER_INT(*x), j = DATA_RETRIEVER_INT(*y);
+
+    return x->storage == y->storage && i <= a->codeseg.size && j <= b->codeseg.size &&
+           a->codeseg.offsetmap[i] != CSG_NOINSTR && a->codeseg.offsetmap[i] == b->codeseg.offsetmap[j];
+}
+
+static int compare(const VM *a, const VM *b)
+{
+    const ControlUnit *x = &a->core.thread_pool[0].controlunit;
+    const ControlUnit *y = &b->core.thread_pool[0].controlunit;
+
+    for (int i = 0; i < 9; i++)
+        if (!same(&x->regfile[i], &y->regfile[i]) && !same_target(a, b, &x->regfile[i], &y->regfile[i]))
+            return printf("register %d differs", i), 0;
+
+    for (size_t i = 0; i < a->staticseg.size; i++)
+        for (size_t j = 0; j < a->staticseg.var_pool[i].size; j++)
+            if (!same(&a->staticseg.var_pool[i].primdata_arr[j], &b->staticseg.var_pool[i].primdata_arr[j]))
+                return printf("static 0x%zX:0x%zX differs", i, j), 0;
+
+    for (size_t i = 0; i < a->heap.size; i++)
+    {
+        const HeapFrame *x = &a->heap.var_pool[i], *y = &b->heap.var_pool[i];
+
+        if (x->occupied && x->type != 0 &&
+            (x->type != y->type || memcmp(x->raw, y->raw, heap_width(x->type) * x->framesize) != 0))
+            return printf("heap 0x%zX differs", i), 0;
+        for (size_t j = 0; x->occupied && x->type == 0 && j < x->framesize; j++)
+            if (!same(&x->block[j], &y->block[j]))
+                return printf("heap 0x%zX:0x%zX differs", i, j), 0;
+    }
+
+    if (a->heap.flattop != b->heap.flattop)
+        return printf("flat region differs"), 0;
+    for (size_t i = 1; i < a->heap.flattop; i++)
+        if (!same(&a->heap.flat[i], &b->heap.flat[i]))
+            return printf("flat 0x%zX differs", i), 0;
+
+    if (a->core.scheduler.clocks != b->core.scheduler.clocks)
+        return printf("clocks differ"), 0;
+
+    return 1;
+}
+
+int main(void)
+{
+    static const uint32_t thresholds[] = {1, 10, PLAIN};
+    char path[] = "/tmp/pvmjitXXXXXX";
+    char compact[] = "/tmp/pvmjitXXXXXX";
+    int failures = 0;
+    int fd = mkstemp(path);
+    int cfd = mkstemp(compact);
+
+    if (fd < 0 || cfd < 0)
+        return 1;
+    close(fd);
+    close(cfd);
+
+    for (size_t i = 0; i < sizeof(programs) / sizeof(programs[0]); i++)
+    {
+        FILE *fp = fopen(path, "wb");
+        fwrite(programs[i].code, programs[i].size, 1, fp);
+        fclose(fp);
+
+        VM interpreted = run(path, 0);
+        if (programs[i].reg >= 0)
+        {
+            const PrimitiveData *result = &interpreted.core.thread_pool[0].controlunit.regfile[programs[i].reg];
+
+            printf("%-12s result         ", programs[i].name);
+            if (result->storage != 0 && DATA_RETRIEVER_INT(*result) == programs[i].value)
+                printf("ok");
+            else
+            {
+                printf("register %d holds %lld, not %lld", programs[i].reg,
+                       (long long) DATA_RETRIEVER_INT(*result), (long long) programs[i].value);
+                failures++;
+            }
+            printf("\n");
+        }
+        for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++)
+        {
+            VM compiled = run(path, thresholds[t]);
+
+            if (thresholds[t] == PLAIN)
+                printf("%-12s plain          ", programs[i].name);
+            else
+                printf("%-12s threshold %-4u ", programs[i].name, thresholds[t]);
+            if (compare(&interpreted, &compiled))
+                printf("ok");
+            else
+                failures++;
+            printf("\n");
+            pvm_finalise(&compiled);
+        }
+
+        opt_compact(path, compact);
+        VM converted = run(compact, 0);
+        printf("%-12s compact        ", programs[i].name);
+        if (compare(&interpreted, &converted))
+            printf("ok");
+        else
+            failures++;
+        printf("\n");
+        pvm_finalise(&converted);
+
+        pvm_finalise(&interpreted);
+    }
+    unlink(path);
+    unlink(compact);
+
+    return failures != 0;
+}
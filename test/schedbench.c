@@ -0,0 +1,112 @@
+#include "../include/vm.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Stress benchmark of the scheduler. Every thread runs the same counting loop,
+ * whose backward branch is a switch point whenever other threads are alive,
+ * so the core picks a thread every two instructions. The loop is shared out
+ * between more and more threads, up to tens of thousands, for the same number
+ * of instructions in total. The time per instruction should not grow with the
+ * number of threads.
+ *
+ * Then the most threads run on more and more workers, up to one per CPU or
+ * the number given as argument, which should scale the throughput.
+ */
+
+static const unsigned char loop[] =
+{
+    /* Header */
+    0xEB, 0x1C, 0xFA, 0x17,
+    /* Static Segment Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* Heap Size */
+    0x00, 0x00, 0x00, 0x00,
+    /* LOAD GPR0 I32 0 */
+    0x02, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+    /* loop: */
+    /* ADDI GPR0 I32 1 GPR0 */
+    0x3E, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00,
+    /* BLTI GPR0 I32 iterations -8 (loop) */
+    0x57, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xF8,
+    /* HLT */
+    0x01
+};
+
+/* Where the number of iterations goes in loop */
+#define ITERATIONS_AT 30
+
+/* Most threads of a run, every one maps a stack and its guard page */
+#define THREADS 16384
+
+/* Instructions retired by all the threads of a run together */
+#define TOTAL 40000000
+
+/* Runs 'threads' threads of 'iterations' loops each, returns the seconds taken */
+static double run(const char *path, unsigned int threads, uint32_t iterations, unsigned int workers,
+                  vmclock_t *retired)
+{
+    unsigned char code[sizeof(loop)];
+    struct timespec start, end;
+    FILE *fp;
+    VM vm;
+
+    memcpy(code, loop, sizeof(loop));
+    for (int b = 0; b < 4; b++)
+        code[ITERATIONS_AT + b] = iterations >> (24 - 8 * b);
+    fp = fopen(path, "wb");
+    fwrite(code, sizeof(code), 1, fp);
+    fclose(fp);
+
+    /* The first thread spawned is the master thread */
+    vm = pvm_initialise(path);
+    vm.core.worker_num = workers;
+    for (unsigned int i = 0; i < threads; i++)
+        thr_spawn(&vm, 0x0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pvm_run(&vm);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *retired = sch_stamp(&vm.core.scheduler);
+    pvm_finalise(&vm);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    static const unsigned int threads[] = {1, 4, 16, 64, 256, 4096, THREADS};
+    unsigned int workers = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    char path[] = "/tmp/pvmschedXXXXXX";
+    int fd = mkstemp(path);
+    vmclock_t retired;
+    double seconds, single = 0;
+
+    if (fd < 0)
+        return 1;
+    close(fd);
+
+    printf("threads   instructions   ns/instruction\n");
+    for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); t++)
+    {
+        seconds = run(path, threads[t], TOTAL / 2 / threads[t], 1, &retired);
+        printf("%7u %14lu %16.2f\n", threads[t], retired, seconds * 1e9 / retired);
+    }
+
+    /* Doubles the workers up to the last number, which always runs */
+    if (workers > WORKER_LIMIT)
+        workers = WORKER_LIMIT;
+    printf("\nworkers   instructions   Minstructions/s   speedup\n");
+    for (unsigned int w = 1; w <= workers; w = w < workers && w * 2 > workers ? workers : w * 2)
+    {
+        seconds = run(path, THREADS, TOTAL / 2 / THREADS * 4, w, &retired);
+        if (w == 1)
+            single = retired / seconds;
+        printf("%7u %14lu %17.1f %9.2f\n", w, retired, retired / seconds / 1e6, retired / seconds / single);
+    }
+    unlink(path);
+
+    return 0;
+}